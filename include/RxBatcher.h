@@ -0,0 +1,69 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef RX_BATCHER_H_
+#define RX_BATCHER_H_
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+
+//UART read coalescing: small reads stay in the UART RX ring until either
+//enough bytes arrived or the oldest of them waited long enough
+#ifndef SERIAL_COALESCE_MAX_BYTES
+#define SERIAL_COALESCE_MAX_BYTES 512
+#endif
+#ifndef SERIAL_COALESCE_MAX_US
+#define SERIAL_COALESCE_MAX_US    2000
+#endif
+
+//Target output on its way from the RX ring of the core serial driver to the
+//fan-out. The UART interrupt fills the ring, loop() takes it in batches of
+//up to SERIAL_COALESCE_MAX_BYTES read in bulk. When the ring was full the
+//driver discards its oldest byte and raises a flag, which hasOverrun()
+//clears: overruns() counts the polls that found it raised, each stands
+//for one or more bytes lost, how many the driver does not tell.
+class RxBatcher
+{
+  public:
+    RxBatcher(HardwareSerial &port);
+
+    //A batch is full or its oldest byte waited long enough, the first byte
+    //only starts the coalescing clock
+    bool ready();
+    //Bytes the next batch takes, at most max; 0 while it is still
+    //coalescing. Polls the overrun flag.
+    size_t poll(size_t max = SERIAL_COALESCE_MAX_BYTES);
+    //Takes len bytes of the batch poll() sized into buf
+    size_t read(uint8_t *buf, size_t len);
+
+    //Stats
+    uint32_t overruns() const { return _overruns; }
+
+  private:
+    HardwareSerial &_port;
+    bool _pending;
+    uint32_t _pendingSince;
+    uint32_t _overruns;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <Arduino.h>
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS 12
+#endif
+//Sleep of a pass where no task had work, hands the CPU to the WiFi stack.
+//The UART keeps filling its interrupt driven RX ring meanwhile.
+#ifndef SCHED_IDLE_SLEEP_MS
+#define SCHED_IDLE_SLEEP_MS 1
+#endif
+
+//Cooperative run-to-completion scheduler for loop(). Each task has a cheap
+//ready() check (data waiting, queue not empty, deadline reached) and/or a
+//period; a pass only runs the tasks that have work, in the order they were
+//added, and sleeps when none had any instead of spinning on empty sources.
+class Scheduler
+{
+  public:
+    typedef bool (*ReadyFunc)();
+    typedef void (*RunFunc)();
+
+    Scheduler();
+
+    //ready may be NULL for a task that only runs every period_ms, a period
+    //of 0 means the task runs only when ready() says so
+    bool add(const char *name, ReadyFunc ready, RunFunc run, uint32_t period_ms = 0);
+
+    //One pass over the tasks, returns how many of them ran
+    uint8_t runOnce();
+
+    //Stats
+    uint8_t count() const { return _count; }
+    const char *name(uint8_t i) const { return _tasks[i].name; }
+    uint32_t runs(uint8_t i) const { return _tasks[i].runs; }
+    uint32_t maxMicros(uint8_t i) const { return _tasks[i].maxMicros; }
+    uint32_t idlePasses() const { return _idlePasses; }
+    uint32_t busyPasses() const { return _busyPasses; }
+    //share of the time spent sleeping since boot, in percent
+    uint8_t idlePercent() const;
+
+  private:
+    struct Task
+    {
+      const char *name;
+      ReadyFunc ready;
+      RunFunc run;
+      uint32_t periodMillis;
+      uint32_t lastRun;
+      uint32_t runs;
+      uint32_t maxMicros;
+    };
+
+    Task _tasks[SCHED_MAX_TASKS];
+    uint8_t _count;
+    uint32_t _idlePasses;
+    uint32_t _busyPasses;
+    uint64_t _idleMicros;
+    uint64_t _busyMicros;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef SCREEN_MODEL_H_
+#define SCREEN_MODEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <CircularBuffer.h>
+
+//Screen geometry assumed for the target console, VT100 default
+#ifndef SCREEN_COLS
+#define SCREEN_COLS 80
+#endif
+#ifndef SCREEN_ROWS
+#define SCREEN_ROWS 24
+#endif
+//Plain text of lines scrolled off the top of the screen
+#ifndef SCREEN_HISTORY_SIZE
+#define SCREEN_HISTORY_SIZE 1024
+#endif
+//Longest piece render() emits at once, the final cursor and mode sequences
+#define SCREEN_RENDER_MIN 96
+
+//Minimal VT100/xterm screen model fed incrementally with the UART stream.
+//It keeps a cell grid, cursor and attributes so a new client can be sent a
+//repaint of the current screen instead of a raw byte tail that may start in
+//the middle of an escape sequence or a UTF-8 codepoint. The repaint is lossy
+//across the alternate screen: the main screen is only kept as history text.
+//Up to 161 different non-ASCII characters and 64 attribute combinations can
+//be on screen at once, any more are repainted as '?' and plain text.
+class ScreenModel
+{
+  public:
+    ScreenModel();
+
+    //Feeds terminal output bytes
+    void write(const uint8_t *data, size_t len);
+
+    //Clears screen, history and parser state
+    void reset();
+
+    enum RenderPhase { RENDER_START, RENDER_HISTORY, RENDER_ROWS, RENDER_TAIL, RENDER_DONE };
+
+    //Where an incremental render stopped, phase is RENDER_DONE once all is out
+    struct RenderPos
+    {
+      uint8_t phase;
+      uint16_t offset;      //into the history
+      uint8_t x, y, end;    //cell, and where the row's trailing blanks start
+      uint8_t flags, color; //attributes the client has at this point
+    };
+
+    //Starts a render of history plus a repaint of the current screen
+    void renderBegin(RenderPos &pos) const;
+
+    //Renders the next part into out, returns the bytes produced, 0 once it is
+    //all out. Any max of SCREEN_RENDER_MIN or more makes progress. The model
+    //must not be written to between the calls of one render.
+    size_t render(RenderPos &pos, uint8_t *out, size_t max) const;
+
+  private:
+    //Cells are two bytes. Printable ASCII is stored as it is, other
+    //characters and the attributes are indexes into small tables of the ones
+    //in use, compacted from the grid when they fill up.
+    struct Cell
+    {
+      uint8_t glyph;  //printable ASCII, or a _glyphs index
+      uint8_t attr;   //_attrs index
+    };
+    enum { GLYPHS = 161, ATTRS = 64 }; //byte values that are not ASCII; SGR states on screen
+
+    enum ParserState { ST_GROUND, ST_ESC, ST_CSI, ST_STRING, ST_STRING_ESC, ST_CHARSET };
+
+    Cell _cells[SCREEN_ROWS][SCREEN_COLS];
+    uint16_t _glyphs[GLYPHS];  //BMP codepoints
+    uint8_t _glyphCount;
+    uint16_t _attrs[ATTRS];    //SM_* flags << 8 | fg in low nibble, bg in high nibble
+    uint8_t _attrCount;
+    uint16_t _lastChar;        //most recent lookups
+    uint8_t _lastGlyph;
+    uint16_t _lastAttrKey;
+    uint8_t _lastAttr;
+    CircularBuffer<uint8_t,SCREEN_HISTORY_SIZE> _history;
+    bool _historyWrapped;
+
+    uint8_t _cx, _cy;
+    bool _wrapPending;
+    uint8_t _flags, _color;
+    uint8_t _top, _bottom; //scroll region, inclusive
+    bool _cursorHidden;
+    bool _altScreen;
+    uint8_t _savedX, _savedY, _savedFlags, _savedColor;
+
+    ParserState _state;
+    uint16_t _params[8];
+    uint8_t _nparams;
+    bool _private;
+    bool _intermediate;
+    uint8_t _charsetTarget;
+
+    uint32_t _utf8;
+    uint8_t _utf8Left;
+
+    void putChar(uint16_t ch);
+    void control(uint8_t c);
+    void escape(uint8_t c);
+    void csi(uint8_t final);
+    void sgr();
+    void index();
+    void reverseIndex();
+    void scrollUp(uint8_t top, uint8_t bottom, uint8_t n);
+    void scrollDown(uint8_t top, uint8_t bottom, uint8_t n);
+    void clearCells(uint8_t row, uint8_t from, uint8_t to);
+    void clearRows(uint8_t from, uint8_t to);
+    void saveLine(uint8_t row);
+    void moveTo(int x, int y);
+    uint16_t param(uint8_t i, uint16_t def) const;
+    uint8_t rowEnd(uint8_t row) const;
+    uint8_t glyphOf(uint16_t ch);
+    uint8_t attrOf(uint8_t flags, uint8_t color);
+    void compactGlyphs();
+    void compactAttrs();
+    uint16_t charAt(const Cell &c) const;
+    uint8_t flagsAt(const Cell &c) const { return _attrs[c.attr] >> 8; }
+    uint8_t colorAt(const Cell &c) const { return _attrs[c.attr] & 0xFF; }
+};
+
+#endif
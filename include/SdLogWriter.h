@@ -0,0 +1,169 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef SD_LOG_WRITER_H_
+#define SD_LOG_WRITER_H_
+
+#include <Arduino.h>
+#include <SD.h>
+#include <CircularBuffer.h>
+
+#define SD_SECTOR_SIZE 512
+//Write-behind buffer, whole sectors
+#ifndef SD_LOG_BUFFER_SECTORS
+#define SD_LOG_BUFFER_SECTORS 4
+#endif
+//Max time buffered data may stay off the card, the data-loss window on power cut
+#ifndef SD_LOG_FLUSH_MS
+#define SD_LOG_FLUSH_MS 1000
+#endif
+//Sync the FAT/directory entry at least every this many written bytes
+#ifndef SD_LOG_FLUSH_BYTES
+#define SD_LOG_FLUSH_BYTES 16384
+#endif
+//An index record is emitted about every SD_LOG_INDEX_INTERVAL bytes, listing
+//one (timestamp, offset) entry per SD_LOG_INDEX_STRIDE bytes before it
+#ifndef SD_LOG_INDEX_INTERVAL
+#define SD_LOG_INDEX_INTERVAL 65536
+#endif
+#ifndef SD_LOG_INDEX_STRIDE
+#define SD_LOG_INDEX_STRIDE 4096
+#endif
+#define SD_LOG_INDEX_ENTRIES (SD_LOG_INDEX_INTERVAL / SD_LOG_INDEX_STRIDE)
+//The log is split into TTLnnnnn.BIN segments of about SD_LOG_SEGMENT_SIZE
+//bytes in the card root, the oldest is removed once there are more than
+//SD_LOG_MAX_SEGMENTS (4MB * 64 = 256MB by default)
+#ifndef SD_LOG_SEGMENT_SIZE
+#define SD_LOG_SEGMENT_SIZE (4UL * 1024 * 1024)
+#endif
+#ifndef SD_LOG_MAX_SEGMENTS
+#define SD_LOG_MAX_SEGMENTS 64
+#endif
+
+//Log file format, all integers little endian. The file is a sequence of
+//records, each an 8 byte header followed by len payload bytes:
+//  uint8 magic (SD_LOG_MAGIC), uint8 type, uint16 len, uint32 millis()
+//SD_REC_BOOT  "ETTL", uint8 version, uint32 now() at boot
+//SD_REC_RX    bytes received from the target UART
+//SD_REC_TX    bytes sent to the target UART
+//SD_REC_INDEX uint32 offset of the previous index record (0xFFFFFFFF if none),
+//             uint16 count, count * (uint32 millis, uint32 record offset),
+//             uint32 millis() wraps since boot at this record
+//SD_REC_SEGMENT "ETTL", uint8 version, uint32 segment number, uint32 now(),
+//             uint32 millis() wraps since boot,
+//             first record of a segment continuing the previous one
+//Header timestamps wrap after 49.7 days, the wrap counts in index and segment
+//records let readers extend them to 64 bits.
+//tools/ttllog.py decodes, greps and seeks by time through the index.
+#define SD_LOG_MAGIC    0xE7
+#define SD_LOG_VERSION  2
+#define SD_REC_BOOT     0x01
+#define SD_REC_RX       0x02
+#define SD_REC_TX       0x03
+#define SD_REC_INDEX    0x04
+#define SD_REC_SEGMENT  0x05
+#define SD_REC_HEADER_SIZE 8
+
+//Write-behind logger for the SD card. record() only copies into RAM and is
+//safe on the UART hot path; service() is called from loop() and writes at
+//most one sector-aligned block or one sync per call, so the loop stall is
+//bounded by a single card operation, also when the flush deadline drains
+//the buffer.
+//Segment rotation is spread over several service() calls (drain, close,
+//open, remove oldest), one card operation each, and never scans directories.
+class SdLogWriter
+{
+  public:
+    SdLogWriter();
+
+    //Finds the segments on the card (once, at setup) and appends a boot
+    //record to the newest one
+    bool begin();
+    void end();
+    bool isOpen() { return _open; }
+
+    //Buffers one framed record, a record that does not fit is dropped whole
+    bool record(uint8_t type, const uint8_t *data, size_t len);
+
+    //Moves buffered data to the card, call from loop()
+    void service();
+    //True when service() has something to do right now
+    bool serviceDue() const;
+
+    //Writes everything buffered and syncs the file
+    void flush();
+
+    uint32_t bytesWritten() const { return _bytesWritten; }
+    uint32_t bytesDropped() const { return _bytesDropped; }
+    uint32_t recordsDropped() const { return _recordsDropped; }
+    uint32_t flushes() const { return _flushes; }
+    uint32_t maxServiceMicros() const { return _maxServiceMicros; }
+    uint32_t rotations() const { return _rotations; }
+    uint32_t segment() const { return _lastSegment; }
+    size_t buffered() const { return _buffer.size(); }
+
+  private:
+    enum RotateState { ROT_NONE, ROT_DRAIN, ROT_CLOSE, ROT_OPEN, ROT_REMOVE };
+
+    File _file;
+    bool _open;
+    CircularBuffer<uint8_t,SD_LOG_BUFFER_SECTORS * SD_SECTOR_SIZE> _buffer;
+    uint32_t _filePos;
+    uint32_t _unsynced;       //bytes written since the last sync
+    uint32_t _oldestMillis;   //when the oldest buffered byte arrived
+    uint32_t _bytesWritten;
+    uint32_t _bytesDropped;
+    uint32_t _recordsDropped;
+
+    uint32_t _streamPos;      //file offset of the next record
+    uint32_t _lastIndexPos;
+    uint32_t _nextIndexAt;
+    uint32_t _nextEntryAt;
+    uint32_t _entryMillis[SD_LOG_INDEX_ENTRIES];
+    uint32_t _entryOffset[SD_LOG_INDEX_ENTRIES];
+    uint8_t _entryCount;
+    uint32_t _flushes;
+    uint32_t _maxServiceMicros;
+    uint32_t _lastMillis;
+    uint32_t _millisWraps;    //high word of the 64 bit time since boot
+
+    uint32_t _firstSegment;
+    uint32_t _lastSegment;
+    RotateState _rotState;
+    size_t _cutBytes;         //buffered bytes that still belong to the current segment
+    uint32_t _rotations;
+
+    uint32_t stamp();
+    void append(const uint8_t *data, size_t len);
+    void appendHeader(uint8_t type, size_t len, uint32_t ms);
+    bool writeIndex(uint32_t ms);
+    size_t writeOut(size_t len);
+    size_t pending() const;
+    void sync();
+    void cutSegment(uint32_t ms);
+    void rotateStep();
+    bool openSegment(uint32_t n);
+    static void segmentName(char *buf, uint32_t n);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#ifndef STATUS_VIEW_H_
+#define STATUS_VIEW_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Adafruit_SSD1306.h>
+
+//Minimum time between two OLED frames, a full frame is 1KB over I2C
+#ifndef STATUS_VIEW_FRAME_MS
+#define STATUS_VIEW_FRAME_MS 250
+#endif
+//How long the RX/TX markers stay lit after traffic
+#ifndef STATUS_VIEW_ACTIVITY_MS
+#define STATUS_VIEW_ACTIVITY_MS 500
+#endif
+#define STATUS_VIEW_COLS 21 //6x8 font cells on 128x64
+#define STATUS_VIEW_LINES 8
+#define STATUS_VIEW_EVENT_SIZE (STATUS_VIEW_COLS + 1)
+
+//Status model of the bridge shown on the OLED. The data path only bumps
+//counters and flags here; service() draws the model from loop() at most
+//once per STATUS_VIEW_FRAME_MS, and only when something visible changed.
+//Only the character cells that differ from the last frame are redrawn, so
+//the display's dirty tracking sends a few dozen bytes instead of 1KB.
+class StatusView
+{
+  public:
+    StatusView();
+
+    void begin(Adafruit_SSD1306 *display);
+
+    //Cheap setters, safe to call from the data path and web callbacks
+    void onRx(size_t len) { _rxBytes += len; _rxMillis = millis(); }
+    void onTx(size_t len) { _txBytes += len; _txMillis = millis(); }
+    void setClients(uint8_t telnet, uint8_t web);
+    void setIP(const IPAddress &ip);
+    void setBaud(uint32_t baud);
+    void event(const char *text, const IPAddress &ip);
+    //Health summary from the bridge stats
+    void setSummary(uint32_t dropped, uint32_t loop_max_us, uint32_t heap, uint8_t frag);
+    //Forces a redraw, e.g. after something else drew on the display
+    void invalidate() { _changed = true; _fullRedraw = true; }
+
+    bool frameDue() const { return millis() - _lastFrame >= STATUS_VIEW_FRAME_MS; }
+    //A frame is still on its way to the display
+    bool busy() const { return _display != NULL && _display->displayBusy(); }
+
+    //Sends the next slice of a frame on the way, otherwise redraws if a
+    //frame is due and the view changed. Call on every loop() pass.
+    void service();
+
+    uint32_t frames() const { return _frames; }
+
+  private:
+    Adafruit_SSD1306 *_display;
+    uint32_t _lastFrame;
+    uint32_t _frames;
+    bool _changed;
+    bool _fullRedraw;
+    char _shownText[STATUS_VIEW_LINES][STATUS_VIEW_COLS];
+
+    uint32_t _ip;
+    uint32_t _baud;
+    uint8_t _telnetClients;
+    uint8_t _webClients;
+    char _event[STATUS_VIEW_EVENT_SIZE];
+    uint32_t _dropped;
+    uint32_t _loopMaxMicros;
+    uint32_t _heap;
+    uint8_t _frag;
+
+    uint32_t _rxBytes;
+    uint32_t _txBytes;
+    uint32_t _rxMillis;
+    uint32_t _txMillis;
+    //what the last frame showed
+    uint32_t _shownRx;
+    uint32_t _shownTx;
+    bool _shownRxActive;
+    bool _shownTxActive;
+
+    void draw(bool rx_active, bool tx_active);
+};
+
+#endif
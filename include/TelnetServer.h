@@ -0,0 +1,135 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#ifndef TELNET_SERVER_H_
+#define TELNET_SERVER_H_
+
+#include <Arduino.h>
+#ifdef ESP32
+#include <AsyncTCP.h>
+#else
+#include <ESPAsyncTCP.h>
+#endif
+#include <CircularBuffer.h>
+
+#ifndef TELNET_MAX_CLIENTS
+#define TELNET_MAX_CLIENTS 5
+#endif
+//Per client send queue for what the TCP window does not take right away,
+//so a slow client never stalls the UART loop; new writes that do not fit
+//are dropped whole, what is queued already always goes out
+#ifndef TELNET_TX_QUEUE_SIZE
+#define TELNET_TX_QUEUE_SIZE 1024
+#endif
+
+//RFC 854 commands and the options negotiated here
+#define TELNET_IAC    255
+#define TELNET_DONT   254
+#define TELNET_DO     253
+#define TELNET_WONT   252
+#define TELNET_WILL   251
+#define TELNET_SB     250
+#define TELNET_IP     244
+#define TELNET_SE     240
+#define TELNET_OPT_BINARY 0
+#define TELNET_OPT_ECHO   1
+#define TELNET_OPT_SGA    3
+#define TELNET_OPT_NAWS   31
+
+//Telnet endpoint on ESPAsyncTCP. Input arrives in bulk through the onData
+//callback, output is added straight into each client's send window and the
+//remainder is queued and pushed again from the ack callback, so nothing here
+//needs polling from loop().
+//Both directions speak the telnet protocol: a per client state machine strips
+//IAC sequences and answers option negotiation before input reaches the
+//handler, and 0xFF in device output is doubled, so binary transfers pass
+//unchanged. On connect the server offers BINARY both ways, WILL ECHO and
+//SGA (the target echoes, the client should not) and asks for NAWS.
+class TelnetServer
+{
+  public:
+    typedef void (*InputHandler)(const uint8_t *data, size_t len);
+    typedef void (*ConnectHandler)(const IPAddress &ip);
+
+    TelnetServer(uint16_t port);
+
+    void begin();
+    //Called from the TCP callbacks, not from loop()
+    void onInput(InputHandler handler) { _onInput = handler; }
+    void onConnect(ConnectHandler handler) { _onConnect = handler; }
+
+    //Sends to every connected client
+    void write(const uint8_t *data, size_t len);
+
+    uint8_t count() const;
+    //Bytes every client can still queue without dropping
+    size_t queueRoom() const;
+
+    uint32_t bytesSent() const { return _bytesSent; }
+    uint32_t droppedBytes() const { return _droppedBytes; }
+
+    //Window size last reported by client i (NAWS), false if none yet
+    bool windowSize(uint8_t i, uint16_t &cols, uint16_t &rows) const;
+
+  private:
+    struct Slot
+    {
+      AsyncClient *client;
+      CircularBuffer<uint8_t,TELNET_TX_QUEUE_SIZE> queue;
+      //input parser
+      uint8_t state;
+      uint8_t verb;         //WILL/WONT/DO/DONT waiting for its option
+      uint8_t sbOption;
+      uint8_t sb[4];        //subnegotiation payload, only NAWS is kept
+      uint8_t sbLen;
+      bool crPending;       //last data byte was CR, a NUL after it is padding
+      //option bits, see OptionBit()
+      uint8_t local, localPending;
+      uint8_t remote, remotePending;
+      uint16_t cols, rows;
+    };
+
+    enum ParserState { TS_DATA, TS_IAC, TS_OPTION, TS_SB, TS_SB_IAC };
+
+    AsyncServer _server;
+    Slot _slots[TELNET_MAX_CLIENTS];
+    InputHandler _onInput;
+    ConnectHandler _onConnect;
+    uint32_t _bytesSent;
+    uint32_t _droppedBytes;
+
+    void accept(AsyncClient *client);
+    void disconnect(AsyncClient *client);
+    Slot *find(AsyncClient *client);
+    void flush(Slot &slot);
+    void writeRaw(const uint8_t *data, size_t len);
+    void send(Slot &slot, const uint8_t *data, size_t len);
+    void command(Slot &slot, uint8_t verb, uint8_t option);
+    void input(Slot &slot, const uint8_t *data, size_t len);
+    void deliver(Slot &slot, const uint8_t *data, size_t len);
+    void negotiate(Slot &slot, uint8_t verb, uint8_t option);
+    void subnegotiation(Slot &slot);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef TX_PACER_H_
+#define TX_PACER_H_
+
+#include <Arduino.h>
+#include <CircularBuffer.h>
+
+//Client input on its way to the target, written only as far as the UART TX
+//FIFO has room so a large paste never busy-waits in Serial.write()
+#ifndef UART_TX_QUEUE_SIZE
+#define UART_TX_QUEUE_SIZE 2048
+#endif
+//Defaults, changed at runtime with setPacing()/setFlow()
+#ifndef UART_TX_CHAR_DELAY_US
+#define UART_TX_CHAR_DELAY_US 0
+#endif
+#ifndef UART_TX_LINE_DELAY_MS
+#define UART_TX_LINE_DELAY_MS 0
+#endif
+
+#define TX_XON  0x11
+#define TX_XOFF 0x13
+
+//Paced writer for the UART TX side. Input is queued and written from loop()
+//as the target allows: a minimum gap after every character and/or after
+//every line end for consoles without flow control (U-Boot and friends drop
+//characters of a fast paste), or held while the target sent XOFF or keeps
+//its CTS line high. Nothing here waits, a paused queue just keeps filling
+//and drops the tail of input that no longer fits, along with everything
+//that arrives until the queue has drained.
+//Gaps are measured from the write into the TX FIFO; when the bridge is idle
+//the scheduler sleeps SCHED_IDLE_SLEEP_MS between passes, so delays below
+//that are rounded up to it.
+class TxPacer
+{
+  public:
+    enum Flow { FLOW_NONE, FLOW_XONXOFF, FLOW_CTS };
+
+    TxPacer(Stream &port);
+
+    //0 turns the respective delay off
+    void setPacing(uint16_t char_us, uint16_t line_ms);
+    //cts_pin is an input driven low by the target while it can receive,
+    //only used with FLOW_CTS
+    void setFlow(Flow flow, int8_t cts_pin = -1);
+
+    //Queues input, returns how many bytes fit
+    size_t push(const uint8_t *data, size_t len);
+
+    //Queue not empty, not held and the next gap has passed
+    bool ready() const;
+    //Writes what the pacing and the TX FIFO allow
+    void service();
+
+    //Output of the target, watched for XON/XOFF
+    void onRx(const uint8_t *data, size_t len);
+
+    uint16_t charDelay() const { return _charMicros; }
+    uint16_t lineDelay() const { return _lineMillis; }
+    Flow flow() const { return _flow; }
+    bool held() const;
+
+    //Stats
+    size_t queued() const { return _queue.size(); }
+    uint32_t bytesWritten() const { return _bytesWritten; }
+    uint32_t droppedBytes() const { return _droppedBytes; }
+    uint32_t xoffs() const { return _xoffs; }
+
+  private:
+    Stream &_port;
+    CircularBuffer<uint8_t,UART_TX_QUEUE_SIZE> _queue;
+    uint16_t _charMicros;
+    uint16_t _lineMillis;
+    Flow _flow;
+    int8_t _ctsPin;
+    bool _xoff;
+    bool _waiting;
+    uint32_t _resumeMicros;
+    bool _overflow;
+    uint32_t _bytesWritten;
+    uint32_t _droppedBytes;
+    uint32_t _xoffs;
+
+    void wait(uint32_t us);
+};
+
+#endif
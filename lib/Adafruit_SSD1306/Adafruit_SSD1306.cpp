@@ -171,13 +171,15 @@
 Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi,
                                    int8_t rst_pin, uint32_t clkDuring,
                                    uint32_t clkAfter)
-    : Adafruit_GFX(w, h), spi(NULL), wire(twi ? twi : &Wire), buffer(NULL),
+    : Adafruit_GFX(w, h), spi(NULL), wire(twi ? twi : &Wire), buffer(NULL), xferBuffer(NULL), xferCount(0),
       mosiPin(-1), clkPin(-1), dcPin(-1), csPin(-1), rstPin(rst_pin)
 #if ARDUINO >= 157
       ,
       wireClk(clkDuring), restoreClk(clkAfter)
 #endif
-{
+      ,
+      xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
 }
 
 /*!
@@ -210,9 +212,11 @@ Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi,
 Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, int8_t mosi_pin,
                                    int8_t sclk_pin, int8_t dc_pin,
                                    int8_t rst_pin, int8_t cs_pin)
-    : Adafruit_GFX(w, h), spi(NULL), wire(NULL), buffer(NULL),
+    : Adafruit_GFX(w, h), spi(NULL), wire(NULL), buffer(NULL), xferBuffer(NULL), xferCount(0),
       mosiPin(mosi_pin), clkPin(sclk_pin), dcPin(dc_pin), csPin(cs_pin),
-      rstPin(rst_pin) {}
+      rstPin(rst_pin), xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
+}
 
 /*!
     @brief  Constructor for SPI SSD1306 displays, using native hardware SPI.
@@ -243,8 +247,10 @@ Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, int8_t mosi_pin,
 Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, SPIClass *spi,
                                    int8_t dc_pin, int8_t rst_pin, int8_t cs_pin,
                                    uint32_t bitrate)
-    : Adafruit_GFX(w, h), spi(spi ? spi : &SPI), wire(NULL), buffer(NULL),
-      mosiPin(-1), clkPin(-1), dcPin(dc_pin), csPin(cs_pin), rstPin(rst_pin) {
+    : Adafruit_GFX(w, h), spi(spi ? spi : &SPI), wire(NULL), buffer(NULL), xferBuffer(NULL), xferCount(0),
+      mosiPin(-1), clkPin(-1), dcPin(dc_pin), csPin(cs_pin), rstPin(rst_pin),
+      xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
 #ifdef SPI_HAS_TRANSACTION
   spiSettings = SPISettings(bitrate, MSBFIRST, SPI_MODE0);
 #endif
@@ -279,8 +285,10 @@ Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, SPIClass *spi,
 Adafruit_SSD1306::Adafruit_SSD1306(int8_t mosi_pin, int8_t sclk_pin,
                                    int8_t dc_pin, int8_t rst_pin, int8_t cs_pin)
     : Adafruit_GFX(SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT), spi(NULL), wire(NULL),
-      buffer(NULL), mosiPin(mosi_pin), clkPin(sclk_pin), dcPin(dc_pin),
-      csPin(cs_pin), rstPin(rst_pin) {}
+      buffer(NULL), xferBuffer(NULL), xferCount(0), mosiPin(mosi_pin), clkPin(sclk_pin), dcPin(dc_pin),
+      csPin(cs_pin), rstPin(rst_pin), xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
+}
 
 /*!
     @brief  DEPRECATED constructor for SPI SSD1306 displays, using native
@@ -305,8 +313,9 @@ Adafruit_SSD1306::Adafruit_SSD1306(int8_t mosi_pin, int8_t sclk_pin,
 */
 Adafruit_SSD1306::Adafruit_SSD1306(int8_t dc_pin, int8_t rst_pin, int8_t cs_pin)
     : Adafruit_GFX(SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT), spi(&SPI), wire(NULL),
-      buffer(NULL), mosiPin(-1), clkPin(-1), dcPin(dc_pin), csPin(cs_pin),
-      rstPin(rst_pin) {
+      buffer(NULL), xferBuffer(NULL), xferCount(0), mosiPin(-1), clkPin(-1), dcPin(dc_pin), csPin(cs_pin),
+      rstPin(rst_pin), xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
 #ifdef SPI_HAS_TRANSACTION
   spiSettings = SPISettings(8000000, MSBFIRST, SPI_MODE0);
 #endif
@@ -328,8 +337,10 @@ Adafruit_SSD1306::Adafruit_SSD1306(int8_t dc_pin, int8_t rst_pin, int8_t cs_pin)
 */
 Adafruit_SSD1306::Adafruit_SSD1306(int8_t rst_pin)
     : Adafruit_GFX(SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT), spi(NULL), wire(&Wire),
-      buffer(NULL), mosiPin(-1), clkPin(-1), dcPin(-1), csPin(-1),
-      rstPin(rst_pin) {}
+      buffer(NULL), xferBuffer(NULL), xferCount(0), mosiPin(-1), clkPin(-1), dcPin(-1), csPin(-1),
+      rstPin(rst_pin), xferIndex(0), xferPos(0) {
+  clearDirty(0, SSD1306_MAX_PAGES - 1);
+}
 
 /*!
     @brief  Destructor for Adafruit_SSD1306 object.
@@ -339,6 +350,10 @@ Adafruit_SSD1306::~Adafruit_SSD1306(void) {
     free(buffer);
     buffer = NULL;
   }
+  if (xferBuffer) {
+    free(xferBuffer);
+    xferBuffer = NULL;
+  }
 }
 
 // LOW-LEVEL UTILS ---------------------------------------------------------
@@ -493,6 +508,11 @@ bool Adafruit_SSD1306::begin(uint8_t vcs, uint8_t addr, bool reset,
 
   if ((!buffer) && !(buffer = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8))))
     return false;
+  // nothing of an earlier begin() is still on its way or pending
+  xferCount = 0;
+  xferIndex = 0;
+  xferPos = 0;
+  clearDirty(0, (HEIGHT + 7) / 8 - 1);
 
   clearDisplay();
 
@@ -654,6 +674,7 @@ void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
       y = HEIGHT - y - 1;
       break;
     }
+    dirtyPage(y / 8, x, x);
     switch (color) {
     case SSD1306_WHITE:
       buffer[x + (y / 8) * WIDTH] |= (1 << (y & 7));
@@ -677,6 +698,7 @@ void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
 */
 void Adafruit_SSD1306::clearDisplay(void) {
   memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+  markDirty(0, 0, WIDTH - 1, (HEIGHT + 7) / 8 - 1);
 }
 
 /*!
@@ -756,6 +778,7 @@ void Adafruit_SSD1306::drawFastHLineInternal(int16_t x, int16_t y, int16_t w,
       w = (WIDTH - x);
     }
     if (w > 0) { // Proceed only if width is positive
+      dirtyPage(y / 8, x, x + w - 1);
       uint8_t *pBuf = &buffer[(y / 8) * WIDTH + x], mask = 1 << (y & 7);
       switch (color) {
       case SSD1306_WHITE:
@@ -859,6 +882,8 @@ void Adafruit_SSD1306::drawFastVLineInternal(int16_t x, int16_t __y,
       // use local byte registers for faster juggling
       uint8_t y = __y, h = __h;
       uint8_t *pBuf = &buffer[(y / 8) * WIDTH + x];
+      for (uint8_t page = y / 8; page <= (y + h - 1) / 8; page++)
+        dirtyPage(page, x, x);
 
       // do the first partial byte, if necessary - this requires some masking
       uint8_t mod = (y & 7);
@@ -976,39 +1001,87 @@ bool Adafruit_SSD1306::getPixel(int16_t x, int16_t y) {
     @brief  Get base address of display buffer for direct reading or writing.
     @return Pointer to an unsigned 8-bit array, column-major, columns padded
             to full byte boundary if needed.
+    @note   Changes made through the pointer cannot be tracked, so the whole
+            screen is marked dirty and the next display() sends all of it.
+            Call markDirty() instead after later direct writes.
 */
-uint8_t *Adafruit_SSD1306::getBuffer(void) { return buffer; }
+uint8_t *Adafruit_SSD1306::getBuffer(void) {
+  markDirty(0, 0, WIDTH - 1, (HEIGHT + 7) / 8 - 1);
+  return buffer;
+}
+
+/*!
+    @brief  Mark a window of the buffer as changed, so the next display()
+            sends it. Drawing functions do this on their own.
+    @param  x0
+            First column.
+    @param  page0
+            First page (8 pixel row band).
+    @param  x1
+            Last column, inclusive.
+    @param  page1
+            Last page, inclusive.
+    @return None (void).
+*/
+void Adafruit_SSD1306::markDirty(uint8_t x0, uint8_t page0, uint8_t x1,
+                                 uint8_t page1) {
+  uint8_t pages = (HEIGHT + 7) / 8;
+  if (x1 >= WIDTH)
+    x1 = WIDTH - 1;
+  if (page1 >= pages)
+    page1 = pages - 1;
+  if (x0 > x1)
+    return;
+  for (uint8_t page = page0; page <= page1; page++)
+    dirtyPage(page, x0, x1);
+}
+
+/*!
+    @brief  Check for buffer changes not yet sent to the display.
+    @return true if display() has something to send.
+*/
+bool Adafruit_SSD1306::isDirty(void) const {
+  for (uint8_t page = 0; page < (HEIGHT + 7) / 8; page++) {
+    if (dirtyX0[page] <= dirtyX1[page])
+      return true;
+  }
+  return false;
+}
+
+void Adafruit_SSD1306::clearDirty(uint8_t page0, uint8_t page1) {
+  for (uint8_t page = page0; page <= page1; page++) {
+    dirtyX0[page] = 0xFF;
+    dirtyX1[page] = 0;
+  }
+}
 
 // REFRESH DISPLAY ---------------------------------------------------------
 
 /*!
-    @brief  Push data currently in RAM to SSD1306 display.
-    @return None (void).
-    @note   Drawing operations are not visible until this function is
-            called. Call after each graphics command, or after a whole set
-            of graphics commands, as best needed by one's own application.
+    @brief  Set the column/page address window the following data fills.
+            Transaction must be started by the caller.
 */
-void Adafruit_SSD1306::display(void) {
-  TRANSACTION_START
-  static const uint8_t PROGMEM dlist1[] = {
-      SSD1306_PAGEADDR,
-      0,                      // Page start address
-      0xFF,                   // Page end (not really, but works here)
-      SSD1306_COLUMNADDR, 0}; // Column start address
-  ssd1306_commandList(dlist1, sizeof(dlist1));
-  ssd1306_command1(WIDTH - 1); // Column end address
+void Adafruit_SSD1306::setAddrWindow(uint8_t x0, uint8_t page0, uint8_t x1,
+                                     uint8_t page1) {
+  uint8_t cmd[6] = {SSD1306_PAGEADDR, page0, page1, SSD1306_COLUMNADDR, x0, x1};
+  if (wire) { // I2C, one transmission for the whole window
+    wire->beginTransmission(i2caddr);
+    WIRE_WRITE((uint8_t)0x00); // Co = 0, D/C = 0
+    for (uint8_t i = 0; i < sizeof(cmd); i++)
+      WIRE_WRITE(cmd[i]);
+    wire->endTransmission();
+  } else { // SPI
+    SSD1306_MODE_COMMAND
+    for (uint8_t i = 0; i < sizeof(cmd); i++)
+      SPIwrite(cmd[i]);
+  }
+}
 
-#if defined(ESP8266)
-  // ESP8266 needs a periodic yield() call to avoid watchdog reset.
-  // With the limited size of SSD1306 displays, and the fast bitrate
-  // being used (1 MHz or more), I think one yield() immediately before
-  // a screen write and one immediately after should cover it.  But if
-  // not, if this becomes a problem, yields() might be added in the
-  // 32-byte transfer condition below.
-  yield();
-#endif
-  uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
-  uint8_t *ptr = buffer;
+/*!
+    @brief  Stream display RAM data, in WIRE_MAX sized transmissions on I2C.
+            Transaction must be started by the caller.
+*/
+void Adafruit_SSD1306::sendData(const uint8_t *ptr, uint16_t count) {
   if (wire) { // I2C
     wire->beginTransmission(i2caddr);
     WIRE_WRITE((uint8_t)0x40);
@@ -1029,10 +1102,189 @@ void Adafruit_SSD1306::display(void) {
     while (count--)
       SPIwrite(*ptr++);
   }
+}
+
+/*!
+    @brief  Push the parts of the buffer changed since the last update to the
+            SSD1306 display. Consecutive pages with the same dirty column
+            span go out as one address window, so a full redraw costs the
+            same as before while a few changed characters cost a few dozen
+            bytes.
+    @return None (void).
+    @note   Drawing operations are not visible until this function is
+            called. Call after each graphics command, or after a whole set
+            of graphics commands, as best needed by one's own application.
+*/
+void Adafruit_SSD1306::display(void) {
+  uint8_t pages = (HEIGHT + 7) / 8;
+  uint8_t page = 0;
+  while (page < pages) {
+    if (dirtyX0[page] > dirtyX1[page]) {
+      page++;
+      continue;
+    }
+    uint8_t last = page;
+    while (last + 1 < pages && dirtyX0[last + 1] == dirtyX0[page] &&
+           dirtyX1[last + 1] == dirtyX1[page])
+      last++;
+    display(dirtyX0[page], page, dirtyX1[page], last);
+    page = last + 1;
+  }
+}
+
+/*!
+    @brief  Push one window of the buffer to the SSD1306 display.
+    @param  x0
+            First column.
+    @param  page0
+            First page (8 pixel row band).
+    @param  x1
+            Last column, inclusive.
+    @param  page1
+            Last page, inclusive.
+    @return None (void).
+    @note   The window is no longer dirty afterwards, only pages fully
+            covered by it horizontally are marked clean.
+*/
+void Adafruit_SSD1306::display(uint8_t x0, uint8_t page0, uint8_t x1,
+                               uint8_t page1) {
+  uint8_t pages = (HEIGHT + 7) / 8;
+  if (x1 >= WIDTH)
+    x1 = WIDTH - 1;
+  if (page1 >= pages)
+    page1 = pages - 1;
+  if (x0 > x1 || page0 > page1)
+    return;
+  // an asynchronous frame owns the address window until it is done
+  while (displayBusy())
+    displayService();
+
+  TRANSACTION_START
+  setAddrWindow(x0, page0, x1, page1);
+
+#if defined(ESP8266)
+  // ESP8266 needs a periodic yield() call to avoid watchdog reset.
+  // With the limited size of SSD1306 displays, and the fast bitrate
+  // being used (1 MHz or more), I think one yield() immediately before
+  // a screen write and one immediately after should cover it.  But if
+  // not, if this becomes a problem, yields() might be added in the
+  // 32-byte transfer condition below.
+  yield();
+#endif
+  uint16_t width = x1 - x0 + 1;
+  if (width == WIDTH) { // whole rows are contiguous in the buffer
+    sendData(&buffer[page0 * WIDTH], width * (page1 - page0 + 1));
+  } else {
+    for (uint8_t page = page0; page <= page1; page++)
+      sendData(&buffer[page * WIDTH + x0], width);
+  }
   TRANSACTION_END
 #if defined(ESP8266)
   yield();
 #endif
+
+  for (uint8_t page = page0; page <= page1; page++) {
+    if (x0 <= dirtyX0[page] && x1 >= dirtyX1[page])
+      clearDirty(page, page);
+  }
+}
+
+// ASYNCHRONOUS REFRESH ----------------------------------------------------
+
+/*!
+    @brief  Start sending the changed parts of the buffer without blocking.
+            The dirty windows are copied into a second buffer, so drawing
+            can continue right away; call displayService() from the main
+            loop until displayBusy() returns false.
+    @return true if a transfer was started, false if one is still running
+            (the changes stay dirty for the next call), nothing is dirty or
+            the transfer buffer could not be allocated.
+*/
+bool Adafruit_SSD1306::startDisplay(void) {
+  if (displayBusy())
+    return false;
+  uint16_t size = WIDTH * ((HEIGHT + 7) / 8);
+  if ((!xferBuffer) && !(xferBuffer = (uint8_t *)malloc(size)))
+    return false;
+  uint8_t pages = (HEIGHT + 7) / 8;
+  uint8_t page = 0;
+  while (page < pages) {
+    if (dirtyX0[page] > dirtyX1[page]) {
+      page++;
+      continue;
+    }
+    uint8_t last = page;
+    while (last + 1 < pages && dirtyX0[last + 1] == dirtyX0[page] &&
+           dirtyX1[last + 1] == dirtyX1[page])
+      last++;
+    XferWindow &win = xferWindows[xferCount++];
+    win.x0 = dirtyX0[page];
+    win.x1 = dirtyX1[page];
+    win.page0 = page;
+    win.page1 = last;
+    for (uint8_t p = page; p <= last; p++)
+      memcpy(&xferBuffer[p * WIDTH + win.x0], &buffer[p * WIDTH + win.x0],
+             win.x1 - win.x0 + 1);
+    clearDirty(page, last);
+    page = last + 1;
+  }
+  xferIndex = 0;
+  xferPos = SSD1306_XFER_ADDR;
+  return xferCount > 0;
+}
+
+/*!
+    @brief  Send the next slice of a transfer started by startDisplay(): the
+            address window or at most one WIRE_MAX sized data transmission.
+    @return true once the transfer is complete (or none was running).
+*/
+bool Adafruit_SSD1306::displayService(void) {
+  if (!displayBusy())
+    return true;
+  XferWindow &win = xferWindows[xferIndex];
+  uint16_t width = win.x1 - win.x0 + 1;
+  uint16_t total = width * (win.page1 - win.page0 + 1);
+
+  TRANSACTION_START
+  if (xferPos == SSD1306_XFER_ADDR) {
+    setAddrWindow(win.x0, win.page0, win.x1, win.page1);
+    xferPos = 0;
+  } else {
+    // one transmission, split at page ends since rows are not contiguous
+    uint16_t count = total - xferPos;
+    if (count > WIRE_MAX - 1)
+      count = WIRE_MAX - 1;
+    uint8_t page = win.page0 + xferPos / width;
+    uint16_t col = xferPos % width;
+    if (wire) { // I2C
+      wire->beginTransmission(i2caddr);
+      WIRE_WRITE((uint8_t)0x40);
+    } else { // SPI
+      SSD1306_MODE_DATA
+    }
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t d = xferBuffer[page * WIDTH + win.x0 + col];
+      if (wire) {
+        WIRE_WRITE(d);
+      } else {
+        SPIwrite(d);
+      }
+      if (++col == width) {
+        col = 0;
+        page++;
+      }
+    }
+    if (wire)
+      wire->endTransmission();
+    xferPos += count;
+    if (xferPos == total) {
+      xferPos = SSD1306_XFER_ADDR;
+      if (++xferIndex == xferCount)
+        xferCount = 0;
+    }
+  }
+  TRANSACTION_END
+  return !displayBusy();
 }
 
 // SCROLLING FUNCTIONS -----------------------------------------------------
@@ -97,6 +97,9 @@ typedef uint32_t PortMask;
 #define SSD1306_SETHIGHCOLUMN 0x10 ///< Not currently used
 #define SSD1306_SETSTARTLINE 0x40  ///< See datasheet
 
+#define SSD1306_MAX_PAGES 8 ///< Pages of the tallest (64 pixel) panel
+#define SSD1306_XFER_ADDR 0xFFFF ///< Transfer position before the window
+
 #define SSD1306_EXTERNALVCC 0x01  ///< External display voltage source
 #define SSD1306_SWITCHCAPVCC 0x02 ///< Gen. display voltage from 3.3V
 
@@ -148,6 +151,16 @@ public:
   bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0,
              bool reset = true, bool periphBegin = true);
   void display(void);
+  void display(uint8_t x0, uint8_t page0, uint8_t x1, uint8_t page1);
+  void markDirty(uint8_t x0, uint8_t page0, uint8_t x1, uint8_t page1);
+  bool isDirty(void) const;
+  bool startDisplay(void);
+  bool displayService(void);
+  /*!
+      @brief  Check for an asynchronous transfer still in progress.
+      @return true until displayService() has sent the whole frame.
+  */
+  bool displayBusy(void) const { return xferCount > 0; }
   void clearDisplay(void);
   void invertDisplay(bool i);
   void dim(bool dim);
@@ -169,6 +182,18 @@ protected:
   void drawFastVLineInternal(int16_t x, int16_t y, int16_t h, uint16_t color);
   void ssd1306_command1(uint8_t c);
   void ssd1306_commandList(const uint8_t *c, uint8_t n);
+  void setAddrWindow(uint8_t x0, uint8_t page0, uint8_t x1, uint8_t page1);
+  void sendData(const uint8_t *ptr, uint16_t count);
+  void clearDirty(uint8_t page0, uint8_t page1);
+  /*!
+      @brief  Extend the dirty column span of one page, no bounds checks.
+  */
+  inline void dirtyPage(uint8_t page, uint8_t x0, uint8_t x1) {
+    if (x0 < dirtyX0[page])
+      dirtyX0[page] = x0;
+    if (x1 > dirtyX1[page])
+      dirtyX1[page] = x1;
+  }
 
   SPIClass *spi;   ///< Initialized during construction when using SPI. See
                    ///< SPI.cpp, SPI.h
@@ -176,6 +201,9 @@ protected:
                    ///< Wire.cpp, Wire.h
   uint8_t *buffer; ///< Buffer data used for display buffer. Allocated when
                    ///< begin method is called.
+  uint8_t *xferBuffer; ///< Frame being sent by displayService(), allocated
+                       ///< by the first startDisplay()
+  uint8_t xferCount;   ///< Windows of the running transfer, 0 when idle
   int8_t i2caddr;  ///< I2C address initialized when begin method is called.
   int8_t vccstate; ///< VCC selection, set by begin method.
   int8_t page_end; ///< not used
@@ -196,6 +224,15 @@ protected:
   uint32_t restoreClk; ///< Wire speed following SSD1306 transfers
 #endif
   uint8_t contrast; ///< normal contrast setting for this device
+  uint8_t dirtyX0[SSD1306_MAX_PAGES]; ///< First changed column per page
+  uint8_t dirtyX1[SSD1306_MAX_PAGES]; ///< Last changed column, < x0 if clean
+  /// Address window of an asynchronous transfer
+  struct XferWindow {
+    uint8_t x0, page0, x1, page1;
+  };
+  XferWindow xferWindows[SSD1306_MAX_PAGES]; ///< Windows of the transfer
+  uint8_t xferIndex; ///< Window being sent
+  uint16_t xferPos;  ///< Bytes of it sent, SSD1306_XFER_ADDR before address
 #if defined(SPI_HAS_TRANSACTION)
 protected:
   // Allow sub-class to change
@@ -74,12 +74,25 @@ public:
 	 */
 	bool push(T value);
 
+	/**
+	 * Adds `len` elements to the end of buffer with at most two `memcpy`, oldest elements are overwritten when needed.
+	 * The operation returns `false` if the addition caused overwriting existing elements.
+	 * *WARNING* Elements are copied bytewise, use with trivially copyable types only.
+	 */
+	bool push(const T* values, size_t len);
+
 	/**
 	 * Removes an element from the beginning of the buffer.
 	 * *WARNING* Calling this operation on an empty buffer has an unpredictable behaviour.
 	 */
 	T shift();
 
+	/**
+	 * Removes up to `len` elements from the beginning of the buffer, copying them into `dest` unless it is `nullptr`.
+	 * Returns the number of elements removed.
+	 */
+	IT shift(T* dest, size_t len);
+
 	/**
 	 * Removes an element from the end of the buffer.
 	 * *WARNING* Calling this operation on an empty buffer has an unpredictable behaviour.
@@ -103,6 +116,19 @@ public:
 	 */
 	T operator [] (IT index) const;
 
+	/**
+	 * Copies up to `len` elements starting at `index` into `dest` without removing them, with at most two `memcpy`.
+	 * Returns the number of elements copied.
+	 */
+	IT copyOut(T* dest, size_t len, IT index = 0) const;
+
+	/**
+	 * Returns a pointer to the contiguous run of elements starting at `index` and stores its length in `len`.
+	 * The stored elements are made of at most two such runs: `span(0, len)` and `span(len, len2)`.
+	 * Returns `nullptr` and sets `len` to zero when `index` is not lower than `size()`.
+	 */
+	const T* span(IT index, IT& len) const;
+
 	/**
 	 * Returns how many elements are actually stored in the buffer.
 	 */
@@ -15,6 +15,7 @@
  You should have received a copy of the GNU General Public License
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <string.h>
 
 template<typename T, size_t S, typename IT>
 constexpr CircularBuffer<T,S,IT>::CircularBuffer() :
@@ -59,6 +60,37 @@ bool CircularBuffer<T,S,IT>::push(T value) {
 	}
 }
 
+template<typename T, size_t S, typename IT>
+bool CircularBuffer<T,S,IT>::push(const T* values, size_t len) {
+	if (len == 0) return true;
+	if (len >= capacity) {
+		// only the last `capacity` elements survive
+		bool lossless = (count == 0 && len == capacity);
+		memcpy(buffer, values + (len - capacity), capacity * sizeof(T));
+		head = buffer;
+		tail = buffer + capacity - 1;
+		count = capacity;
+		return lossless;
+	}
+	size_t start = (tail + 1 - buffer) % capacity;
+	size_t first = capacity - start;
+	if (first > len) first = len;
+	memcpy(buffer + start, values, first * sizeof(T));
+	memcpy(buffer, values + first, (len - first) * sizeof(T));
+	tail = buffer + (start + len - 1) % capacity;
+	if (count == 0) {
+		head = buffer + start;
+	}
+	size_t total = count + len;
+	if (total > capacity) {
+		head = buffer + (head - buffer + (total - capacity)) % capacity;
+		count = capacity;
+		return false;
+	}
+	count = static_cast<IT>(total);
+	return true;
+}
+
 template<typename T, size_t S, typename IT>
 T CircularBuffer<T,S,IT>::shift() {
 	if (count == 0) return *head;
@@ -70,6 +102,19 @@ T CircularBuffer<T,S,IT>::shift() {
 	return result;
 }
 
+template<typename T, size_t S, typename IT>
+IT CircularBuffer<T,S,IT>::shift(T* dest, size_t len) {
+	IT n = dest ? copyOut(dest, len) : static_cast<IT>(len < count ? len : count);
+	if (n == 0) return 0;
+	count -= n;
+	if (count == 0) {
+		head = tail;
+	} else {
+		head = buffer + (head - buffer + n) % capacity;
+	}
+	return n;
+}
+
 template<typename T, size_t S, typename IT>
 T CircularBuffer<T,S,IT>::pop() {
 	if (count == 0) return *tail;
@@ -97,6 +142,31 @@ T CircularBuffer<T,S,IT>::operator [](IT index) const {
 	return *(buffer + ((head - buffer + index) % capacity));
 }
 
+template<typename T, size_t S, typename IT>
+IT CircularBuffer<T,S,IT>::copyOut(T* dest, size_t len, IT index) const {
+	IT first;
+	const T* run = span(index, first);
+	if (run == nullptr) return 0;
+	IT n = static_cast<IT>(len < (size_t)(count - index) ? len : count - index);
+	if (first > n) first = n;
+	memcpy(dest, run, first * sizeof(T));
+	memcpy(dest + first, buffer, (n - first) * sizeof(T));
+	return n;
+}
+
+template<typename T, size_t S, typename IT>
+const T* CircularBuffer<T,S,IT>::span(IT index, IT& len) const {
+	if (index >= count) {
+		len = 0;
+		return nullptr;
+	}
+	size_t start = (head - buffer + index) % capacity;
+	size_t run = capacity - start;
+	size_t left = count - index;
+	len = static_cast<IT>(run < left ? run : left);
+	return buffer + start;
+}
+
 template<typename T, size_t S, typename IT>
 IT inline CircularBuffer<T,S,IT>::size() const {
 	return count;
@@ -152,7 +152,7 @@ size_t AsyncEventSourceMessage::send(AsyncClient *client) {
 // Client
 
 AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, AsyncEventSource *server)
-: _messageQueue(LinkedList<AsyncEventSourceMessage *>([](AsyncEventSourceMessage *m){ delete  m; }))
+: _messageQueue(SSE_MAX_QUEUED_BYTES)
 {
   _client = request->client();
   _server = server;
@@ -184,11 +184,10 @@ void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage)
     delete dataMessage;
     return;
   }
-  if(_messageQueue.length() >= SSE_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
+  if(!_messageQueue.push(dataMessage, dataMessage->length())){
+      //counted instead of printed, UART0 is the bridged port
+      _server->_countDropped(dataMessage->length());
       delete dataMessage;
-  } else {
-      _messageQueue.add(dataMessage);
   }
   if(_client->canSend())
     _runQueue();
@@ -198,7 +197,7 @@ void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
   while(len && !_messageQueue.isEmpty()){
     len = _messageQueue.front()->ack(len, time);
     if(_messageQueue.front()->finished())
-      _messageQueue.remove(_messageQueue.front());
+      _messageQueue.pop();
   }
 
   _runQueue();
@@ -236,13 +235,14 @@ void AsyncEventSourceClient::send(const char *message, const char *event, uint32
 
 void AsyncEventSourceClient::_runQueue(){
   while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+    _messageQueue.pop();
   }
 
-  for(auto i = _messageQueue.begin(); i != _messageQueue.end(); ++i)
+  for(size_t i = 0; i < _messageQueue.length(); i++)
   {
-    if(!(*i)->sent())
-      (*i)->send(_client);
+    AsyncEventSourceMessage *m = _messageQueue.at(i);
+    if(!m->sent())
+      m->send(_client);
   }
 }
 
@@ -253,6 +253,8 @@ AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
+  , _droppedMessages(0)
+  , _droppedBytes(0)
 {}
 
 AsyncEventSource::~AsyncEventSource(){
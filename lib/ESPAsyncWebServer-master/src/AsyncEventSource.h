@@ -24,13 +24,16 @@
 #ifdef ESP32
 #include <AsyncTCP.h>
 #define SSE_MAX_QUEUED_MESSAGES 32
+#define SSE_MAX_QUEUED_BYTES 16384
 #else
 #include <ESPAsyncTCP.h>
 #define SSE_MAX_QUEUED_MESSAGES 8
+#define SSE_MAX_QUEUED_BYTES 4096
 #endif
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncWebQueue.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -64,6 +67,7 @@ class AsyncEventSourceMessage {
     size_t send(AsyncClient *client);
     bool finished(){ return _acked == _len; }
     bool sent() { return _sent == _len; }
+    size_t length() const { return _len; }
 };
 
 class AsyncEventSourceClient {
@@ -71,7 +75,7 @@ class AsyncEventSourceClient {
     AsyncClient *_client;
     AsyncEventSource *_server;
     uint32_t _lastId;
-    LinkedList<AsyncEventSourceMessage *> _messageQueue;
+    AsyncWebQueue<AsyncEventSourceMessage, SSE_MAX_QUEUED_MESSAGES> _messageQueue;
     void _queueMessage(AsyncEventSourceMessage *dataMessage);
     void _runQueue();
 
@@ -87,6 +91,7 @@ class AsyncEventSourceClient {
     bool connected() const { return (_client != NULL) && _client->connected(); }
     uint32_t lastId() const { return _lastId; }
     size_t  packetsWaiting() const { return _messageQueue.length(); }
+    size_t  bytesWaiting() const { return _messageQueue.bytes(); }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -100,6 +105,8 @@ class AsyncEventSource: public AsyncWebHandler {
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    uint32_t _droppedMessages;
+    uint32_t _droppedBytes;
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -110,10 +117,14 @@ class AsyncEventSource: public AsyncWebHandler {
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     size_t count() const; //number clinets connected
     size_t  avgPacketsWaiting() const;
+    //messages refused because a client queue was full, all clients together
+    uint32_t droppedMessages() const { return _droppedMessages; }
+    uint32_t droppedBytes() const { return _droppedBytes; }
 
     //system callbacks (do not call)
     void _addClient(AsyncEventSourceClient * client);
     void _handleDisconnect(AsyncEventSourceClient * client);
+    void _countDropped(size_t len){ _droppedMessages++; _droppedBytes += len; }
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
 };
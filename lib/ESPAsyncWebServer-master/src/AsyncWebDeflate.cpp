@@ -0,0 +1,470 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "AsyncWebDeflate.h"
+#include "string.h"
+
+// length codes 257..285 and distance codes 0..29, RFC 1951 3.2.5
+static const uint16_t lengthBase[29] = {
+  3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const uint8_t lengthExtra[29] = {
+  0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const uint16_t distBase[30] = {
+  1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,
+  4097,6145,8193,12289,16385,24577 };
+static const uint8_t distExtra[30] = {
+  0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+/*
+ * Deflate
+ */
+
+typedef struct {
+  uint8_t *out;
+  size_t pos;
+  size_t max;
+  uint32_t bits;
+  uint8_t count;
+  bool full;
+} DeflateWriter;
+
+static void putBits(DeflateWriter &w, uint32_t value, uint8_t n){
+  w.bits |= value << w.count;
+  w.count += n;
+  while(w.count >= 8){
+    if(w.pos == w.max){
+      w.full = true;
+      w.count = 0;
+      return;
+    }
+    w.out[w.pos++] = w.bits & 0xFF;
+    w.bits >>= 8;
+    w.count -= 8;
+  }
+}
+
+// Huffman codes go out most significant bit first
+static void putCode(DeflateWriter &w, uint16_t code, uint8_t n){
+  uint16_t r = 0;
+  for(uint8_t i = 0; i < n; i++){
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  putBits(w, r, n);
+}
+
+static void putSymbol(DeflateWriter &w, uint16_t sym){
+  if(sym < 144)
+    putCode(w, 0x30 + sym, 8);
+  else if(sym < 256)
+    putCode(w, 0x190 + sym - 144, 9);
+  else if(sym < 280)
+    putCode(w, sym - 256, 7);
+  else
+    putCode(w, 0xC0 + sym - 280, 8);
+}
+
+static void putMatch(DeflateWriter &w, size_t len, size_t dist){
+  uint8_t i = 28;
+  while(lengthBase[i] > len) i--;
+  putSymbol(w, 257 + i);
+  putBits(w, len - lengthBase[i], lengthExtra[i]);
+  i = 29;
+  while(distBase[i] > dist) i--;
+  putCode(w, i, 5);
+  putBits(w, dist - distBase[i], distExtra[i]);
+}
+
+static inline uint16_t hash3(const uint8_t *p){
+  uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (v * 2654435761u) >> (32 - WS_DEFLATE_HASH_BITS);
+}
+
+size_t webSocketDeflate(AsyncWebDeflater *z, const uint8_t *in, size_t len, uint8_t *out, size_t max){
+  if(len > 0xFFFE)
+    return 0;
+  DeflateWriter w = { out, 0, max, 0, 0, false };
+  uint16_t *matchHead = z->matchHead;
+  memset(matchHead, 0, sizeof(z->matchHead));
+  putBits(w, 0, 1); // BFINAL 0
+  putBits(w, 1, 2); // fixed Huffman codes
+  size_t i = 0;
+  while(i < len && !w.full){
+    size_t best = 0;
+    size_t dist = 0;
+    if(i + 3 <= len){
+      uint16_t h = hash3(in + i);
+      size_t cand = matchHead[h];
+      matchHead[h] = i + 1;
+      if(cand && i - (cand - 1) <= (1u << WS_DEFLATE_WINDOW_BITS)){
+        const uint8_t *m = in + cand - 1;
+        size_t limit = len - i;
+        if(limit > 258) limit = 258;
+        while(best < limit && m[best] == in[i + best]) best++;
+        dist = i - (cand - 1);
+      }
+    }
+    if(best >= 3){
+      putMatch(w, best, dist);
+      for(size_t k = 1; k < best && i + k + 3 <= len; k++)
+        matchHead[hash3(in + i + k)] = i + k + 1;
+      i += best;
+    } else {
+      putSymbol(w, in[i]);
+      i++;
+    }
+  }
+  putSymbol(w, 256);  // end of block
+  putBits(w, 0, 3);   // empty stored block, its LEN/NLEN are the dropped tail
+  if(w.count)
+    putBits(w, 0, 8 - w.count); // pad to the byte boundary
+  if(w.full)
+    return 0;
+  return w.pos;
+}
+
+/*
+ * Inflate, canonical Huffman decoding as in zlib's puff.c, resumable: every
+ * literal, match or block header is decoded whole or not at all, what is left
+ * of the input waits in the inflater for the next frame
+ */
+
+#define INFLATE_WINDOW (1u << WS_INFLATE_WINDOW_BITS)
+#define INFLATE_MASK (INFLATE_WINDOW - 1)
+
+enum { INFLATE_HEADER, INFLATE_STORED, INFLATE_CODES, INFLATE_DONE };
+
+typedef struct {
+  const uint8_t *in;
+  size_t pos;
+  size_t len;
+  uint32_t bits;
+  uint8_t count;
+  bool error;   // ran out of input
+} InflateReader;
+
+static uint32_t getBits(InflateReader &r, uint8_t n){
+  while(r.count < n){
+    if(r.pos == r.len){
+      r.error = true;
+      return 0;
+    }
+    r.bits |= (uint32_t)r.in[r.pos++] << r.count;
+    r.count += 8;
+  }
+  uint32_t v = r.bits & ((1u << n) - 1);
+  r.bits >>= n;
+  r.count -= n;
+  return v;
+}
+
+static bool buildTable(AsyncWebInflateTable &t, const uint8_t *lengths, uint16_t n){
+  uint16_t offs[16];
+  memset(t.count, 0, sizeof(t.count));
+  for(uint16_t i = 0; i < n; i++)
+    t.count[lengths[i]]++;
+  if(t.count[0] == n)
+    return true; // no codes, only an error if one gets used
+  int left = 1;
+  for(uint8_t len = 1; len < 16; len++){
+    left <<= 1;
+    left -= t.count[len];
+    if(left < 0)
+      return false; // over-subscribed
+  }
+  offs[1] = 0;
+  for(uint8_t len = 1; len < 15; len++)
+    offs[len + 1] = offs[len] + t.count[len];
+  for(uint16_t i = 0; i < n; i++)
+    if(lengths[i])
+      t.symbol[offs[lengths[i]]++] = i;
+  return true;
+}
+
+// -1 with r.error set when the input ran out, without it on a bad code
+static int decodeSymbol(InflateReader &r, const AsyncWebInflateTable &t){
+  int code = 0, first = 0, index = 0;
+  for(uint8_t len = 1; len < 16; len++){
+    code |= getBits(r, 1);
+    if(r.error)
+      return -1;
+    int count = t.count[len];
+    if(code - count < first)
+      return t.symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+static void fixedTables(AsyncWebInflater *z){
+  uint16_t i = 0;
+  for(; i < 144; i++) z->lengths[i] = 8;
+  for(; i < 256; i++) z->lengths[i] = 9;
+  for(; i < 280; i++) z->lengths[i] = 7;
+  for(; i < 288; i++) z->lengths[i] = 8;
+  buildTable(z->lit, z->lengths, 288);
+  for(i = 0; i < 30; i++) z->lengths[i] = 5;
+  buildTable(z->dist, z->lengths, 30);
+}
+
+static bool dynamicTables(AsyncWebInflater *z, InflateReader &r){
+  static const uint8_t order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+  uint8_t *lengths = z->lengths;
+  uint16_t nlen = getBits(r, 5) + 257;
+  uint16_t ndist = getBits(r, 5) + 1;
+  uint16_t ncode = getBits(r, 4) + 4;
+  if(r.error || nlen > 286 || ndist > 30)
+    return false;
+  uint16_t i;
+  for(i = 0; i < ncode; i++)
+    lengths[order[i]] = getBits(r, 3);
+  for(; i < 19; i++)
+    lengths[order[i]] = 0;
+  if(r.error || !buildTable(z->lit, lengths, 19))
+    return false;
+  i = 0;
+  while(i < nlen + ndist){
+    int sym = decodeSymbol(r, z->lit);
+    if(sym < 0)
+      return false;
+    if(sym < 16){
+      lengths[i++] = sym;
+      continue;
+    }
+    uint8_t len = 0;
+    uint16_t repeat;
+    if(sym == 16){
+      if(i == 0)
+        return false;
+      len = lengths[i - 1];
+      repeat = 3 + getBits(r, 2);
+    } else if(sym == 17){
+      repeat = 3 + getBits(r, 3);
+    } else {
+      repeat = 11 + getBits(r, 7);
+    }
+    if(r.error || i + repeat > nlen + ndist)
+      return false;
+    while(repeat--)
+      lengths[i++] = len;
+  }
+  if(lengths[256] == 0)
+    return false;
+  return buildTable(z->lit, lengths, nlen) && buildTable(z->dist, lengths + nlen, ndist);
+}
+
+// Hands len bytes of the window on, restoring the byte after them in case
+// the handler terminated the data in place
+static void deliver(uint8_t *data, size_t len, bool last, AsyncWebInflateSink sink, void *arg){
+  uint8_t after = data[len];
+  sink(arg, data, len, last);
+  data[len] = after;
+}
+
+static void flush(AsyncWebInflater *z, bool last, AsyncWebInflateSink sink, void *arg){
+  uint16_t start = (z->pos - z->pending) & INFLATE_MASK;
+  if(!z->pending && last)
+    deliver(z->window + start, 0, true, sink, arg);
+  while(z->pending){
+    uint16_t n = INFLATE_WINDOW - start;
+    if(n > z->pending)
+      n = z->pending;
+    z->pending -= n;
+    deliver(z->window + start, n, last && !z->pending, sink, arg);
+    start = (start + n) & INFLATE_MASK;
+  }
+}
+
+// Makes room for n more bytes, the oldest ones go to the sink first
+static inline void reserve(AsyncWebInflater *z, size_t n, AsyncWebInflateSink sink, void *arg){
+  if(z->pending + n > INFLATE_WINDOW)
+    flush(z, false, sink, arg);
+}
+
+static inline void advance(AsyncWebInflater *z, size_t n){
+  z->pos = (z->pos + n) & INFLATE_MASK;
+  z->pending += n;
+  z->filled = (z->filled + n > INFLATE_WINDOW) ? INFLATE_WINDOW : z->filled + n;
+}
+
+// Decodes what the buffered input allows, false on corrupt data
+static bool inflateRun(AsyncWebInflater *z, AsyncWebInflateSink sink, void *arg){
+  InflateReader r = { z->input, 0, z->inLen, z->bits, z->count, false };
+  // where to go back to when the input runs out halfway through a code
+  size_t pos;
+  uint32_t bits;
+  uint8_t count;
+  for(;;){
+    pos = r.pos;
+    bits = r.bits;
+    count = r.count;
+    if(z->state == INFLATE_DONE){
+      // anything after the final block, the appended tail included, is ignored
+      r.pos = r.len;
+      break;
+    } else if(z->state == INFLATE_HEADER){
+      bool last = getBits(r, 1);
+      uint8_t type = getBits(r, 2);
+      if(r.error)
+        break;
+      if(type == 0){
+        r.bits = 0;
+        r.count = 0;
+        if(r.pos + 4 > r.len){
+          r.error = true;
+          break;
+        }
+        uint16_t n = r.in[r.pos] | (r.in[r.pos + 1] << 8);
+        uint16_t nn = r.in[r.pos + 2] | (r.in[r.pos + 3] << 8);
+        r.pos += 4;
+        if(n != (uint16_t)~nn)
+          return false;
+        z->stored = n;
+        z->state = INFLATE_STORED;
+      } else if(type == 1){
+        fixedTables(z);
+        z->state = INFLATE_CODES;
+      } else if(type == 2){
+        if(!dynamicTables(z, r)){
+          if(r.error)
+            break;
+          return false;
+        }
+        z->state = INFLATE_CODES;
+      } else {
+        return false;
+      }
+      z->last = last;
+    } else if(z->state == INFLATE_STORED){
+      if(!z->stored){
+        z->state = z->last ? INFLATE_DONE : INFLATE_HEADER;
+        continue;
+      }
+      reserve(z, 1, sink, arg);
+      size_t n = z->stored;
+      if(n > r.len - r.pos) n = r.len - r.pos;
+      if(n > INFLATE_WINDOW - z->pending) n = INFLATE_WINDOW - z->pending;
+      if(n > INFLATE_WINDOW - z->pos) n = INFLATE_WINDOW - z->pos;
+      if(!n)
+        break;
+      memcpy(z->window + z->pos, r.in + r.pos, n);
+      r.pos += n;
+      z->stored -= n;
+      advance(z, n);
+    } else {
+      int sym = decodeSymbol(r, z->lit);
+      if(r.error)
+        break;
+      if(sym < 0)
+        return false;
+      if(sym < 256){
+        reserve(z, 1, sink, arg);
+        z->window[z->pos] = sym;
+        advance(z, 1);
+      } else if(sym == 256){
+        z->state = z->last ? INFLATE_DONE : INFLATE_HEADER;
+      } else {
+        sym -= 257;
+        if(sym >= 29)
+          return false;
+        size_t len = lengthBase[sym] + getBits(r, lengthExtra[sym]);
+        int d = decodeSymbol(r, z->dist);
+        if(r.error)
+          break;
+        if(d < 0 || d >= 30)
+          return false;
+        size_t dist = distBase[d] + getBits(r, distExtra[d]);
+        if(r.error)
+          break;
+        if(dist > z->filled)
+          return false;
+        reserve(z, len, sink, arg);
+        uint16_t to = z->pos;
+        uint16_t from = (to - dist) & INFLATE_MASK;
+        for(size_t k = 0; k < len; k++){
+          z->window[to] = z->window[from];
+          to = (to + 1) & INFLATE_MASK;
+          from = (from + 1) & INFLATE_MASK;
+        }
+        advance(z, len);
+      }
+    }
+  }
+  if(r.error){
+    r.pos = pos;
+    r.bits = bits;
+    r.count = count;
+  }
+  // keep the unread input for the next frame
+  z->bits = r.bits;
+  z->count = r.count;
+  z->inLen = r.len - r.pos;
+  memmove(z->input, z->input + r.pos, z->inLen);
+  return true;
+}
+
+static bool inflateFeed(AsyncWebInflater *z, const uint8_t *in, size_t len, AsyncWebInflateSink sink, void *arg){
+  do {
+    size_t n = sizeof(z->input) - z->inLen;
+    if(n > len)
+      n = len;
+    if(n)
+      memcpy(z->input + z->inLen, in, n);
+    z->inLen += n;
+    in += n;
+    len -= n;
+    if(!inflateRun(z, sink, arg))
+      return false;
+    // a full buffer that still does not hold one whole code
+    if(z->inLen == sizeof(z->input))
+      return false;
+  } while(len);
+  return true;
+}
+
+void webSocketInflateBegin(AsyncWebInflater *z){
+  z->inLen = 0;
+  z->bits = 0;
+  z->count = 0;
+  z->state = INFLATE_HEADER;
+  z->last = false;
+  z->stored = 0;
+  z->pos = 0;
+  z->pending = 0;
+  z->filled = 0;
+}
+
+bool webSocketInflate(AsyncWebInflater *z, const uint8_t *in, size_t len, bool last, AsyncWebInflateSink sink, void *arg){
+  static const uint8_t tail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+  if(!inflateFeed(z, in, len, sink, arg))
+    return false;
+  if(!last)
+    return true;
+  // without a final block the message ends with the flush's empty stored block
+  if(!inflateFeed(z, tail, sizeof(tail), sink, arg))
+    return false;
+  if(z->state != INFLATE_HEADER && z->state != INFLATE_DONE)
+    return false;
+  flush(z, true, sink, arg);
+  return true;
+}
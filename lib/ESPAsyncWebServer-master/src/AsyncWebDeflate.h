@@ -0,0 +1,119 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBDEFLATE_H_
+#define ASYNCWEBDEFLATE_H_
+
+#include "stddef.h"
+#include "stdint.h"
+
+// permessage-deflate (RFC 7692) in fixed memory. Outgoing messages are
+// compressed one at a time without context takeover, so one compressed
+// broadcast serves every client and a dropped message or a late joiner never
+// breaks the stream. Matches reach back at most 2^WS_DEFLATE_WINDOW_BITS bytes
+// within the message, the match finder is a single hash table.
+#ifndef WS_DEFLATE_WINDOW_BITS
+#define WS_DEFLATE_WINDOW_BITS 11
+#endif
+#ifndef WS_DEFLATE_HASH_BITS
+#define WS_DEFLATE_HASH_BITS 9
+#endif
+// smaller messages are sent as they are
+#ifndef WS_DEFLATE_MIN_SIZE
+#define WS_DEFLATE_MIN_SIZE 32
+#endif
+// incoming compressed messages are inflated through a ring of
+// 2^WS_INFLATE_WINDOW_BITS bytes and handed on in pieces as it fills, so a
+// message of any size needs no more memory. Clients are asked to keep their
+// window to that size.
+#ifndef WS_INFLATE_WINDOW_BITS
+#define WS_INFLATE_WINDOW_BITS 11
+#endif
+// compressed input held until a whole code is in, the biggest dynamic block
+// header takes under 300 bytes
+#ifndef WS_INFLATE_INPUT_SIZE
+#define WS_INFLATE_INPUT_SIZE 512
+#endif
+// messages that can be inflated at the same time, about 4KB each, at most 8
+#ifndef WS_INFLATERS
+#ifdef ESP32
+#define WS_INFLATERS 2
+#else
+#define WS_INFLATERS 1
+#endif
+#endif
+
+typedef struct {
+  uint32_t messages;  // compressed and sent compressed
+  uint32_t skipped;   // did not get smaller, sent as they are
+  uint32_t bytesIn;   // of the compressed messages, before
+  uint32_t bytesOut;  // and after
+  uint32_t micros;    // spent compressing, skipped ones included
+  uint32_t inflated;  // compressed messages received
+  uint32_t inflateBusy; // refused, every inflater was in use
+} AsyncWebDeflateStats;
+
+typedef struct {
+  uint16_t count[16];
+  uint16_t symbol[288];
+} AsyncWebInflateTable;
+
+// One message being inflated, see webSocketInflate()
+typedef struct {
+  uint8_t input[WS_INFLATE_INPUT_SIZE];
+  uint16_t inLen;
+  uint32_t bits;
+  uint8_t count;
+  uint8_t state;
+  bool last;          // in the final block
+  uint16_t stored;    // bytes left of a stored block
+  uint16_t pos;       // next write into window
+  uint16_t pending;   // written, not handed on yet
+  uint16_t filled;    // history matches may reach back into
+  AsyncWebInflateTable lit;
+  AsyncWebInflateTable dist;
+  uint8_t lengths[320];
+  uint8_t window[(1 << WS_INFLATE_WINDOW_BITS) + 1]; // spare byte, handlers may terminate the data in place
+} AsyncWebInflater;
+
+// Receives an inflated message in pieces, last is set on the final one
+typedef void (*AsyncWebInflateSink)(void *arg, uint8_t *data, size_t len, bool last);
+
+// Match finder of webSocketDeflate(), one per caller so that compressing
+// from two tasks at once needs no more than a lock around each
+typedef struct {
+  uint16_t matchHead[1 << WS_DEFLATE_HASH_BITS]; // position + 1, 0 is empty
+} AsyncWebDeflater;
+
+// Raw DEFLATE of in with fixed Huffman codes, ending in the empty stored block
+// whose 00 00 FF FF tail RFC 7692 leaves out. Returns the compressed length,
+// or 0 when it would need more than max bytes.
+size_t webSocketDeflate(AsyncWebDeflater *z, const uint8_t *in, size_t len, uint8_t *out, size_t max);
+
+// Starts a message, nothing is taken over from the previous one
+void webSocketInflateBegin(AsyncWebInflater *z);
+
+// Feeds the next compressed bytes of a message, with last on its final frame
+// (the 00 00 FF FF tail is added here). Output goes to sink whenever the
+// window fills and at the end. Returns false on corrupt data or a match
+// reaching back further than the window.
+bool webSocketInflate(AsyncWebInflater *z, const uint8_t *in, size_t len, bool last, AsyncWebInflateSink sink, void *arg);
+
+#endif /* ASYNCWEBDEFLATE_H_ */
@@ -0,0 +1,47 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "AsyncWebMask.h"
+#include "string.h"
+
+//lets a byte buffer be read and written a word at a time
+typedef uint32_t __attribute__((__may_alias__)) webSocketWord;
+
+void webSocketMask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset){
+  offset &= 3;
+  //up to the first word boundary, the ESP8266 traps on unaligned words
+  while(len && ((uintptr_t)data & 3)){
+    *data++ ^= mask[offset];
+    offset = (offset + 1) & 3;
+    len--;
+  }
+  //the mask turned so its byte at offset lines up with each word
+  uint8_t turned[4];
+  for(uint8_t i = 0; i < 4; i++)
+    turned[i] = mask[(offset + i) & 3];
+  webSocketWord key;
+  memcpy(&key, turned, 4);
+  webSocketWord *words = (webSocketWord *)data;
+  for(size_t n = len >> 2; n; n--)
+    *words++ ^= key;
+  data = (uint8_t *)words;
+  for(size_t i = 0; i < (len & 3); i++)
+    data[i] ^= turned[i];
+}
@@ -0,0 +1,31 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBMASK_H_
+#define ASYNCWEBMASK_H_
+
+#include "stddef.h"
+#include "stdint.h"
+
+//XORs data in place with the frame mask, offset is the position of data[0]
+//in the payload. Goes a 32-bit word at a time between unaligned ends.
+void webSocketMask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset);
+
+#endif /* ASYNCWEBMASK_H_ */
@@ -0,0 +1,95 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBPOOL_H_
+#define ASYNCWEBPOOL_H_
+
+#include "stddef.h"
+#include "stdint.h"
+#include "AsyncWebSynchronization.h"
+
+typedef struct {
+  uint16_t size;   // blocks in the pool
+  uint16_t used;   // blocks handed out now
+  uint16_t peak;   // most blocks handed out at once
+  uint32_t misses; // allocations that found the pool empty
+} AsyncWebPoolStats;
+
+/*
+ * Fixed block allocator: N blocks of SIZE bytes in one static array, handed
+ * out and taken back in O(1) through a free list threaded through the free
+ * blocks. It never falls back to the heap itself, alloc() returns NULL when
+ * the pool is empty and the caller decides what to do.
+ */
+template<size_t SIZE, size_t N>
+class AsyncWebPool {
+  private:
+    union Block {
+      Block *next;
+      uint8_t data[SIZE];
+      void *align;
+    };
+    Block _blocks[N];
+    Block *_free;
+    uint16_t _used;
+    uint16_t _peak;
+    uint32_t _misses;
+    AsyncWebLock _lock;
+
+  public:
+    AsyncWebPool():_free(NULL),_used(0),_peak(0),_misses(0){
+      for(size_t i = N; i > 0; i--){
+        _blocks[i - 1].next = _free;
+        _free = &_blocks[i - 1];
+      }
+    }
+
+    void *alloc(){
+      AsyncWebLockGuard l(_lock);
+      Block *b = _free;
+      if(b == NULL){
+        _misses++;
+        return NULL;
+      }
+      _free = b->next;
+      if(++_used > _peak)
+        _peak = _used;
+      return b->data;
+    }
+
+    bool owns(const void *p) const {
+      return p >= (const void *)_blocks && p < (const void *)(_blocks + N);
+    }
+
+    void free(void *p){
+      AsyncWebLockGuard l(_lock);
+      Block *b = (Block *)p;
+      b->next = _free;
+      _free = b;
+      _used--;
+    }
+
+    AsyncWebPoolStats stats() const {
+      AsyncWebPoolStats s = { (uint16_t)N, _used, _peak, _misses };
+      return s;
+    }
+};
+
+#endif /* ASYNCWEBPOOL_H_ */
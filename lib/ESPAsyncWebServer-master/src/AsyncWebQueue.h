@@ -0,0 +1,93 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBQUEUE_H_
+#define ASYNCWEBQUEUE_H_
+
+#include "stddef.h"
+#include "stdint.h"
+
+/*
+ * Per client send queue: a fixed ring of N slots holding the messages and
+ * their lengths, so push and pop are O(1) and never allocate. Besides the slot
+ * count it enforces a byte budget; a message that would go over it is refused,
+ * except into an empty queue, so one large message still gets through while
+ * many small ones cannot pile up. The queue owns what it holds, pop() and
+ * free() delete it.
+ */
+template<typename T, size_t N>
+class AsyncWebQueue {
+  private:
+    struct Slot {
+      T *item;
+      size_t len;
+    };
+    Slot _slots[N];
+    size_t _head;
+    size_t _count;
+    size_t _bytes;
+    size_t _budget;
+
+  public:
+    AsyncWebQueue(size_t budget):_head(0),_count(0),_bytes(0),_budget(budget){}
+    ~AsyncWebQueue(){ free(); }
+
+    bool isEmpty() const { return _count == 0; }
+    bool isFull() const { return _count == N || _bytes >= _budget; }
+    size_t length() const { return _count; }
+    size_t bytes() const { return _bytes; }
+
+    bool canTake(size_t len) const {
+      return _count < N && (_count == 0 || _bytes + len <= _budget);
+    }
+
+    bool push(T *item, size_t len){
+      if(!canTake(len))
+        return false;
+      Slot &s = _slots[(_head + _count) % N];
+      s.item = item;
+      s.len = len;
+      _count++;
+      _bytes += len;
+      return true;
+    }
+
+    T *front() const { return _slots[_head].item; }
+    // i-th queued item, 0 is the front
+    T *at(size_t i) const { return _slots[(_head + i) % N].item; }
+
+    void pop(){
+      if(_count == 0)
+        return;
+      Slot &s = _slots[_head];
+      T *item = s.item;
+      _bytes -= s.len;
+      _head = (_head + 1) % N;
+      _count--;
+      delete item;
+    }
+
+    void free(){
+      while(_count)
+        pop();
+    }
+};
+
+#endif /* ASYNCWEBQUEUE_H_ */
@@ -40,7 +40,7 @@ size_t webSocketSendFrameWindow(AsyncClient *client){
   return space - 8;
 }
 
-size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
+size_t webSocketAddFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
   if(!client->canSend())
     return 0;
   size_t space = client->space();
@@ -63,13 +63,10 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
 
   if(len > space) len = space;
 
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
-  }
+  //at most 8 bytes, copied by add()
+  uint8_t buf[8];
 
-  buf[0] = opcode & 0x0F;
+  buf[0] = opcode & (0x0F | WS_RSV1);
   if(final)
     buf[0] |= 0x80;
   if(len < 126)
@@ -85,27 +82,48 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   }
   if(client->add((const char *)buf, headLen) != headLen){
     //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
     return 0;
   }
-  free(buf);
 
   if(len){
     if(len && mask){
-      size_t i;
-      for(i=0;i<len;i++)
-        data[i] = data[i] ^ mbuf[i%4];
+      webSocketMask(data, len, mbuf, 0);
     }
     if(client->add((const char *)data, len) != len){
       //os_printf("error adding %lu data bytes\n", len);
       return 0;
     }
   }
+  return len;
+}
+
+//unmasked frame header for len payload bytes the caller adds itself,
+//returns the header length or 0 if it did not fit
+static size_t webSocketAddFrameHeader(AsyncClient *client, uint8_t opcode, size_t len){
+  uint8_t buf[4];
+  size_t headLen = (len < 126) ? 2 : 4;
+  buf[0] = 0x80 | (opcode & 0x0F);
+  if(len < 126)
+    buf[1] = len;
+  else {
+    buf[1] = 126;
+    buf[2] = (uint8_t)((len >> 8) & 0xFF);
+    buf[3] = (uint8_t)(len & 0xFF);
+  }
+  if(client->space() < headLen + len || client->add((const char *)buf, headLen) != headLen)
+    return 0;
+  return headLen;
+}
+
+size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
+  size_t sent = webSocketAddFrame(client, final, opcode, mask, data, len);
+  if(len && !sent)
+    return 0;
   if(!client->send()){
-    //os_printf("error sending frame: %lu\n", headLen+len);
+    //os_printf("error sending frame: %lu\n", sent);
     return 0;
   }
-  return len;
+  return sent;
 }
 
 
@@ -113,13 +131,31 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
  *    AsyncWebSocketMessageBuffer
  */
 
+static AsyncWebPool<sizeof(AsyncWebSocketMessageBuffer), WS_POOL_BUFFERS> _bufferPool;
+static AsyncWebPool<WS_POOL_BUFFER_SIZE + 1, WS_POOL_BUFFERS> _dataPool;
+static AsyncWebPool<sizeof(AsyncWebSocketMultiMessage), WS_POOL_MESSAGES> _messagePool;
+
+void * AsyncWebSocketMessageBuffer::operator new(size_t size) noexcept
+{
+  void * p = _bufferPool.alloc();
+  return p ? p : malloc(size);
+}
 
+void AsyncWebSocketMessageBuffer::operator delete(void * p)
+{
+  if (_bufferPool.owns(p)) {
+    _bufferPool.free(p);
+  } else {
+    free(p);
+  }
+}
 
 AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer()
   :_data(nullptr)
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
 
 }
@@ -129,17 +165,15 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(uint8_t * data, size_t
   ,_len(size)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
 
   if (!data) {
     return; 
   }
 
-  _data = new uint8_t[_len + 1];
-
-  if (_data) {
+  if (_allocData(_len)) {
     memcpy(_data, data, _len);
-    _data[_len] = 0; 
   }
 }
 
@@ -149,13 +183,9 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(size_t size)
   ,_len(size)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
-  _data = new uint8_t[_len + 1]; 
-
-  if (_data) {
-    _data[_len] = 0; 
-  }
-  
+  _allocData(_len);
 }
 
 AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const AsyncWebSocketMessageBuffer & copy)
@@ -163,19 +193,14 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const AsyncWebSocketMes
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
   _len = copy._len;
   _lock = copy._lock;
   _count = 0;
 
-  if (_len) {
-    _data = new uint8_t[_len + 1]; 
-    _data[_len] = 0; 
-  } 
-
-  if (_data) {
+  if (_len && _allocData(_len)) {
     memcpy(_data, copy._data, _len);
-    _data[_len] = 0; 
   }
 
 }
@@ -185,6 +210,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
   _len = copy._len;
   _lock = copy._lock;
@@ -199,29 +225,41 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
 
 AsyncWebSocketMessageBuffer::~AsyncWebSocketMessageBuffer()
 {
-    if (_data) {
-      delete[] _data; 
-    }
+  _freeData();
 }
 
-bool AsyncWebSocketMessageBuffer::reserve(size_t size) 
+// from the data pool when it fits, one extra byte for the terminating NUL
+bool AsyncWebSocketMessageBuffer::_allocData(size_t size)
 {
-  _len = size; 
-
+  _data = (size <= WS_POOL_BUFFER_SIZE) ? (uint8_t *)_dataPool.alloc() : nullptr;
+  if (!_data) {
+    _data = new uint8_t[size + 1];
+  }
   if (_data) {
-    delete[] _data;
-    _data = nullptr; 
+    _data[size] = 0;
+    return true;
   }
+  return false;
+}
 
-  _data = new uint8_t[_len + 1];
-
-  if (_data) {
-    _data[_len] = 0;
-    return true; 
+void AsyncWebSocketMessageBuffer::_freeData()
+{
+  if (!_data) {
+    return;
+  }
+  if (_dataPool.owns(_data)) {
+    _dataPool.free(_data);
   } else {
-    return false; 
+    delete[] _data;
   }
+  _data = nullptr;
+}
 
+bool AsyncWebSocketMessageBuffer::reserve(size_t size) 
+{
+  _len = size; 
+  _freeData();
+  return _allocData(_len);
 }
 
 
@@ -309,14 +347,26 @@ AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
     free(_data);
 }
 
- void AsyncWebSocketBasicMessage::ack(size_t len, uint32_t time)  {
+ size_t AsyncWebSocketBasicMessage::ack(size_t len, uint32_t time)  {
    (void)time;
+  size_t extra = 0;
+  if(len > _ack - _acked){
+    extra = len - (_ack - _acked);
+    len -= extra;
+  }
   _acked += len;
   if(_sent == _len && _acked == _ack){
     _status = WS_MSG_SENT;
   }
+  return extra;
 }
  size_t AsyncWebSocketBasicMessage::send(AsyncClient *client)  {
+  size_t sent = add(client);
+  if(sent)
+    client->send();
+  return sent;
+}
+ size_t AsyncWebSocketBasicMessage::add(AsyncClient *client)  {
   if(_status != WS_MSG_SENDING)
     return 0;
   if(_acked < _ack){
@@ -346,7 +396,7 @@ AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
   uint8_t* dPtr = (uint8_t*)(_data + (_sent - toSend));
   uint8_t opCode = (toSend && _sent == toSend)?_opcode:(uint8_t)WS_CONTINUATION;
 
-  size_t sent = webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend);
+  size_t sent = webSocketAddFrame(client, final, opCode, _mask, dPtr, toSend);
   _status = WS_MSG_SENDING;
   if(toSend && sent != toSend){
       _sent -= (toSend - sent);
@@ -355,6 +405,14 @@ AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
   return sent;
 }
 
+ size_t AsyncWebSocketBasicMessage::addMerged(AsyncClient *client, size_t headLen)  {
+  if(!mergeable() || client->add((const char *)_data, _len) != _len)
+    return 0;
+  _sent = _len;
+  _ack = _len + headLen;
+  return _len;
+}
+
 // bool AsyncWebSocketBasicMessage::reserve(size_t size) { 
 //   if (size) {
 //     _data = (uint8_t*)malloc(size +1);
@@ -374,7 +432,7 @@ AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
  */
 
 
-AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode, bool mask)
+AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode, bool mask, bool compressed)
   :_len(0)
   ,_sent(0)
   ,_ack(0)
@@ -383,6 +441,9 @@ AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuff
 {
 
   _opcode = opcode & 0x07;
+  if (compressed) {
+    _opcode |= WS_RSV1; // only the first frame carries _opcode
+  }
   _mask = mask;
 
   if (buffer) {
@@ -405,15 +466,39 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
   }
 }
 
- void AsyncWebSocketMultiMessage::ack(size_t len, uint32_t time)  {
+void * AsyncWebSocketMultiMessage::operator new(size_t size) noexcept {
+  void * p = _messagePool.alloc();
+  return p ? p : malloc(size);
+}
+
+void AsyncWebSocketMultiMessage::operator delete(void * p) {
+  if(_messagePool.owns(p))
+    _messagePool.free(p);
+  else
+    free(p);
+}
+
+ size_t AsyncWebSocketMultiMessage::ack(size_t len, uint32_t time)  {
    (void)time;
+  size_t extra = 0;
+  if(len > _ack - _acked){
+    extra = len - (_ack - _acked);
+    len -= extra;
+  }
   _acked += len;
   if(_sent >= _len && _acked >= _ack){
     _status = WS_MSG_SENT;
   }
   //ets_printf("A: %u\n", len);
+  return extra;
 }
  size_t AsyncWebSocketMultiMessage::send(AsyncClient *client)  {
+  size_t sent = add(client);
+  if(sent)
+    client->send();
+  return sent;
+}
+ size_t AsyncWebSocketMultiMessage::add(AsyncClient *client)  {
   if(_status != WS_MSG_SENDING)
     return 0;
   if(_acked < _ack){
@@ -445,7 +530,7 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
   uint8_t* dPtr = (uint8_t*)(_data + (_sent - toSend));
   uint8_t opCode = (toSend && _sent == toSend)?_opcode:(uint8_t)WS_CONTINUATION;
 
-  size_t sent = webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend);
+  size_t sent = webSocketAddFrame(client, final, opCode, _mask, dPtr, toSend);
   _status = WS_MSG_SENDING;
   if(toSend && sent != toSend){
       //ets_printf("E: %u != %u\n", toSend, sent);
@@ -457,6 +542,15 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
 }
 
 
+ size_t AsyncWebSocketMultiMessage::addMerged(AsyncClient *client, size_t headLen)  {
+  if(!mergeable() || client->add((const char *)_data, _len) != _len)
+    return 0;
+  _sent = _len;
+  _ack = _len + headLen;
+  return _len;
+}
+
+
 /*
  * Async WebSocket Client
  */
@@ -464,8 +558,8 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
  const size_t AWSC_PING_PAYLOAD_LEN = 22;
 
 AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server)
-  : _controlQueue(LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *c){ delete  c; }))
-  , _messageQueue(LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m){ delete  m; }))
+  : _controlQueue(WS_MAX_QUEUED_CONTROLS * 127)
+  , _messageQueue(WS_MAX_QUEUED_BYTES)
   , _tempObject(NULL)
 {
   _client = request->client();
@@ -475,6 +569,12 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _pstate = 0;
   _lastMessageTime = millis();
   _keepAlivePeriod = 0;
+  _deflate = _server->_acceptDeflate(request, NULL);
+  _inflating = false;
+  _inflateDiscard = false;
+  _inflateOpcode = WS_TEXT;
+  _inflateNum = 0;
+  _inflater = NULL;
   _client->setRxTimeout(0);
   _client->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; ((AsyncWebSocketClient*)(r))->_onError(error); }, this);
   _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
@@ -490,6 +590,7 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 AsyncWebSocketClient::~AsyncWebSocketClient(){
   _messageQueue.free();
   _controlQueue.free();
+  _inflateEnd();
   _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
 }
 
@@ -500,16 +601,17 @@ void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
     if(head->finished()){
       len -= head->len();
       if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
-        _controlQueue.remove(head);
+        _controlQueue.pop();
         _status = WS_DISCONNECTED;
         _client->close(true);
         return;
       }
-      _controlQueue.remove(head);
+      _controlQueue.pop();
     }
   }
-  if(len && !_messageQueue.isEmpty()){
-    _messageQueue.front()->ack(len, time);
+  //frames of several messages may be in flight, acks are handed on in order
+  for(size_t i = 0; len && i < _messageQueue.length(); i++){
+    len = _messageQueue.at(i)->ack(len, time);
   }
   _server->_cleanBuffers(); 
   _runQueue();
@@ -525,18 +627,82 @@ void AsyncWebSocketClient::_onPoll(){
 
 void AsyncWebSocketClient::_runQueue(){
   while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+    _messageQueue.pop();
   }
 
-  if(!_controlQueue.isEmpty() && (_messageQueue.isEmpty() || _messageQueue.front()->betweenFrames()) && webSocketSendFrameWindow(_client) > (size_t)(_controlQueue.front()->len() - 1)){
-    _controlQueue.front()->send(_client);
-  } else if(!_messageQueue.isEmpty() && _messageQueue.front()->betweenFrames() && webSocketSendFrameWindow(_client)){
-    _messageQueue.front()->send(_client);
+  if(!_controlQueue.isEmpty()){
+    //control frames go between data frames once everything in flight is acked
+    if(!_controlQueue.front()->finished() && _messagesAcked() && webSocketSendFrameWindow(_client) > (size_t)(_controlQueue.front()->len() - 1))
+      _controlQueue.front()->send(_client);
+    return;
+  }
+
+  //frames of consecutive messages are packed into the send window and pushed
+  //with one send(), in order: a message still waiting for the ack of a partial
+  //frame holds back the ones behind it. A run of small binary messages that
+  //fits the window whole goes out as one frame.
+  bool added = false;
+  for(size_t i = 0; i < _messageQueue.length(); i++){
+    AsyncWebSocketMessage *m = _messageQueue.at(i);
+    if(m->finished())
+      continue;
+    if(m->sentAll()){
+      if(m->betweenFrames())
+        m->add(_client); //nothing left to add, lets an empty message finish
+      continue;
+    }
+    if(!m->betweenFrames() || !webSocketSendFrameWindow(_client))
+      break;
+    size_t merged = _mergeRun(i);
+    if(merged > 1){
+      added = true;
+      i += merged - 1;
+      continue;
+    }
+    if(m->add(_client))
+      added = true;
+    if(!m->sentAll())
+      break;
+  }
+  if(added)
+    _client->send();
+}
+
+//sends the mergeable messages from the i-th on as one binary frame, as many
+//as fit the send window whole; returns how many, nothing is sent for one
+size_t AsyncWebSocketClient::_mergeRun(size_t i){
+  size_t window = webSocketSendFrameWindow(_client);
+  size_t count = 0;
+  size_t len = 0;
+  while(i + count < _messageQueue.length()){
+    AsyncWebSocketMessage *m = _messageQueue.at(i + count);
+    if(!m->mergeable() || len + m->length() > window || len + m->length() > 0xFFFF)
+      break;
+    len += m->length();
+    count++;
+  }
+  if(count < 2)
+    return 0;
+  size_t headLen = webSocketAddFrameHeader(_client, WS_BINARY, len);
+  if(!headLen)
+    return 0;
+  for(size_t n = 0; n < count; n++){
+    //the header is acked with the first message
+    _messageQueue.at(i + n)->addMerged(_client, n ? 0 : headLen);
   }
+  return count;
+}
+
+bool AsyncWebSocketClient::_messagesAcked() const {
+  for(size_t i = 0; i < _messageQueue.length(); i++){
+    if(!_messageQueue.at(i)->betweenFrames())
+      return false;
+  }
+  return true;
 }
 
 bool AsyncWebSocketClient::queueIsFull(){
-  if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (_status != WS_CONNECTED) ) return true;
+  if(_messageQueue.isFull() || (_status != WS_CONNECTED) ) return true;
   return false;
 }
 
@@ -547,11 +713,10 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
     delete dataMessage;
     return;
   }
-  if(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
+  if(!_messageQueue.push(dataMessage, dataMessage->length())){
+      //counted instead of printed, UART0 is the bridged port
+      _server->_countDropped(dataMessage->length());
       delete dataMessage;
-  } else {
-      _messageQueue.add(dataMessage);
   }
   if(_client->canSend())
     _runQueue();
@@ -560,7 +725,14 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
 void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
   if(controlMessage == NULL)
     return;
-  _controlQueue.add(controlMessage);
+  if(!_controlQueue.push(controlMessage, controlMessage->len())){
+    //the peer stopped reading, a close that cannot be queued drops the link
+    bool closing = controlMessage->opcode() == WS_DISCONNECT;
+    delete controlMessage;
+    if(closing)
+      _client->close(true);
+    return;
+  }
   if(_client->canSend())
     _runQueue();
 }
@@ -635,14 +807,25 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
         data += 4;
         plen -= 4;
       }
+
+      //RSV1 marks a compressed message, only allowed on its first frame and
+      //with permessage-deflate negotiated. RSV2 and RSV3 have no use here.
+      uint8_t rsv = fdata[0] & 0x70;
+      if(rsv && (rsv != WS_RSV1 || !_deflate || (_pinfo.opcode != WS_TEXT && _pinfo.opcode != WS_BINARY))){
+        //fail the connection, the rest of the data is ignored
+        close(1002);
+        _status = WS_DISCONNECTING;
+      } else if(_pinfo.opcode == WS_TEXT || _pinfo.opcode == WS_BINARY){
+        _inflating = rsv != 0;
+        _inflateOpcode = _pinfo.opcode;
+      }
     }
 
     const size_t datalen = std::min((size_t)(_pinfo.len - _pinfo.index), plen);
     const auto datalast = data[datalen];
 
     if(_pinfo.masked){
-      for(size_t i=0;i<datalen;i++)
-        data[i] ^= _pinfo.mask[(_pinfo.index+i)%4];
+      webSocketMask(data, datalen, _pinfo.mask, _pinfo.index);
     }
 
     if((datalen + _pinfo.index) < _pinfo.len){
@@ -654,7 +837,12 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
           _pinfo.num = 0;
         } else _pinfo.num += 1;
       }
-      _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, (uint8_t*)data, datalen);
+      if(_pinfo.opcode < 8 && _status != WS_CONNECTED){
+        //a close went out or came in, data frames are dropped
+      } else if(_inflating && _pinfo.opcode < 8)
+        _inflateData(data, datalen, false);
+      else
+        _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, (uint8_t*)data, datalen);
 
       _pinfo.index += datalen;
     } else if((datalen + _pinfo.index) == _pinfo.len){
@@ -681,7 +869,12 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
         if(datalen != AWSC_PING_PAYLOAD_LEN || memcmp(AWSC_PING_PAYLOAD, data, AWSC_PING_PAYLOAD_LEN) != 0)
           _server->_handleEvent(this, WS_EVT_PONG, NULL, data, datalen);
       } else if(_pinfo.opcode < 8){//continuation or text/binary frame
-        _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, data, datalen);
+        if(_status != WS_CONNECTED){
+          //a close went out or came in, data frames are dropped
+        } else if(_inflating)
+          _inflateData(data, datalen, _pinfo.final);
+        else
+          _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, data, datalen);
       }
     } else {
       //os_printf("frame error: len: %u, index: %llu, total: %llu\n", datalen, _pinfo.index, _pinfo.len);
@@ -698,6 +891,57 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
   }
 }
 
+//Inflates the frames of a compressed message as they come in. The handler
+//gets the result in window sized pieces, numbered like the frames of a
+//fragmented message: the first carries the opcode, the last is final.
+void AsyncWebSocketClient::_inflateData(uint8_t *data, size_t len, bool last){
+  //the rest of a message we already closed the connection over
+  if(_inflateDiscard){
+    _inflateDiscard = !last;
+    return;
+  }
+  if(!_inflater){
+    _inflater = _server->_takeInflater();
+    if(!_inflater){
+      //every inflater is busy with another client's message
+      _inflateDiscard = !last;
+      close(1013);
+      return;
+    }
+    webSocketInflateBegin(_inflater);
+    _inflateNum = 0;
+  }
+  bool ok = webSocketInflate(_inflater, data, len, last, _inflateSink, this);
+  if(ok && !last)
+    return;
+  _inflateEnd();
+  if(!ok){
+    _inflateDiscard = !last;
+    close(1007);
+    return;
+  }
+  _server->_countInflated();
+}
+
+void AsyncWebSocketClient::_inflateSink(void *arg, uint8_t *data, size_t len, bool last){
+  AsyncWebSocketClient *c = (AsyncWebSocketClient *)arg;
+  AwsFrameInfo info = c->_pinfo;
+  info.message_opcode = c->_inflateOpcode;
+  info.opcode = c->_inflateNum ? (uint8_t)WS_CONTINUATION : c->_inflateOpcode;
+  info.num = c->_inflateNum++;
+  info.final = last;
+  info.index = 0;
+  info.len = len;
+  c->_server->_handleEvent(c, WS_EVT_DATA, (void *)&info, data, len);
+}
+
+void AsyncWebSocketClient::_inflateEnd(){
+  if(_inflater){
+    _server->_giveInflater(_inflater);
+    _inflater = NULL;
+  }
+}
+
 size_t AsyncWebSocketClient::printf(const char *format, ...) {
   va_list arg;
   va_start(arg, format);
@@ -793,7 +1037,7 @@ void AsyncWebSocketClient::text(const __FlashStringHelper *data){
 }
 void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer * buffer)
 {
-  _queueMessage(new AsyncWebSocketMultiMessage(buffer));
+  _queueBuffer(buffer, _deflate ? _server->_deflateBuffer(buffer) : NULL, WS_TEXT);
 }
 
 void AsyncWebSocketClient::binary(const char * message, size_t len){
@@ -824,7 +1068,17 @@ void AsyncWebSocketClient::binary(const __FlashStringHelper *data, size_t len){
 }
 void AsyncWebSocketClient::binary(AsyncWebSocketMessageBuffer * buffer)
 {
-  _queueMessage(new AsyncWebSocketMultiMessage(buffer, WS_BINARY));
+  _queueBuffer(buffer, _deflate ? _server->_deflateBuffer(buffer) : NULL, WS_BINARY);
+}
+
+//deflated is the compressed copy of buffer if there is one, shared by all
+//clients that negotiated permessage-deflate
+void AsyncWebSocketClient::_queueBuffer(AsyncWebSocketMessageBuffer *buffer, AsyncWebSocketMessageBuffer *deflated, uint8_t opcode)
+{
+  if(_deflate && deflated)
+    _queueMessage(new AsyncWebSocketMultiMessage(deflated, opcode, false, true));
+  else
+    _queueMessage(new AsyncWebSocketMultiMessage(buffer, opcode));
 }
 
 IPAddress AsyncWebSocketClient::remoteIP() {
@@ -852,12 +1106,49 @@ AsyncWebSocket::AsyncWebSocket(const String& url)
   ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
   ,_cNextId(1)
   ,_enabled(true)
-  ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
+  ,_droppedMessages(0)
+  ,_droppedBytes(0)
+  ,_deflateEnabled(false)
+  ,_inflaters(NULL)
+  ,_inflatersUsed(0)
+  ,_buffers(nullptr)
 {
   _eventHandler = NULL;
+  memset(&_deflateStats, 0, sizeof(_deflateStats));
 }
 
-AsyncWebSocket::~AsyncWebSocket(){}
+AsyncWebSocket::~AsyncWebSocket(){
+  while(_buffers){
+    AsyncWebSocketMessageBuffer * b = _buffers;
+    _buffers = b->_next;
+    delete b;
+  }
+  free(_inflaters);
+}
+
+void AsyncWebSocket::enableDeflate(bool e){
+  //allocated once and kept, a compressed message never needs the heap
+  if(e && !_inflaters)
+    _inflaters = (AsyncWebInflater*)malloc(WS_INFLATERS * sizeof(AsyncWebInflater));
+  _deflateEnabled = e && _inflaters;
+}
+
+AsyncWebInflater * AsyncWebSocket::_takeInflater(){
+  AsyncWebLockGuard l(_lock);
+  for(uint8_t i = 0; _inflaters && i < WS_INFLATERS; i++){
+    if(!(_inflatersUsed & (1 << i))){
+      _inflatersUsed |= 1 << i;
+      return _inflaters + i;
+    }
+  }
+  _deflateStats.inflateBusy++;
+  return NULL;
+}
+
+void AsyncWebSocket::_giveInflater(AsyncWebInflater * inflater){
+  AsyncWebLockGuard l(_lock);
+  _inflatersUsed &= ~(1 << (inflater - _inflaters));
+}
 
 void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len){
   if(_eventHandler != NULL){
@@ -948,11 +1239,14 @@ void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
 void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
   if (!buffer) return;
   buffer->lock(); 
+  AsyncWebSocketMessageBuffer * deflated = _hasDeflateClient() ? _deflateBuffer(buffer) : NULL;
+  if (deflated) deflated->lock();
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED){
-        c->text(buffer);
+        c->_queueBuffer(buffer, deflated, WS_TEXT);
     }
   }
+  if (deflated) deflated->unlock();
   buffer->unlock();
   _cleanBuffers(); 
 }
@@ -978,10 +1272,13 @@ void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
   if (!buffer) return;
   buffer->lock(); 
+  AsyncWebSocketMessageBuffer * deflated = _hasDeflateClient() ? _deflateBuffer(buffer) : NULL;
+  if (deflated) deflated->lock();
     for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
-      c->binary(buffer);
+      c->_queueBuffer(buffer, deflated, WS_BINARY);
   }
+  if (deflated) deflated->unlock();
   buffer->unlock(); 
   _cleanBuffers(); 
 }
@@ -1151,6 +1448,8 @@ const char * WS_STR_ORIGIN = "Origin";
 const char * WS_STR_VERSION = "Sec-WebSocket-Version";
 const char * WS_STR_KEY = "Sec-WebSocket-Key";
 const char * WS_STR_PROTOCOL = "Sec-WebSocket-Protocol";
+const char * WS_STR_EXTENSIONS = "Sec-WebSocket-Extensions";
+const char * WS_STR_DEFLATE = "permessage-deflate";
 const char * WS_STR_ACCEPT = "Sec-WebSocket-Accept";
 const char * WS_STR_UUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
@@ -1167,6 +1466,7 @@ bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
   request->addInterestingHeader(WS_STR_VERSION);
   request->addInterestingHeader(WS_STR_KEY);
   request->addInterestingHeader(WS_STR_PROTOCOL);
+  request->addInterestingHeader(WS_STR_EXTENSIONS);
   return true;
 }
 
@@ -1192,42 +1492,177 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
     //ToDo: check protocol
     response->addHeader(WS_STR_PROTOCOL, protocol->value());
   }
+  String extension;
+  if(_acceptDeflate(request, &extension)){
+    response->addHeader(WS_STR_EXTENSIONS, extension);
+  }
   request->send(response);
 }
 
+//One permessage-deflate offer, RFC 7692 section 7.1. Declined if it has a
+//parameter we do not know, limits our window below WS_DEFLATE_WINDOW_BITS or
+//leaves out client_max_window_bits, without which the client's window cannot
+//be held to the WS_INFLATE_WINDOW_BITS we inflate with.
+static bool _acceptDeflateOffer(const String& offer, String *extension){
+  String response = WS_STR_DEFLATE;
+  response += "; server_no_context_takeover; client_no_context_takeover";
+  int start = 0;
+  bool first = true;
+  long clientBits = 0;
+  while(start <= (int)offer.length()){
+    int end = offer.indexOf(';', start);
+    if(end < 0)
+      end = offer.length();
+    String param = offer.substring(start, end);
+    start = end + 1;
+    param.trim();
+    if(first){
+      if(!param.equalsIgnoreCase(WS_STR_DEFLATE))
+        return false;
+      first = false;
+      continue;
+    }
+    String value;
+    int eq = param.indexOf('=');
+    if(eq >= 0){
+      value = param.substring(eq + 1);
+      param = param.substring(0, eq);
+      param.trim();
+      value.trim();
+      value.replace("\"", "");
+    }
+    if(param.equalsIgnoreCase("server_no_context_takeover") || param.equalsIgnoreCase("client_no_context_takeover")){
+      if(value.length())
+        return false;
+    } else if(param.equalsIgnoreCase("client_max_window_bits")){
+      clientBits = value.length() ? value.toInt() : 15;
+      if(clientBits < 8 || clientBits > 15)
+        return false;
+    } else if(param.equalsIgnoreCase("server_max_window_bits")){
+      long bits = value.toInt();
+      if(bits < WS_DEFLATE_WINDOW_BITS || bits > 15)
+        return false;
+      response += "; server_max_window_bits=";
+      response += value;
+    } else {
+      return false;
+    }
+  }
+  if(!clientBits)
+    return false;
+  response += "; client_max_window_bits=";
+  response += String(clientBits < WS_INFLATE_WINDOW_BITS ? clientBits : WS_INFLATE_WINDOW_BITS);
+  if(extension)
+    *extension = response;
+  return true;
+}
+
+bool AsyncWebSocket::_acceptDeflate(AsyncWebServerRequest *request, String *extension){
+  if(!_deflateEnabled || !request->hasHeader(WS_STR_EXTENSIONS))
+    return false;
+  const String& offers = request->getHeader(WS_STR_EXTENSIONS)->value();
+  int start = 0;
+  while(start < (int)offers.length()){
+    int end = offers.indexOf(',', start);
+    if(end < 0)
+      end = offers.length();
+    if(_acceptDeflateOffer(offers.substring(start, end), extension))
+      return true;
+    start = end + 1;
+  }
+  return false;
+}
+
+bool AsyncWebSocket::_hasDeflateClient(){
+  for(const auto& c: _clients){
+    if(c->status() == WS_CONNECTED && c->deflate())
+      return true;
+  }
+  return false;
+}
+
+//Compressed copy of buffer, or NULL when it is too short or does not shrink.
+//The copy is a regular buffer, released by _cleanBuffers() once sent.
+AsyncWebSocketMessageBuffer * AsyncWebSocket::_deflateBuffer(AsyncWebSocketMessageBuffer * buffer)
+{
+  size_t len = buffer->length();
+  if (!buffer->get() || len < WS_DEFLATE_MIN_SIZE) {
+    return NULL;
+  }
+  AsyncWebSocketMessageBuffer * deflated = makeBuffer(len - 1);
+  if (!deflated || !deflated->get()) {
+    return NULL;
+  }
+  //one match finder per server, on ESP32 any task may be broadcasting
+  AsyncWebLockGuard l(_lock);
+  uint32_t start = micros();
+  size_t deflatedLen = webSocketDeflate(&_deflater, buffer->get(), len, deflated->get(), len - 1);
+  _deflateStats.micros += micros() - start;
+  if (!deflatedLen) {
+    _deflateStats.skipped++;
+    return NULL;
+  }
+  deflated->_len = deflatedLen;
+  _deflateStats.messages++;
+  _deflateStats.bytesIn += len;
+  _deflateStats.bytesOut += deflatedLen;
+  return deflated;
+}
+
 AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(size_t size)
 {
   AsyncWebSocketMessageBuffer * buffer = new AsyncWebSocketMessageBuffer(size); 
-  if (buffer) {
-    AsyncWebLockGuard l(_lock);
-    _buffers.add(buffer);
-  }
+  _addBuffer(buffer);
   return buffer; 
 }
 
 AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(uint8_t * data, size_t size)
 {
   AsyncWebSocketMessageBuffer * buffer = new AsyncWebSocketMessageBuffer(data, size); 
-  
+  _addBuffer(buffer);
+  return buffer; 
+}
+
+void AsyncWebSocket::_addBuffer(AsyncWebSocketMessageBuffer * buffer)
+{
   if (buffer) {
     AsyncWebLockGuard l(_lock);
-    _buffers.add(buffer);
+    buffer->_next = _buffers;
+    _buffers = buffer;
   }
-
-  return buffer; 
 }
 
 void AsyncWebSocket::_cleanBuffers()
 {
   AsyncWebLockGuard l(_lock);
 
-  for(AsyncWebSocketMessageBuffer * c: _buffers){
-    if(c && c->canDelete()){
-        _buffers.remove(c);
+  AsyncWebSocketMessageBuffer ** link = &_buffers;
+  while (*link) {
+    AsyncWebSocketMessageBuffer * c = *link;
+    if (c->canDelete()) {
+      *link = c->_next;
+      delete c;
+    } else {
+      link = &c->_next;
     }
   }
 }
 
+AsyncWebPoolStats AsyncWebSocket::bufferPoolStats()
+{
+  return _bufferPool.stats();
+}
+
+AsyncWebPoolStats AsyncWebSocket::dataPoolStats()
+{
+  return _dataPool.stats();
+}
+
+AsyncWebPoolStats AsyncWebSocket::messagePoolStats()
+{
+  return _messagePool.stats();
+}
+
 AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() const {
   return _clients;
 }
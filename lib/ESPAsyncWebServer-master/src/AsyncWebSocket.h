@@ -25,13 +25,26 @@
 #ifdef ESP32
 #include <AsyncTCP.h>
 #define WS_MAX_QUEUED_MESSAGES 32
+#define WS_MAX_QUEUED_BYTES 16384
+#define WS_POOL_QUEUE_DEPTH 32
 #else
 #include <ESPAsyncTCP.h>
-#define WS_MAX_QUEUED_MESSAGES 8
+// the byte budget bounds the memory, the count only the slots (8 bytes each),
+// so a burst of small messages can wait for the ack and go out together
+#define WS_MAX_QUEUED_MESSAGES 32
+#define WS_MAX_QUEUED_BYTES 4096
+// the pools stay sized for the queue depth of steady traffic
+#define WS_POOL_QUEUE_DEPTH 8
 #endif
+// pings, pongs and the close frame waiting between data frames
+#define WS_MAX_QUEUED_CONTROLS 4
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncWebPool.h"
+#include "AsyncWebQueue.h"
+#include "AsyncWebDeflate.h"
+#include "AsyncWebMask.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -46,6 +59,20 @@
 #define DEFAULT_MAX_WS_CLIENTS 4
 #endif
 
+// Broadcast pools: message buffers up to WS_POOL_BUFFER_SIZE bytes, their
+// buffer objects and the per client messages referencing them come from fixed
+// pools, so a steady stream of broadcasts does not allocate. Bigger buffers or
+// an empty pool fall back to the heap.
+#ifndef WS_POOL_BUFFER_SIZE
+#define WS_POOL_BUFFER_SIZE 512
+#endif
+#ifndef WS_POOL_BUFFERS
+#define WS_POOL_BUFFERS WS_POOL_QUEUE_DEPTH
+#endif
+#ifndef WS_POOL_MESSAGES
+#define WS_POOL_MESSAGES (DEFAULT_MAX_WS_CLIENTS * WS_POOL_QUEUE_DEPTH)
+#endif
+
 class AsyncWebSocket;
 class AsyncWebSocketResponse;
 class AsyncWebSocketClient;
@@ -77,6 +104,8 @@ typedef struct {
 
 typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
 typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
+//first frame header bit of a permessage-deflate compressed message
+#define WS_RSV1 0x40
 typedef enum { WS_MSG_SENDING, WS_MSG_SENT, WS_MSG_ERROR } AwsMessageStatus;
 typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
 
@@ -86,8 +115,15 @@ class AsyncWebSocketMessageBuffer {
     size_t _len;
     bool _lock; 
     uint32_t _count;  
+    AsyncWebSocketMessageBuffer * _next; // AsyncWebSocket::_buffers
+
+    bool _allocData(size_t size);
+    void _freeData();
 
   public:
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * p);
+
     AsyncWebSocketMessageBuffer();
     AsyncWebSocketMessageBuffer(size_t size);
     AsyncWebSocketMessageBuffer(uint8_t * data, size_t size); 
@@ -108,6 +144,12 @@ class AsyncWebSocketMessageBuffer {
 
 };
 
+//frame writers, also usable by application defined AsyncWebSocketMessage types
+size_t webSocketSendFrameWindow(AsyncClient *client);
+size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len);
+//same without client->send(), for packing several frames into one send
+size_t webSocketAddFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len);
+
 class AsyncWebSocketMessage {
   protected:
     uint8_t _opcode;
@@ -116,10 +158,22 @@ class AsyncWebSocketMessage {
   public:
     AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR){}
     virtual ~AsyncWebSocketMessage(){}
-    virtual void ack(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){}
+    //takes the part of len that acks this message, returns the rest for the next one
+    virtual size_t ack(size_t len, uint32_t time __attribute__((unused))){ return len; }
     virtual size_t send(AsyncClient *client __attribute__((unused))){ return 0; }
+    //send() that leaves client->send() to the caller
+    virtual size_t add(AsyncClient *client){ return send(client); }
+    //all data handed to TCP, only acks outstanding
+    virtual bool sentAll() const { return false; }
+    //nothing sent yet of an uncompressed, unmasked binary message, its
+    //payload may share one frame with the messages next to it
+    virtual bool mergeable() const { return false; }
+    //adds the whole payload without a frame header, headLen header bytes of
+    //the shared frame are acked with it
+    virtual size_t addMerged(AsyncClient *client __attribute__((unused)), size_t headLen __attribute__((unused))){ return 0; }
     virtual bool finished(){ return _status != WS_MSG_SENDING; }
     virtual bool betweenFrames() const { return false; }
+    virtual size_t length() const { return 0; }
 };
 
 class AsyncWebSocketBasicMessage: public AsyncWebSocketMessage {
@@ -134,8 +188,13 @@ public:
     AsyncWebSocketBasicMessage(uint8_t opcode=WS_TEXT, bool mask=false);
     virtual ~AsyncWebSocketBasicMessage() override;
     virtual bool betweenFrames() const override { return _acked == _ack; }
-    virtual void ack(size_t len, uint32_t time) override ;
+    virtual size_t length() const override { return _len; }
+    virtual bool sentAll() const override { return _sent == _len; }
+    virtual bool mergeable() const override { return _status == WS_MSG_SENDING && _opcode == WS_BINARY && !_mask && _len && !_ack; }
+    virtual size_t addMerged(AsyncClient *client, size_t headLen) override ;
+    virtual size_t ack(size_t len, uint32_t time) override ;
     virtual size_t send(AsyncClient *client) override ;
+    virtual size_t add(AsyncClient *client) override ;
 };
 
 class AsyncWebSocketMultiMessage: public AsyncWebSocketMessage {
@@ -147,11 +206,18 @@ class AsyncWebSocketMultiMessage: public AsyncWebSocketMessage {
     size_t _acked;
     AsyncWebSocketMessageBuffer * _WSbuffer; 
 public:
-    AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode=WS_TEXT, bool mask=false); 
+    AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode=WS_TEXT, bool mask=false, bool compressed=false); 
     virtual ~AsyncWebSocketMultiMessage() override;
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * p);
     virtual bool betweenFrames() const override { return _acked == _ack; }
-    virtual void ack(size_t len, uint32_t time) override ;
+    virtual size_t length() const override { return _len; }
+    virtual bool sentAll() const override { return _sent == _len; }
+    virtual bool mergeable() const override { return _status == WS_MSG_SENDING && _opcode == WS_BINARY && !_mask && _len && !_ack; }
+    virtual size_t addMerged(AsyncClient *client, size_t headLen) override ;
+    virtual size_t ack(size_t len, uint32_t time) override ;
     virtual size_t send(AsyncClient *client) override ;
+    virtual size_t add(AsyncClient *client) override ;
 };
 
 class AsyncWebSocketClient {
@@ -161,8 +227,8 @@ class AsyncWebSocketClient {
     uint32_t _clientId;
     AwsClientStatus _status;
 
-    LinkedList<AsyncWebSocketControl *> _controlQueue;
-    LinkedList<AsyncWebSocketMessage *> _messageQueue;
+    AsyncWebQueue<AsyncWebSocketControl, WS_MAX_QUEUED_CONTROLS> _controlQueue;
+    AsyncWebQueue<AsyncWebSocketMessage, WS_MAX_QUEUED_MESSAGES> _messageQueue;
 
     uint8_t _pstate;
     AwsFrameInfo _pinfo;
@@ -170,9 +236,25 @@ class AsyncWebSocketClient {
     uint32_t _lastMessageTime;
     uint32_t _keepAlivePeriod;
 
+    //permessage-deflate negotiated, incoming compressed message being inflated
+    bool _deflate;
+    bool _inflating;
+    bool _inflateDiscard;
+    uint8_t _inflateOpcode;
+    uint32_t _inflateNum;
+    AsyncWebInflater * _inflater;
+
     void _queueMessage(AsyncWebSocketMessage *dataMessage);
+    void _queueBuffer(AsyncWebSocketMessageBuffer *buffer, AsyncWebSocketMessageBuffer *deflated, uint8_t opcode);
+    void _inflateData(uint8_t *data, size_t len, bool last);
+    void _inflateEnd();
+    static void _inflateSink(void *arg, uint8_t *data, size_t len, bool last);
     void _queueControl(AsyncWebSocketControl *controlMessage);
     void _runQueue();
+    size_t _mergeRun(size_t i);
+    bool _messagesAcked() const;
+
+    friend AsyncWebSocket;
 
   public:
     void *_tempObject;
@@ -186,6 +268,8 @@ class AsyncWebSocketClient {
     AsyncClient* client(){ return _client; }
     AsyncWebSocket *server(){ return _server; }
     AwsFrameInfo const &pinfo() const { return _pinfo; }
+    //permessage-deflate in use on this connection
+    bool deflate() const { return _deflate; }
 
     IPAddress remoteIP();
     uint16_t  remotePort();
@@ -226,7 +310,10 @@ class AsyncWebSocketClient {
     void binary(const __FlashStringHelper *data, size_t len);
     void binary(AsyncWebSocketMessageBuffer *buffer); 
 
-    bool canSend() { return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
+    bool canSend() { return !_messageQueue.isFull(); }
+    // data messages waiting and their payload bytes
+    size_t queueLength() const { return _messageQueue.length(); }
+    size_t queuedBytes() const { return _messageQueue.bytes(); }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -250,6 +337,15 @@ class AsyncWebSocket: public AsyncWebHandler {
     AwsEventHandler _eventHandler;
     bool _enabled;
     AsyncWebLock _lock;
+    uint32_t _droppedMessages;
+    uint32_t _droppedBytes;
+    bool _deflateEnabled;
+    AsyncWebDeflateStats _deflateStats;
+    AsyncWebDeflater _deflater;
+    AsyncWebInflater * _inflaters;
+    uint8_t _inflatersUsed;
+
+    bool _hasDeflateClient();
 
   public:
     AsyncWebSocket(const String& url);
@@ -257,10 +353,18 @@ class AsyncWebSocket: public AsyncWebHandler {
     const char * url() const { return _url.c_str(); }
     void enable(bool e){ _enabled = e; }
     bool enabled() const { return _enabled; }
+    //offer permessage-deflate to clients that ask for it, off by default.
+    //Turning it on allocates the inflaters, best done early in setup().
+    void enableDeflate(bool e);
+    bool deflateEnabled() const { return _deflateEnabled; }
+    const AsyncWebDeflateStats &deflateStats() const { return _deflateStats; }
     bool availableForWriteAll();
     bool availableForWrite(uint32_t id);
 
     size_t count() const;
+    //messages refused because a client queue was full, all clients together
+    uint32_t droppedMessages() const { return _droppedMessages; }
+    uint32_t droppedBytes() const { return _droppedBytes; }
     AsyncWebSocketClient * client(uint32_t id);
     bool hasClient(uint32_t id){ return client(id) != NULL; }
 
@@ -320,6 +424,12 @@ class AsyncWebSocket: public AsyncWebHandler {
     uint32_t _getNextId(){ return _cNextId++; }
     void _addClient(AsyncWebSocketClient * client);
     void _handleDisconnect(AsyncWebSocketClient * client);
+    void _countDropped(size_t len){ _droppedMessages++; _droppedBytes += len; }
+    void _countInflated(){ _deflateStats.inflated++; }
+    AsyncWebInflater * _takeInflater();
+    void _giveInflater(AsyncWebInflater * inflater);
+    bool _acceptDeflate(AsyncWebServerRequest *request, String *extension);
+    AsyncWebSocketMessageBuffer * _deflateBuffer(AsyncWebSocketMessageBuffer * buffer);
     void _handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
@@ -328,9 +438,15 @@ class AsyncWebSocket: public AsyncWebHandler {
     //  messagebuffer functions/objects. 
     AsyncWebSocketMessageBuffer * makeBuffer(size_t size = 0); 
     AsyncWebSocketMessageBuffer * makeBuffer(uint8_t * data, size_t size); 
-    LinkedList<AsyncWebSocketMessageBuffer *> _buffers;
+    AsyncWebSocketMessageBuffer * _buffers; // intrusive, linked through _next
+    void _addBuffer(AsyncWebSocketMessageBuffer * buffer);
     void _cleanBuffers(); 
 
+    // occupancy of the broadcast pools, shared by all servers
+    static AsyncWebPoolStats bufferPoolStats();
+    static AsyncWebPoolStats dataPoolStats();
+    static AsyncWebPoolStats messagePoolStats();
+
     AsyncWebSocketClientLinkedList getClients() const;
 };
 
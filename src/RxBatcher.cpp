@@ -0,0 +1,77 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include "RxBatcher.h"
+
+RxBatcher::RxBatcher(HardwareSerial &port)
+  :_port(port)
+  ,_pending(false)
+  ,_pendingSince(0)
+  ,_overruns(0)
+{
+}
+
+bool RxBatcher::ready()
+{
+  size_t len = _port.available();
+  if (len == 0)
+  {
+    return false;
+  }
+  return !_pending || len >= SERIAL_COALESCE_MAX_BYTES ||
+         (uint32_t)(micros() - _pendingSince) >= SERIAL_COALESCE_MAX_US;
+}
+
+size_t RxBatcher::poll(size_t max)
+{
+  if (_port.hasOverrun())
+  {
+    _overruns++;
+  }
+  size_t len = _port.available();
+  if (len == 0)
+  {
+    return 0;
+  }
+  if (!_pending)
+  {
+    _pending = true;
+    _pendingSince = micros();
+  }
+  if (len < SERIAL_COALESCE_MAX_BYTES && (uint32_t)(micros() - _pendingSince) < SERIAL_COALESCE_MAX_US)
+  {
+    return 0; //keep batching in the RX ring
+  }
+  if (len > SERIAL_COALESCE_MAX_BYTES) len = SERIAL_COALESCE_MAX_BYTES;
+  if (len > max) len = max; //the rest stays in the RX ring
+  return len;
+}
+
+size_t RxBatcher::read(uint8_t *buf, size_t len)
+{
+  len = _port.readBytes(buf, len);
+  //leftovers have waited already, flush them on the next pass
+  _pending = _port.available() > 0;
+  _pendingSince = micros() - SERIAL_COALESCE_MAX_US;
+  return len;
+}
@@ -0,0 +1,91 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler()
+  :_count(0)
+  ,_idlePasses(0)
+  ,_busyPasses(0)
+  ,_idleMicros(0)
+  ,_busyMicros(0)
+{
+}
+
+bool Scheduler::add(const char *name, ReadyFunc ready, RunFunc run, uint32_t period_ms)
+{
+  if (_count >= SCHED_MAX_TASKS || run == NULL)
+  {
+    return false;
+  }
+  Task &task = _tasks[_count++];
+  task.name = name;
+  task.ready = ready;
+  task.run = run;
+  task.periodMillis = period_ms;
+  task.lastRun = millis();
+  task.runs = 0;
+  task.maxMicros = 0;
+  return true;
+}
+
+uint8_t Scheduler::runOnce()
+{
+  uint8_t ran = 0;
+  uint32_t pass_start = micros();
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    Task &task = _tasks[i];
+    bool due = task.periodMillis != 0 && millis() - task.lastRun >= task.periodMillis;
+    if (!due && (task.ready == NULL || !task.ready()))
+    {
+      continue;
+    }
+    uint32_t start = micros();
+    task.run();
+    uint32_t took = micros() - start;
+    if (took > task.maxMicros) task.maxMicros = took;
+    task.lastRun = millis();
+    task.runs++;
+    ran++;
+  }
+  if (ran > 0)
+  {
+    _busyPasses++;
+    _busyMicros += micros() - pass_start;
+  }
+  else
+  {
+    _idlePasses++;
+    delay(SCHED_IDLE_SLEEP_MS);
+    _idleMicros += micros() - pass_start;
+  }
+  return ran;
+}
+
+uint8_t Scheduler::idlePercent() const
+{
+  uint64_t total = _idleMicros + _busyMicros;
+  return total ? (uint8_t)(_idleMicros * 100 / total) : 0;
+}
@@ -0,0 +1,888 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include "ScreenModel.h"
+
+#define SM_BOLD      0x01
+#define SM_DIM       0x02
+#define SM_UNDERLINE 0x04
+#define SM_BLINK     0x08
+#define SM_REVERSE   0x10
+#define SM_ACS       0x20 //DEC special graphics (line drawing)
+#define SM_FG        0x40 //fg color set, default otherwise
+#define SM_BG        0x80 //bg color set, default otherwise
+
+//UTF-8 of a BMP codepoint into u, returns its length
+static size_t Utf8(uint8_t *u, uint16_t ch)
+{
+  if (ch < 0x80)
+  {
+    u[0] = ch;
+    return 1;
+  }
+  if (ch < 0x800)
+  {
+    u[0] = 0xC0 | (ch >> 6);
+    u[1] = 0x80 | (ch & 0x3F);
+    return 2;
+  }
+  u[0] = 0xE0 | (ch >> 12);
+  u[1] = 0x80 | ((ch >> 6) & 0x3F);
+  u[2] = 0x80 | (ch & 0x3F);
+  return 3;
+}
+
+//SGR that sets exactly these attributes plus the matching G0 charset into p,
+//returns its length
+static size_t Sgr(char *p, uint8_t flags, uint8_t color)
+{
+  char *start = p;
+  p += sprintf(p, "\x1b[0");
+  if (flags & SM_BOLD) p += sprintf(p, ";1");
+  if (flags & SM_DIM) p += sprintf(p, ";2");
+  if (flags & SM_UNDERLINE) p += sprintf(p, ";4");
+  if (flags & SM_BLINK) p += sprintf(p, ";5");
+  if (flags & SM_REVERSE) p += sprintf(p, ";7");
+  if (flags & SM_FG) p += sprintf(p, ";%d", (color & 0x08 ? 90 : 30) + (color & 0x07));
+  if (flags & SM_BG) p += sprintf(p, ";%d", (color & 0x80 ? 100 : 40) + ((color >> 4) & 0x07));
+  p += sprintf(p, "m%s", (flags & SM_ACS) ? "\x1b(0" : "\x1b(B");
+  return p - start;
+}
+
+//History is plain text, line drawing is approximated with ASCII
+static uint16_t AcsToAscii(uint16_t ch)
+{
+  switch (ch)
+  {
+    case 'q': return '-';
+    case 'x': return '|';
+    case 'j': case 'k': case 'l': case 'm': case 'n':
+    case 't': case 'u': case 'v': case 'w': return '+';
+    default: return ch;
+  }
+}
+
+ScreenModel::ScreenModel()
+{
+  reset();
+}
+
+void ScreenModel::reset()
+{
+  _glyphCount = 0;
+  _attrs[0] = 0; //default attributes stay at index 0
+  _attrCount = 1;
+  _lastChar = 0;
+  _lastGlyph = '?';
+  _lastAttrKey = 0;
+  _lastAttr = 0;
+  _history.clear();
+  _historyWrapped = false;
+  _cx = _cy = 0;
+  _wrapPending = false;
+  _flags = 0;
+  _color = 0;
+  _top = 0;
+  _bottom = SCREEN_ROWS - 1;
+  _cursorHidden = false;
+  _altScreen = false;
+  _savedX = _savedY = _savedFlags = _savedColor = 0;
+  _state = ST_GROUND;
+  _nparams = 0;
+  _private = false;
+  _intermediate = false;
+  _charsetTarget = 0;
+  _utf8 = 0;
+  _utf8Left = 0;
+  clearRows(0, SCREEN_ROWS - 1);
+}
+
+uint16_t ScreenModel::param(uint8_t i, uint16_t def) const
+{
+  return (i < _nparams && _params[i] != 0) ? _params[i] : def;
+}
+
+void ScreenModel::moveTo(int x, int y)
+{
+  if (x < 0) x = 0;
+  if (x > SCREEN_COLS - 1) x = SCREEN_COLS - 1;
+  if (y < 0) y = 0;
+  if (y > SCREEN_ROWS - 1) y = SCREEN_ROWS - 1;
+  _cx = x;
+  _cy = y;
+  _wrapPending = false;
+}
+
+//Glyph byte values skip printable ASCII, index i is byte i or i + 95
+static inline uint8_t GlyphByte(uint8_t index) { return index < 0x20 ? index : index + 0x5F; }
+static inline uint8_t GlyphIndex(uint8_t glyph) { return glyph < 0x20 ? glyph : glyph - 0x5F; }
+static inline bool IsAscii(uint16_t ch) { return ch >= 0x20 && ch < 0x7F; }
+
+uint16_t ScreenModel::charAt(const Cell &c) const
+{
+  return IsAscii(c.glyph) ? c.glyph : _glyphs[GlyphIndex(c.glyph)];
+}
+
+uint8_t ScreenModel::glyphOf(uint16_t ch)
+{
+  if (IsAscii(ch))
+  {
+    return ch;
+  }
+  if (ch == _lastChar)
+  {
+    return _lastGlyph;
+  }
+  uint8_t i = 0;
+  while (i < _glyphCount && _glyphs[i] != ch)
+  {
+    i++;
+  }
+  if (i == _glyphCount)
+  {
+    if (_glyphCount == GLYPHS)
+    {
+      compactGlyphs();
+    }
+    if (_glyphCount == GLYPHS)
+    {
+      return '?'; //every one of them is on screen
+    }
+    i = _glyphCount++;
+    _glyphs[i] = ch;
+  }
+  _lastChar = ch;
+  _lastGlyph = GlyphByte(i);
+  return _lastGlyph;
+}
+
+uint8_t ScreenModel::attrOf(uint8_t flags, uint8_t color)
+{
+  uint16_t key = (flags << 8) | color;
+  if (key == _lastAttrKey)
+  {
+    return _lastAttr;
+  }
+  uint8_t i = 0;
+  while (i < _attrCount && _attrs[i] != key)
+  {
+    i++;
+  }
+  if (i == _attrCount)
+  {
+    if (_attrCount == ATTRS)
+    {
+      compactAttrs();
+    }
+    if (_attrCount == ATTRS)
+    {
+      return 0; //every one of them is on screen, fall back to the default
+    }
+    i = _attrCount++;
+    _attrs[i] = key;
+  }
+  _lastAttrKey = key;
+  _lastAttr = i;
+  return i;
+}
+
+//Drops the glyphs no cell uses any more and renumbers the rest
+void ScreenModel::compactGlyphs()
+{
+  uint8_t map[GLYPHS];
+  memset(map, 0xFF, sizeof(map));
+  for (uint8_t y = 0; y < SCREEN_ROWS; y++)
+  {
+    for (uint8_t x = 0; x < SCREEN_COLS; x++)
+    {
+      if (!IsAscii(_cells[y][x].glyph))
+      {
+        map[GlyphIndex(_cells[y][x].glyph)] = 0;
+      }
+    }
+  }
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _glyphCount; i++)
+  {
+    if (map[i] == 0)
+    {
+      _glyphs[count] = _glyphs[i];
+      map[i] = count++;
+    }
+  }
+  for (uint8_t y = 0; y < SCREEN_ROWS; y++)
+  {
+    for (uint8_t x = 0; x < SCREEN_COLS; x++)
+    {
+      Cell &c = _cells[y][x];
+      if (!IsAscii(c.glyph))
+      {
+        c.glyph = GlyphByte(map[GlyphIndex(c.glyph)]);
+      }
+    }
+  }
+  _glyphCount = count;
+  _lastChar = 0;
+}
+
+//Same for the attributes, the default keeps index 0
+void ScreenModel::compactAttrs()
+{
+  uint8_t map[ATTRS];
+  memset(map, 0xFF, sizeof(map));
+  map[0] = 0;
+  for (uint8_t y = 0; y < SCREEN_ROWS; y++)
+  {
+    for (uint8_t x = 0; x < SCREEN_COLS; x++)
+    {
+      map[_cells[y][x].attr] = 0;
+    }
+  }
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _attrCount; i++)
+  {
+    if (map[i] == 0)
+    {
+      _attrs[count] = _attrs[i];
+      map[i] = count++;
+    }
+  }
+  for (uint8_t y = 0; y < SCREEN_ROWS; y++)
+  {
+    for (uint8_t x = 0; x < SCREEN_COLS; x++)
+    {
+      _cells[y][x].attr = map[_cells[y][x].attr];
+    }
+  }
+  _attrCount = count;
+  _lastAttrKey = 0;
+  _lastAttr = 0;
+}
+
+void ScreenModel::clearCells(uint8_t row, uint8_t from, uint8_t to)
+{
+  //erased cells keep the current background, like xterm
+  Cell blank = { ' ', attrOf(_flags & SM_BG, _color & 0xF0) };
+  for (uint8_t x = from; x <= to && x < SCREEN_COLS; x++)
+  {
+    _cells[row][x] = blank;
+  }
+}
+
+void ScreenModel::clearRows(uint8_t from, uint8_t to)
+{
+  for (uint8_t y = from; y <= to && y < SCREEN_ROWS; y++)
+  {
+    clearCells(y, 0, SCREEN_COLS - 1);
+  }
+}
+
+void ScreenModel::saveLine(uint8_t row)
+{
+  uint8_t tmp[SCREEN_COLS * 3 + 2];
+  size_t len = 0;
+  int end = SCREEN_COLS;
+  while (end > 0 && _cells[row][end - 1].glyph == ' ')
+  {
+    end--;
+  }
+  for (int x = 0; x < end; x++)
+  {
+    const Cell &c = _cells[row][x];
+    len += Utf8(tmp + len, (flagsAt(c) & SM_ACS) ? AcsToAscii(charAt(c)) : charAt(c));
+  }
+  tmp[len++] = '\r';
+  tmp[len++] = '\n';
+  if (len > sizeof(tmp)) len = sizeof(tmp); //never true, lets -Warray-bounds see push() cannot wrap the ring
+  if (len > _history.available())
+  {
+    _historyWrapped = true;
+  }
+  _history.push(tmp, len);
+}
+
+void ScreenModel::scrollUp(uint8_t top, uint8_t bottom, uint8_t n)
+{
+  uint8_t lines = bottom - top + 1;
+  if (n > lines) n = lines;
+  if (top == 0 && !_altScreen)
+  {
+    for (uint8_t i = 0; i < n; i++)
+    {
+      saveLine(i);
+    }
+  }
+  memmove(&_cells[top][0], &_cells[top + n][0], (lines - n) * sizeof(_cells[0]));
+  clearRows(bottom - n + 1, bottom);
+}
+
+void ScreenModel::scrollDown(uint8_t top, uint8_t bottom, uint8_t n)
+{
+  uint8_t lines = bottom - top + 1;
+  if (n > lines) n = lines;
+  memmove(&_cells[top + n][0], &_cells[top][0], (lines - n) * sizeof(_cells[0]));
+  clearRows(top, top + n - 1);
+}
+
+void ScreenModel::index()
+{
+  if (_cy == _bottom)
+  {
+    scrollUp(_top, _bottom, 1);
+  }
+  else if (_cy < SCREEN_ROWS - 1)
+  {
+    _cy++;
+  }
+}
+
+void ScreenModel::reverseIndex()
+{
+  if (_cy == _top)
+  {
+    scrollDown(_top, _bottom, 1);
+  }
+  else if (_cy > 0)
+  {
+    _cy--;
+  }
+}
+
+void ScreenModel::putChar(uint16_t ch)
+{
+  if (_wrapPending)
+  {
+    _cx = 0;
+    index();
+    _wrapPending = false;
+  }
+  uint8_t glyph = glyphOf(ch);
+  uint8_t attr = attrOf(_flags, _color);
+  Cell &c = _cells[_cy][_cx];
+  c.glyph = glyph;
+  c.attr = attr;
+  if (_cx == SCREEN_COLS - 1)
+  {
+    _wrapPending = true;
+  }
+  else
+  {
+    _cx++;
+  }
+}
+
+void ScreenModel::control(uint8_t c)
+{
+  switch (c)
+  {
+    case '\b':
+      if (_cx > 0) _cx--;
+      _wrapPending = false;
+      break;
+    case '\t':
+      moveTo((_cx / 8 + 1) * 8, _cy);
+      break;
+    case '\n':
+    case '\v':
+    case '\f':
+      index();
+      _wrapPending = false;
+      break;
+    case '\r':
+      _cx = 0;
+      _wrapPending = false;
+      break;
+    case 0x0E: //SO, G1 not tracked
+    case 0x0F: //SI
+    default:
+      break;
+  }
+}
+
+void ScreenModel::escape(uint8_t c)
+{
+  _state = ST_GROUND;
+  switch (c)
+  {
+    case '[':
+      _state = ST_CSI;
+      _nparams = 0;
+      _params[0] = 0;
+      _private = false;
+      _intermediate = false;
+      break;
+    case ']': case 'P': case '^': case '_': case 'X':
+      _state = ST_STRING; //OSC/DCS/PM/APC/SOS, skipped up to BEL or ST
+      break;
+    case '(': case ')': case '*': case '+':
+      _state = ST_CHARSET;
+      _charsetTarget = c;
+      break;
+    case '7':
+      _savedX = _cx; _savedY = _cy; _savedFlags = _flags; _savedColor = _color;
+      break;
+    case '8':
+      moveTo(_savedX, _savedY);
+      _flags = _savedFlags; _color = _savedColor;
+      break;
+    case 'D':
+      index();
+      _wrapPending = false;
+      break;
+    case 'E':
+      _cx = 0;
+      index();
+      _wrapPending = false;
+      break;
+    case 'M':
+      reverseIndex();
+      _wrapPending = false;
+      break;
+    case 'c':
+      reset();
+      break;
+    default:
+      break;
+  }
+}
+
+void ScreenModel::sgr()
+{
+  if (_nparams == 0)
+  {
+    _params[0] = 0;
+    _nparams = 1;
+  }
+  for (uint8_t i = 0; i < _nparams; i++)
+  {
+    uint16_t p = _params[i];
+    if (p == 0) { _flags &= SM_ACS; _color = 0; }
+    else if (p == 1) _flags |= SM_BOLD;
+    else if (p == 2) _flags |= SM_DIM;
+    else if (p == 4) _flags |= SM_UNDERLINE;
+    else if (p == 5) _flags |= SM_BLINK;
+    else if (p == 7) _flags |= SM_REVERSE;
+    else if (p == 22) _flags &= ~(SM_BOLD | SM_DIM);
+    else if (p == 24) _flags &= ~SM_UNDERLINE;
+    else if (p == 25) _flags &= ~SM_BLINK;
+    else if (p == 27) _flags &= ~SM_REVERSE;
+    else if (p >= 30 && p <= 37) { _flags |= SM_FG; _color = (_color & 0xF0) | (p - 30); }
+    else if (p == 39) _flags &= ~SM_FG;
+    else if (p >= 40 && p <= 47) { _flags |= SM_BG; _color = (_color & 0x0F) | ((p - 40) << 4); }
+    else if (p == 49) _flags &= ~SM_BG;
+    else if (p >= 90 && p <= 97) { _flags |= SM_FG; _color = (_color & 0xF0) | (p - 90 + 8); }
+    else if (p >= 100 && p <= 107) { _flags |= SM_BG; _color = (_color & 0x0F) | ((p - 100 + 8) << 4); }
+    else if (p == 38 || p == 48)
+    {
+      //extended colors, only the 16 basic palette entries are kept
+      if (i + 2 < _nparams && _params[i + 1] == 5)
+      {
+        uint16_t n = _params[i + 2];
+        if (n < 16 && p == 38) { _flags |= SM_FG; _color = (_color & 0xF0) | n; }
+        if (n < 16 && p == 48) { _flags |= SM_BG; _color = (_color & 0x0F) | (n << 4); }
+        i += 2;
+      }
+      else if (i + 1 < _nparams && _params[i + 1] == 2)
+      {
+        i += 4;
+      }
+    }
+  }
+}
+
+void ScreenModel::csi(uint8_t final)
+{
+  _state = ST_GROUND;
+  if (_intermediate)
+  {
+    return;
+  }
+  if (_private)
+  {
+    if (final == 'h' || final == 'l')
+    {
+      bool set = (final == 'h');
+      for (uint8_t i = 0; i < _nparams; i++)
+      {
+        uint16_t p = _params[i];
+        if (p == 25)
+        {
+          _cursorHidden = !set;
+        }
+        else if ((p == 47 || p == 1047 || p == 1049) && set != _altScreen)
+        {
+          //The main screen is not kept, a second grid would double the RAM.
+          //Its lines go to the history instead and leaving the alternate
+          //screen starts a blank one at the top, so a repaint still shows
+          //them, as scrollback above whatever came after.
+          if (set)
+          {
+            int last = SCREEN_ROWS - 1;
+            while (last >= 0 && rowEnd(last) == 0)
+            {
+              last--;
+            }
+            for (int y = 0; y <= last; y++)
+            {
+              saveLine(y);
+            }
+          }
+          _altScreen = set;
+          clearRows(0, SCREEN_ROWS - 1);
+          if (p == 1049 || !set) moveTo(0, 0);
+        }
+      }
+    }
+    return;
+  }
+
+  int n = param(0, 1);
+  uint8_t i;
+  if (n > 255) n = 255;
+  switch (final)
+  {
+    case 'A': moveTo(_cx, _cy - n); break;
+    case 'B': moveTo(_cx, _cy + n); break;
+    case 'C': moveTo(_cx + n, _cy); break;
+    case 'D': moveTo(_cx - n, _cy); break;
+    case 'E': moveTo(0, _cy + n); break;
+    case 'F': moveTo(0, _cy - n); break;
+    case 'G': case '`': moveTo(n - 1, _cy); break;
+    case 'd': moveTo(_cx, n - 1); break;
+    case 'H': case 'f': moveTo(param(1, 1) - 1, n - 1); break;
+    case 'J':
+      switch (param(0, 0))
+      {
+        case 0:
+          clearCells(_cy, _cx, SCREEN_COLS - 1);
+          if (_cy < SCREEN_ROWS - 1) clearRows(_cy + 1, SCREEN_ROWS - 1);
+          break;
+        case 1:
+          if (_cy > 0) clearRows(0, _cy - 1);
+          clearCells(_cy, 0, _cx);
+          break;
+        default:
+          clearRows(0, SCREEN_ROWS - 1);
+          break;
+      }
+      break;
+    case 'K':
+      switch (param(0, 0))
+      {
+        case 0: clearCells(_cy, _cx, SCREEN_COLS - 1); break;
+        case 1: clearCells(_cy, 0, _cx); break;
+        default: clearCells(_cy, 0, SCREEN_COLS - 1); break;
+      }
+      break;
+    case 'X':
+      if (n > SCREEN_COLS - _cx) n = SCREEN_COLS - _cx;
+      clearCells(_cy, _cx, _cx + n - 1);
+      break;
+    case '@':
+      if (n > SCREEN_COLS - _cx) n = SCREEN_COLS - _cx;
+      memmove(&_cells[_cy][_cx + n], &_cells[_cy][_cx], (SCREEN_COLS - _cx - n) * sizeof(Cell));
+      clearCells(_cy, _cx, _cx + n - 1);
+      break;
+    case 'P':
+      if (n > SCREEN_COLS - _cx) n = SCREEN_COLS - _cx;
+      memmove(&_cells[_cy][_cx], &_cells[_cy][_cx + n], (SCREEN_COLS - _cx - n) * sizeof(Cell));
+      clearCells(_cy, SCREEN_COLS - n, SCREEN_COLS - 1);
+      break;
+    case 'L':
+      if (_cy >= _top && _cy <= _bottom) scrollDown(_cy, _bottom, n);
+      _cx = 0;
+      break;
+    case 'M':
+      if (_cy >= _top && _cy <= _bottom)
+      {
+        //deleted lines are not history, only lines leaving the top are
+        bool alt = _altScreen;
+        _altScreen = true;
+        scrollUp(_cy, _bottom, n);
+        _altScreen = alt;
+      }
+      _cx = 0;
+      break;
+    case 'S': scrollUp(_top, _bottom, n); break;
+    case 'T': scrollDown(_top, _bottom, n); break;
+    case 'm': sgr(); break;
+    case 'r':
+      i = param(0, 1) - 1;
+      n = param(1, SCREEN_ROWS) - 1;
+      if (n > SCREEN_ROWS - 1) n = SCREEN_ROWS - 1;
+      if (i < n)
+      {
+        _top = i;
+        _bottom = n;
+        moveTo(0, 0);
+      }
+      break;
+    case 's':
+      _savedX = _cx; _savedY = _cy; _savedFlags = _flags; _savedColor = _color;
+      break;
+    case 'u':
+      moveTo(_savedX, _savedY);
+      _flags = _savedFlags; _color = _savedColor;
+      break;
+    default:
+      break;
+  }
+}
+
+void ScreenModel::write(const uint8_t *data, size_t len)
+{
+  for (size_t k = 0; k < len; k++)
+  {
+    uint8_t c = data[k];
+    switch (_state)
+    {
+      case ST_GROUND:
+        if (_utf8Left > 0)
+        {
+          if ((c & 0xC0) == 0x80)
+          {
+            _utf8 = (_utf8 << 6) | (c & 0x3F);
+            if (--_utf8Left == 0)
+            {
+              putChar(_utf8 > 0xFFFF ? 0xFFFD : _utf8); //cells hold the BMP only
+            }
+            continue;
+          }
+          _utf8Left = 0;
+          putChar(0xFFFD); //truncated sequence, c is processed below
+        }
+        if (c >= 0x20 && c < 0x7F)
+        {
+          putChar(c);
+        }
+        else if (c == 0x1B)
+        {
+          _state = ST_ESC;
+        }
+        else if (c < 0x20)
+        {
+          control(c);
+        }
+        else if ((c & 0xE0) == 0xC0)
+        {
+          _utf8 = c & 0x1F;
+          _utf8Left = 1;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+          _utf8 = c & 0x0F;
+          _utf8Left = 2;
+        }
+        else if ((c & 0xF8) == 0xF0)
+        {
+          _utf8 = c & 0x07;
+          _utf8Left = 3;
+        }
+        break;
+      case ST_ESC:
+        escape(c);
+        break;
+      case ST_CSI:
+        if (c >= '0' && c <= '9')
+        {
+          if (_nparams == 0) _nparams = 1;
+          uint16_t &p = _params[_nparams - 1];
+          if (p < 10000) p = p * 10 + (c - '0');
+        }
+        else if (c == ';' || c == ':')
+        {
+          if (_nparams == 0) _nparams = 1;
+          if (_nparams < sizeof(_params) / sizeof(_params[0]))
+          {
+            _params[_nparams++] = 0;
+          }
+        }
+        else if (c == '?' || c == '>' || c == '=' || c == '<')
+        {
+          _private = true;
+        }
+        else if (c >= 0x20 && c <= 0x2F)
+        {
+          _intermediate = true;
+        }
+        else if (c >= 0x40 && c <= 0x7E)
+        {
+          csi(c);
+        }
+        else if (c == 0x1B)
+        {
+          _state = ST_ESC;
+        }
+        else if (c < 0x20)
+        {
+          control(c); //C0 controls are executed inside sequences
+        }
+        break;
+      case ST_STRING:
+        if (c == 0x07) _state = ST_GROUND;
+        else if (c == 0x1B) _state = ST_STRING_ESC;
+        break;
+      case ST_STRING_ESC:
+        _state = (c == '\\') ? ST_GROUND : ST_STRING;
+        break;
+      case ST_CHARSET:
+        if (_charsetTarget == '(')
+        {
+          if (c == '0') _flags |= SM_ACS;
+          else _flags &= ~SM_ACS;
+        }
+        _state = ST_GROUND;
+        break;
+    }
+  }
+}
+
+//Trailing default blanks of a row are not rendered
+uint8_t ScreenModel::rowEnd(uint8_t row) const
+{
+  uint8_t end = SCREEN_COLS;
+  while (end > 0 && _cells[row][end - 1].glyph == ' ' && flagsAt(_cells[row][end - 1]) == 0)
+  {
+    end--;
+  }
+  return end;
+}
+
+void ScreenModel::renderBegin(RenderPos &pos) const
+{
+  pos.phase = RENDER_START;
+  pos.offset = 0;
+  //once the ring has wrapped, history starts at its first complete line
+  if (_historyWrapped)
+  {
+    while (pos.offset < _history.size() && _history[pos.offset] != '\n')
+    {
+      pos.offset++;
+    }
+    pos.offset++;
+  }
+  pos.x = 0;
+  pos.y = 0;
+  pos.end = rowEnd(0);
+  pos.flags = 0;
+  pos.color = 0;
+}
+
+//Emits whole units only: an escape sequence or a character never straddles
+//two calls, history text is copied as it comes
+size_t ScreenModel::render(RenderPos &pos, uint8_t *out, size_t max) const
+{
+  char unit[SCREEN_RENDER_MIN];
+  size_t len = 0;
+  while (pos.phase != RENDER_DONE)
+  {
+    if (pos.phase == RENDER_HISTORY)
+    {
+      CircularBuffer<uint8_t,SCREEN_HISTORY_SIZE>::index_t n;
+      const uint8_t *run = _history.span(pos.offset, n);
+      if (run == NULL)
+      {
+        pos.phase = RENDER_ROWS;
+        continue;
+      }
+      if (n > max - len) n = max - len;
+      if (n == 0) break;
+      memcpy(out + len, run, n);
+      len += n;
+      pos.offset += n;
+      continue;
+    }
+
+    RenderPos next = pos;
+    size_t n = 0;
+    if (pos.phase == RENDER_START)
+    {
+      n = Sgr(unit, 0, 0);
+      next.phase = RENDER_HISTORY;
+    }
+    else if (pos.phase == RENDER_ROWS && pos.x < pos.end)
+    {
+      const Cell &c = _cells[pos.y][pos.x];
+      uint8_t flags = flagsAt(c);
+      uint8_t color = colorAt(c);
+      if (flags != pos.flags || color != pos.color)
+      {
+        n = Sgr(unit, flags, color);
+        next.flags = flags;
+        next.color = color;
+      }
+      n += Utf8((uint8_t *)unit + n, charAt(c));
+      next.x++;
+    }
+    else if (pos.phase == RENDER_ROWS && pos.y < SCREEN_ROWS - 1)
+    {
+      if (pos.flags != 0)
+      {
+        n = Sgr(unit, 0, 0);
+        next.flags = 0;
+        next.color = 0;
+      }
+      unit[n++] = '\r';
+      unit[n++] = '\n';
+      next.x = 0;
+      next.y++;
+      next.end = rowEnd(next.y);
+    }
+    else if (pos.phase == RENDER_ROWS)
+    {
+      next.phase = RENDER_TAIL;
+    }
+    else
+    {
+      //scroll region, cursor and current attributes
+      if (_top != 0 || _bottom != SCREEN_ROWS - 1)
+      {
+        n += sprintf(unit + n, "\x1b[%d;%dr", _top + 1, _bottom + 1);
+        n += sprintf(unit + n, "\x1b[%d;%dH", _cy + 1, _cx + 1);
+      }
+      else
+      {
+        //relative moves keep working on a client taller than the model
+        unit[n++] = '\r';
+        if (_cy < SCREEN_ROWS - 1)
+        {
+          n += sprintf(unit + n, "\x1b[%dA", SCREEN_ROWS - 1 - _cy);
+        }
+        if (_cx > 0)
+        {
+          n += sprintf(unit + n, "\x1b[%dC", _cx);
+        }
+      }
+      n += Sgr(unit + n, _flags, _color);
+      n += sprintf(unit + n, _cursorHidden ? "\x1b[?25l" : "\x1b[?25h");
+      next.phase = RENDER_DONE;
+    }
+    if (n > max - len) break;
+    memcpy(out + len, unit, n);
+    len += n;
+    pos = next;
+  }
+  return len;
+}
@@ -0,0 +1,470 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include "SdLogWriter.h"
+#include <TimeLib.h>
+
+//SD_REC_SEGMENT payload: "ETTL", version, segment number, now(), wraps
+#define SEGMENT_PAYLOAD_SIZE 17
+//SD_REC_INDEX payload without the entries: previous, count, wraps
+#define INDEX_PAYLOAD_SIZE 10
+
+static void PutU16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void PutU32(uint8_t *p, uint32_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+SdLogWriter::SdLogWriter()
+  :_open(false)
+  ,_filePos(0)
+  ,_unsynced(0)
+  ,_oldestMillis(0)
+  ,_bytesWritten(0)
+  ,_bytesDropped(0)
+  ,_recordsDropped(0)
+  ,_streamPos(0)
+  ,_lastIndexPos(0xFFFFFFFF)
+  ,_nextIndexAt(0)
+  ,_nextEntryAt(0)
+  ,_entryCount(0)
+  ,_flushes(0)
+  ,_maxServiceMicros(0)
+  ,_lastMillis(0)
+  ,_millisWraps(0)
+  ,_firstSegment(1)
+  ,_lastSegment(1)
+  ,_rotState(ROT_NONE)
+  ,_cutBytes(0)
+  ,_rotations(0)
+{
+}
+
+void SdLogWriter::segmentName(char *buf, uint32_t n)
+{
+  sprintf(buf, "/TTL%05u.BIN", (unsigned)n);
+}
+
+//Parses TTLnnnnn.BIN, returns 0 for anything else
+static uint32_t SegmentNumber(const char *name)
+{
+  const char *slash = strrchr(name, '/');
+  if (slash) name = slash + 1;
+  if (strlen(name) != 12 || strncasecmp(name, "TTL", 3) != 0 || strcasecmp(name + 8, ".BIN") != 0)
+  {
+    return 0;
+  }
+  uint32_t n = 0;
+  for (int i = 3; i < 8; i++)
+  {
+    if (name[i] < '0' || name[i] > '9') return 0;
+    n = n * 10 + (name[i] - '0');
+  }
+  return n;
+}
+
+bool SdLogWriter::openSegment(uint32_t n)
+{
+  char name[16];
+  segmentName(name, n);
+  _file = SD.open(name, FILE_WRITE);
+  _open = (bool)_file;
+  _filePos = _open ? _file.size() : 0;
+  _unsynced = 0;
+  return _open;
+}
+
+bool SdLogWriter::begin()
+{
+  //the only directory scan, done once at setup
+  uint32_t first = 0, last = 0;
+  File root = SD.open("/");
+  if (root)
+  {
+    File entry;
+    while ((entry = root.openNextFile()))
+    {
+      uint32_t n = SegmentNumber(entry.name());
+      if (n != 0)
+      {
+        if (first == 0 || n < first) first = n;
+        if (n > last) last = n;
+      }
+      entry.close();
+    }
+    root.close();
+  }
+  _firstSegment = first ? first : 1;
+  _lastSegment = last ? last : 1;
+  if (!openSegment(_lastSegment))
+  {
+    return false;
+  }
+  if (_filePos >= SD_LOG_SEGMENT_SIZE)
+  {
+    _file.close();
+    openSegment(++_lastSegment);
+  }
+  while (_lastSegment - _firstSegment + 1 > SD_LOG_MAX_SEGMENTS)
+  {
+    char name[16];
+    segmentName(name, _firstSegment++);
+    SD.remove(name);
+  }
+  _buffer.clear();
+  _rotState = ROT_NONE;
+  //index chain restarts at every boot, readers find it by scanning
+  _streamPos = _filePos;
+  _lastIndexPos = 0xFFFFFFFF;
+  _nextIndexAt = _streamPos + SD_LOG_INDEX_INTERVAL;
+  _nextEntryAt = _streamPos;
+  _entryCount = 0;
+  _lastMillis = millis();
+  _millisWraps = 0;
+
+  uint8_t boot[9] = { 'E', 'T', 'T', 'L', SD_LOG_VERSION };
+  PutU32(boot + 5, (uint32_t)now());
+  record(SD_REC_BOOT, boot, sizeof(boot));
+  return _open;
+}
+
+void SdLogWriter::end()
+{
+  if (_open)
+  {
+    //finish a rotation in progress, the file may be closed midway
+    while (_rotState != ROT_NONE && _open)
+    {
+      if (_rotState == ROT_DRAIN)
+      {
+        writeOut(pending());
+      }
+      rotateStep();
+    }
+    if (_open)
+    {
+      flush();
+      _file.close();
+      _open = false;
+    }
+  }
+}
+
+//Callers make sure len fits
+void SdLogWriter::append(const uint8_t *data, size_t len)
+{
+  if (_buffer.isEmpty() && _unsynced == 0)
+  {
+    _oldestMillis = millis(); //first byte not yet safe on the card
+  }
+  _buffer.push(data, len);
+  _streamPos += len;
+}
+
+//millis() for a record header, counting its wraps on the way; only a
+//log idle for the whole 49.7 day period would miss one
+uint32_t SdLogWriter::stamp()
+{
+  uint32_t ms = millis();
+  if (ms < _lastMillis)
+  {
+    _millisWraps++;
+  }
+  _lastMillis = ms;
+  return ms;
+}
+
+void SdLogWriter::appendHeader(uint8_t type, size_t len, uint32_t ms)
+{
+  uint8_t head[SD_REC_HEADER_SIZE];
+  head[0] = SD_LOG_MAGIC;
+  head[1] = type;
+  PutU16(head + 2, (uint16_t)len);
+  PutU32(head + 4, ms);
+  append(head, sizeof(head));
+}
+
+bool SdLogWriter::writeIndex(uint32_t ms)
+{
+  uint8_t payload[INDEX_PAYLOAD_SIZE + SD_LOG_INDEX_ENTRIES * 8];
+  size_t len = INDEX_PAYLOAD_SIZE + _entryCount * 8;
+  if (SD_REC_HEADER_SIZE + len > _buffer.available())
+  {
+    return false; //try again after the next record
+  }
+  PutU32(payload, _lastIndexPos);
+  PutU16(payload + 4, _entryCount);
+  for (uint8_t i = 0; i < _entryCount; i++)
+  {
+    PutU32(payload + 6 + i * 8, _entryMillis[i]);
+    PutU32(payload + 10 + i * 8, _entryOffset[i]);
+  }
+  PutU32(payload + 6 + _entryCount * 8, _millisWraps);
+  _lastIndexPos = _streamPos;
+  appendHeader(SD_REC_INDEX, len, ms);
+  append(payload, len);
+  _entryCount = 0;
+  _nextIndexAt = _streamPos + SD_LOG_INDEX_INTERVAL;
+  return true;
+}
+
+bool SdLogWriter::record(uint8_t type, const uint8_t *data, size_t len)
+{
+  if (!_open)
+  {
+    return false;
+  }
+  size_t need = SD_REC_HEADER_SIZE + len;
+  if (_rotState == ROT_NONE && _streamPos + need >= SD_LOG_SEGMENT_SIZE)
+  {
+    //the record that ends a segment also brings the closing index and the
+    //next segment's header, which must not be dropped
+    need += 2 * SD_REC_HEADER_SIZE + INDEX_PAYLOAD_SIZE + (_entryCount + 1) * 8 + SEGMENT_PAYLOAD_SIZE;
+  }
+  if (len > 0xFFFF || need > _buffer.available())
+  {
+    //card is behind, drop whole records so the framing stays intact
+    _bytesDropped += len;
+    _recordsDropped++;
+    return false;
+  }
+  uint32_t ms = stamp();
+  if (_streamPos >= _nextEntryAt && _entryCount < SD_LOG_INDEX_ENTRIES)
+  {
+    _entryMillis[_entryCount] = ms;
+    _entryOffset[_entryCount] = _streamPos;
+    _entryCount++;
+    _nextEntryAt = _streamPos + SD_LOG_INDEX_STRIDE;
+  }
+  appendHeader(type, len, ms);
+  append(data, len);
+  if (_streamPos >= _nextIndexAt)
+  {
+    writeIndex(ms);
+  }
+  if (_streamPos >= SD_LOG_SEGMENT_SIZE && _rotState == ROT_NONE)
+  {
+    cutSegment(ms);
+  }
+  return true;
+}
+
+//Everything buffered so far goes to the current segment, everything after
+//it to the next one, which starts with a segment record
+void SdLogWriter::cutSegment(uint32_t ms)
+{
+  if (_entryCount > 0)
+  {
+    writeIndex(ms);
+  }
+  _cutBytes = _buffer.size();
+  _rotState = (_cutBytes > 0) ? ROT_DRAIN : ROT_CLOSE;
+  _streamPos = 0;
+  _lastIndexPos = 0xFFFFFFFF;
+  _nextIndexAt = SD_LOG_INDEX_INTERVAL;
+  _nextEntryAt = 0;
+  _entryCount = 0;
+
+  uint8_t seg[SEGMENT_PAYLOAD_SIZE] = { 'E', 'T', 'T', 'L', SD_LOG_VERSION };
+  PutU32(seg + 5, _lastSegment + 1);
+  PutU32(seg + 9, (uint32_t)now());
+  PutU32(seg + 13, _millisWraps);
+  //room was reserved by the record that crossed the segment size
+  appendHeader(SD_REC_SEGMENT, sizeof(seg), ms);
+  append(seg, sizeof(seg));
+}
+
+//One card operation per call, keeps the loop stall to a single FAT update
+void SdLogWriter::rotateStep()
+{
+  char name[16];
+  switch (_rotState)
+  {
+    case ROT_DRAIN:
+      if (_cutBytes == 0)
+      {
+        _rotState = ROT_CLOSE;
+      }
+      break;
+    case ROT_CLOSE:
+      _file.flush();
+      _file.close();
+      _flushes++;
+      _unsynced = 0;
+      _rotState = ROT_OPEN;
+      break;
+    case ROT_OPEN:
+      _rotations++;
+      if (!openSegment(++_lastSegment))
+      {
+        _rotState = ROT_NONE;
+        break;
+      }
+      _rotState = (_lastSegment - _firstSegment + 1 > SD_LOG_MAX_SEGMENTS) ? ROT_REMOVE : ROT_NONE;
+      break;
+    case ROT_REMOVE:
+      segmentName(name, _firstSegment++);
+      SD.remove(name);
+      _rotState = ROT_NONE;
+      break;
+    default:
+      break;
+  }
+}
+
+//Buffered bytes that can go to the currently open segment
+size_t SdLogWriter::pending() const
+{
+  switch (_rotState)
+  {
+    case ROT_NONE: return _buffer.size();
+    case ROT_DRAIN: return _cutBytes;
+    default: return 0;
+  }
+}
+
+//Writes up to len buffered bytes straight out of the ring
+size_t SdLogWriter::writeOut(size_t len)
+{
+  size_t done = 0;
+  while (done < len && !_buffer.isEmpty())
+  {
+    CircularBuffer<uint8_t,SD_LOG_BUFFER_SECTORS * SD_SECTOR_SIZE>::index_t n;
+    const uint8_t *run = _buffer.span(0, n);
+    if (n > len - done) n = len - done;
+    size_t w = _file.write(run, n);
+    _buffer.shift(NULL, w);
+    done += w;
+    if (w < n)
+    {
+      break; //card error, retry on next service()
+    }
+  }
+  _filePos += done;
+  _unsynced += done;
+  _bytesWritten += done;
+  if (_rotState == ROT_DRAIN)
+  {
+    _cutBytes -= done;
+  }
+  return done;
+}
+
+void SdLogWriter::sync()
+{
+  _file.flush();
+  _unsynced = 0;
+  _flushes++;
+}
+
+bool SdLogWriter::serviceDue() const
+{
+  if (!_open)
+  {
+    return false;
+  }
+  if (_rotState != ROT_NONE)
+  {
+    return true;
+  }
+  if (_buffer.isEmpty() && _unsynced == 0)
+  {
+    return false;
+  }
+  if (millis() - _oldestMillis >= SD_LOG_FLUSH_MS || _unsynced >= SD_LOG_FLUSH_BYTES)
+  {
+    return true;
+  }
+  return _buffer.size() >= SD_SECTOR_SIZE - (_filePos % SD_SECTOR_SIZE);
+}
+
+void SdLogWriter::service()
+{
+  if (!_open || (_rotState == ROT_NONE && _buffer.isEmpty() && _unsynced == 0))
+  {
+    return;
+  }
+  uint32_t start = micros();
+  if (_rotState != ROT_NONE && _rotState != ROT_DRAIN)
+  {
+    rotateStep();
+  }
+  else
+  {
+    //the next write ends on a sector boundary of the file
+    size_t sector_room = SD_SECTOR_SIZE - (_filePos % SD_SECTOR_SIZE);
+    size_t len = pending();
+    //nothing may stay unsynced longer than SD_LOG_FLUSH_MS, the buffer is
+    //drained one sector per pass and synced on the pass after that
+    if (millis() - _oldestMillis >= SD_LOG_FLUSH_MS)
+    {
+      if (len > 0 && _unsynced < SD_LOG_FLUSH_BYTES)
+      {
+        writeOut(len < sector_room ? len : sector_room);
+      }
+      else
+      {
+        sync();
+      }
+    }
+    else if (_unsynced >= SD_LOG_FLUSH_BYTES)
+    {
+      sync(); //a pass of its own, not on top of the write that got here
+    }
+    else if (len >= sector_room)
+    {
+      writeOut(sector_room);
+    }
+    else if (_rotState == ROT_DRAIN)
+    {
+      writeOut(len); //tail of the segment, no need to wait for a full sector
+    }
+    if (_rotState == ROT_DRAIN)
+    {
+      rotateStep();
+    }
+  }
+  uint32_t took = micros() - start;
+  if (took > _maxServiceMicros)
+  {
+    _maxServiceMicros = took;
+  }
+}
+
+void SdLogWriter::flush()
+{
+  if (!_open || (_rotState != ROT_NONE && _rotState != ROT_DRAIN))
+  {
+    return;
+  }
+  writeOut(pending());
+  sync();
+}
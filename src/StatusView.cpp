@@ -0,0 +1,177 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#include "StatusView.h"
+
+StatusView::StatusView()
+  :_display(NULL)
+  ,_lastFrame(0)
+  ,_frames(0)
+  ,_changed(true)
+  ,_fullRedraw(true)
+  ,_ip(0)
+  ,_baud(0)
+  ,_telnetClients(0)
+  ,_webClients(0)
+  ,_dropped(0)
+  ,_loopMaxMicros(0)
+  ,_heap(0)
+  ,_frag(0)
+  ,_rxBytes(0)
+  ,_txBytes(0)
+  ,_rxMillis(0)
+  ,_txMillis(0)
+  ,_shownRx(0)
+  ,_shownTx(0)
+  ,_shownRxActive(false)
+  ,_shownTxActive(false)
+{
+  _event[0] = 0;
+}
+
+void StatusView::begin(Adafruit_SSD1306 *display)
+{
+  _display = display;
+  invalidate();
+}
+
+void StatusView::setClients(uint8_t telnet, uint8_t web)
+{
+  if (telnet != _telnetClients || web != _webClients)
+  {
+    _telnetClients = telnet;
+    _webClients = web;
+    _changed = true;
+  }
+}
+
+void StatusView::setIP(const IPAddress &ip)
+{
+  if ((uint32_t)ip != _ip)
+  {
+    _ip = (uint32_t)ip;
+    _changed = true;
+  }
+}
+
+void StatusView::setBaud(uint32_t baud)
+{
+  if (baud != _baud)
+  {
+    _baud = baud;
+    _changed = true;
+  }
+}
+
+void StatusView::event(const char *text, const IPAddress &ip)
+{
+  snprintf(_event, sizeof(_event), "%s%s", text, ip.toString().c_str());
+  _changed = true;
+}
+
+void StatusView::setSummary(uint32_t dropped, uint32_t loop_max_us, uint32_t heap, uint8_t frag)
+{
+  //heap is shown in 100 byte steps so it does not redraw every frame
+  heap = heap / 100 * 100;
+  if (dropped != _dropped || loop_max_us != _loopMaxMicros || heap != _heap || frag != _frag)
+  {
+    _dropped = dropped;
+    _loopMaxMicros = loop_max_us;
+    _heap = heap;
+    _frag = frag;
+    _changed = true;
+  }
+}
+
+void StatusView::service()
+{
+  if (_display == NULL)
+  {
+    return;
+  }
+  if (_display->displayBusy())
+  {
+    _display->displayService(); //one I2C transmission per loop() pass
+    return;
+  }
+  if (!frameDue())
+  {
+    return;
+  }
+  uint32_t ms = millis();
+  uint32_t rx = _rxBytes, tx = _txBytes;
+  bool rx_active = ms - _rxMillis < STATUS_VIEW_ACTIVITY_MS && rx != 0;
+  bool tx_active = ms - _txMillis < STATUS_VIEW_ACTIVITY_MS && tx != 0;
+  if (!_changed && rx == _shownRx && tx == _shownTx &&
+      rx_active == _shownRxActive && tx_active == _shownTxActive)
+  {
+    return;
+  }
+  _shownRx = rx;
+  _shownTx = tx;
+  _shownRxActive = rx_active;
+  _shownTxActive = tx_active;
+  _changed = false;
+  _lastFrame = ms;
+  _frames++;
+  draw(rx_active, tx_active);
+}
+
+void StatusView::draw(bool rx_active, bool tx_active)
+{
+  char lines[STATUS_VIEW_LINES][STATUS_VIEW_COLS + 1];
+  memset(lines, 0, sizeof(lines));
+  snprintf(lines[0], sizeof(lines[0]), "IP %s", IPAddress(_ip).toString().c_str());
+  snprintf(lines[1], sizeof(lines[1]), "Baud %u", (unsigned)_baud);
+  snprintf(lines[2], sizeof(lines[2]), "Telnet %u  Web %u", _telnetClients, _webClients);
+  snprintf(lines[3], sizeof(lines[3]), "%c RX %u", rx_active ? '>' : ' ', (unsigned)_shownRx);
+  snprintf(lines[4], sizeof(lines[4]), "%c TX %u", tx_active ? '<' : ' ', (unsigned)_shownTx);
+  snprintf(lines[5], sizeof(lines[5]), "%s", _event);
+  snprintf(lines[6], sizeof(lines[6]), "Drop %u Loop %ums", (unsigned)_dropped, (unsigned)(_loopMaxMicros / 1000));
+  snprintf(lines[7], sizeof(lines[7]), "Heap %u Frag %u%%", (unsigned)_heap, _frag);
+
+  Adafruit_SSD1306 &d = *_display;
+  if (_fullRedraw)
+  {
+    d.clearDisplay();
+    memset(_shownText, ' ', sizeof(_shownText));
+    _fullRedraw = false;
+  }
+  for (uint8_t row = 0; row < STATUS_VIEW_LINES; row++)
+  {
+    bool ended = false;
+    for (uint8_t col = 0; col < STATUS_VIEW_COLS; col++)
+    {
+      if (lines[row][col] == 0) ended = true;
+      char c = ended ? ' ' : lines[row][col];
+      if (c != _shownText[row][col])
+      {
+        //opaque cell, overwrites the old glyph without a clear
+        d.drawChar(col * 6, row * 8, c, SSD1306_WHITE, SSD1306_BLACK, 1);
+        _shownText[row][col] = c;
+      }
+    }
+  }
+  d.startDisplay(); //dirty cells only, sent in slices by the next service() calls
+}
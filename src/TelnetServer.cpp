@@ -0,0 +1,476 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+
+#include "TelnetServer.h"
+
+//Options we perform (WILL) and accept from the client (DO)
+#define TELNET_LOCAL_OPTIONS  (OptionBit(TELNET_OPT_BINARY) | OptionBit(TELNET_OPT_ECHO) | OptionBit(TELNET_OPT_SGA))
+#define TELNET_REMOTE_OPTIONS (OptionBit(TELNET_OPT_BINARY) | OptionBit(TELNET_OPT_SGA) | OptionBit(TELNET_OPT_NAWS))
+//Output is escaped through a stack buffer of this size
+#define TELNET_ESCAPE_CHUNK 256
+
+static uint8_t OptionBit(uint8_t option)
+{
+  switch (option)
+  {
+    case TELNET_OPT_BINARY: return 0x01;
+    case TELNET_OPT_ECHO:   return 0x02;
+    case TELNET_OPT_SGA:    return 0x04;
+    case TELNET_OPT_NAWS:   return 0x08;
+    default:                return 0;
+  }
+}
+
+TelnetServer::TelnetServer(uint16_t port)
+  :_server(port)
+  ,_onInput(NULL)
+  ,_onConnect(NULL)
+  ,_bytesSent(0)
+  ,_droppedBytes(0)
+{
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    _slots[i].client = NULL;
+  }
+}
+
+void TelnetServer::begin()
+{
+  _server.onClient([](void *arg, AsyncClient *client)
+  {
+    ((TelnetServer*)arg)->accept(client);
+  }, this);
+  _server.setNoDelay(true);
+  _server.begin();
+}
+
+void TelnetServer::accept(AsyncClient *client)
+{
+  if (client == NULL)
+  {
+    return;
+  }
+  Slot *slot = find(NULL);
+  if (slot == NULL)
+  {
+    //no free spot, reject
+    client->close(true);
+    client->free();
+    delete client;
+    return;
+  }
+  slot->client = client;
+  slot->queue.clear();
+  slot->state = TS_DATA;
+  slot->crPending = false;
+  slot->sbLen = 0;
+  slot->local = slot->remote = 0;
+  slot->cols = slot->rows = 0;
+  client->setNoDelay(true);
+  client->onData([](void *arg, AsyncClient *c, void *data, size_t len)
+  {
+    TelnetServer *server = (TelnetServer*)arg;
+    Slot *slot = server->find(c);
+    if (slot) server->input(*slot, (const uint8_t*)data, len);
+  }, this);
+  //the window opened up, or as a fallback every poll interval
+  client->onAck([](void *arg, AsyncClient *c, size_t len, uint32_t time)
+  {
+    (void)len;
+    (void)time;
+    TelnetServer *server = (TelnetServer*)arg;
+    Slot *slot = server->find(c);
+    if (slot) server->flush(*slot);
+  }, this);
+  client->onPoll([](void *arg, AsyncClient *c)
+  {
+    TelnetServer *server = (TelnetServer*)arg;
+    Slot *slot = server->find(c);
+    if (slot) server->flush(*slot);
+  }, this);
+  client->onDisconnect([](void *arg, AsyncClient *c)
+  {
+    ((TelnetServer*)arg)->disconnect(c);
+    delete c;
+  }, this);
+  //the target echoes and runs its own line editing, so the client should
+  //send character at a time without local echo
+  static const uint8_t offer[] =
+  {
+    TELNET_IAC, TELNET_WILL, TELNET_OPT_ECHO,
+    TELNET_IAC, TELNET_WILL, TELNET_OPT_SGA,
+    TELNET_IAC, TELNET_WILL, TELNET_OPT_BINARY,
+    TELNET_IAC, TELNET_DO, TELNET_OPT_BINARY,
+    TELNET_IAC, TELNET_DO, TELNET_OPT_NAWS,
+  };
+  slot->localPending = OptionBit(TELNET_OPT_ECHO) | OptionBit(TELNET_OPT_SGA) | OptionBit(TELNET_OPT_BINARY);
+  slot->remotePending = OptionBit(TELNET_OPT_BINARY) | OptionBit(TELNET_OPT_NAWS);
+  send(*slot, offer, sizeof(offer));
+  if (_onConnect)
+  {
+    _onConnect(client->remoteIP());
+  }
+}
+
+void TelnetServer::disconnect(AsyncClient *client)
+{
+  Slot *slot = find(client);
+  if (slot)
+  {
+    slot->client = NULL;
+    slot->queue.clear();
+  }
+}
+
+TelnetServer::Slot *TelnetServer::find(AsyncClient *client)
+{
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    if (_slots[i].client == client)
+    {
+      return &_slots[i];
+    }
+  }
+  return NULL;
+}
+
+//Moves queued bytes into the send window, at most two runs out of the ring
+void TelnetServer::flush(Slot &slot)
+{
+  bool added = false;
+  while (!slot.queue.isEmpty())
+  {
+    size_t room = slot.client->space();
+    CircularBuffer<uint8_t,TELNET_TX_QUEUE_SIZE>::index_t n;
+    const uint8_t *run = slot.queue.span(0, n);
+    if (n > room) n = room;
+    if (n == 0) break;
+    n = slot.client->add((const char*)run, n, ASYNC_WRITE_FLAG_COPY);
+    if (n == 0) break;
+    slot.queue.shift(NULL, n);
+    _bytesSent += n;
+    added = true;
+  }
+  if (added)
+  {
+    slot.client->send();
+  }
+}
+
+//Adds to the send window what fits, queues the rest. A write that does not
+//fit is dropped whole: queued bytes are never overwritten and a command or
+//a doubled 0xFF never reaches the client cut in half.
+void TelnetServer::send(Slot &slot, const uint8_t *data, size_t len)
+{
+  size_t room = slot.queue.available();
+  if (slot.queue.isEmpty())
+  {
+    room += slot.client->space();
+  }
+  if (len > room)
+  {
+    _droppedBytes += len;
+    return;
+  }
+  if (slot.queue.isEmpty())
+  {
+    //copied, the caller's buffer is not kept until the ack
+    size_t n = slot.client->space();
+    if (n > len) n = len;
+    if (n > 0)
+    {
+      n = slot.client->add((const char*)data, n, ASYNC_WRITE_FLAG_COPY);
+      if (n > 0)
+      {
+        slot.client->send();
+        _bytesSent += n;
+        data += n;
+        len -= n;
+      }
+    }
+  }
+  slot.queue.push(data, len);
+}
+
+void TelnetServer::writeRaw(const uint8_t *data, size_t len)
+{
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    Slot &slot = _slots[i];
+    if (slot.client != NULL && slot.client->connected())
+    {
+      send(slot, data, len);
+    }
+  }
+}
+
+//Doubles every 0xFF. Runs without one go out as they are, the rest is
+//copied in runs into a stack buffer with the IAC pairs appended; a pair is
+//never split over two writes, so dropping one cannot leave half of it.
+void TelnetServer::write(const uint8_t *data, size_t len)
+{
+  if (memchr(data, TELNET_IAC, len) == NULL)
+  {
+    writeRaw(data, len);
+    return;
+  }
+  uint8_t escaped[TELNET_ESCAPE_CHUNK];
+  size_t n = 0;
+  while (len > 0)
+  {
+    const uint8_t *iac = (const uint8_t*)memchr(data, TELNET_IAC, len);
+    size_t run = iac ? (size_t)(iac - data) : len; //up to the IAC
+    len -= run;
+    while (run > 0)
+    {
+      size_t m = sizeof(escaped) - n;
+      if (m > run) m = run;
+      memcpy(escaped + n, data, m);
+      n += m;
+      data += m;
+      run -= m;
+      if (n == sizeof(escaped))
+      {
+        writeRaw(escaped, n);
+        n = 0;
+      }
+    }
+    if (iac)
+    {
+      if (n + 2 > sizeof(escaped))
+      {
+        writeRaw(escaped, n);
+        n = 0;
+      }
+      escaped[n++] = TELNET_IAC;
+      escaped[n++] = TELNET_IAC;
+      data++;
+      len--;
+    }
+  }
+  if (n > 0)
+  {
+    writeRaw(escaped, n);
+  }
+}
+
+void TelnetServer::command(Slot &slot, uint8_t verb, uint8_t option)
+{
+  uint8_t cmd[3] = { TELNET_IAC, verb, option };
+  send(slot, cmd, sizeof(cmd));
+}
+
+//Client input as it arrives. Plain data between IACs is handed on in one
+//piece, only the command bytes go through the state machine.
+void TelnetServer::input(Slot &slot, const uint8_t *data, size_t len)
+{
+  const uint8_t *end = data + len;
+  while (data < end)
+  {
+    if (slot.state == TS_DATA)
+    {
+      const uint8_t *iac = (const uint8_t*)memchr(data, TELNET_IAC, end - data);
+      const uint8_t *stop = iac ? iac : end;
+      deliver(slot, data, stop - data);
+      data = stop;
+      if (iac)
+      {
+        slot.state = TS_IAC;
+        data++;
+      }
+      continue;
+    }
+    uint8_t c = *data++;
+    switch (slot.state)
+    {
+      case TS_IAC:
+        slot.state = TS_DATA;
+        if (c == TELNET_IAC)
+        {
+          deliver(slot, &c, 1); //escaped 0xFF
+        }
+        else if (c >= TELNET_WILL && c <= TELNET_DONT)
+        {
+          slot.verb = c;
+          slot.state = TS_OPTION;
+        }
+        else if (c == TELNET_SB)
+        {
+          slot.sbLen = 0;
+          slot.sbOption = 0xFF;
+          slot.state = TS_SB;
+        }
+        else if (c == TELNET_IP)
+        {
+          uint8_t intr = 0x03; //interrupt process, what Ctrl-C is on the target
+          deliver(slot, &intr, 1);
+        }
+        //NOP, GA, AYT and the rest are dropped
+        break;
+      case TS_OPTION:
+        slot.state = TS_DATA;
+        negotiate(slot, slot.verb, c);
+        break;
+      case TS_SB:
+        if (c == TELNET_IAC)
+        {
+          slot.state = TS_SB_IAC;
+        }
+        else if (slot.sbOption == 0xFF)
+        {
+          slot.sbOption = c;
+        }
+        else if (slot.sbLen < sizeof(slot.sb))
+        {
+          slot.sb[slot.sbLen++] = c;
+        }
+        break;
+      case TS_SB_IAC:
+        if (c == TELNET_SE)
+        {
+          subnegotiation(slot);
+          slot.state = TS_DATA;
+        }
+        else
+        {
+          //IAC IAC is a 0xFF in the payload, anything else is malformed and
+          //is taken as data the same way
+          slot.state = TS_SB;
+          if (slot.sbLen < sizeof(slot.sb))
+          {
+            slot.sb[slot.sbLen++] = c;
+          }
+        }
+        break;
+    }
+  }
+}
+
+//Passes data on to the handler. Outside binary mode the client pads a bare
+//CR with NUL (RFC 854), the NUL is not meant for the target.
+void TelnetServer::deliver(Slot &slot, const uint8_t *data, size_t len)
+{
+  bool binary = slot.remote & OptionBit(TELNET_OPT_BINARY);
+  while (len > 0)
+  {
+    const uint8_t *nul = binary ? NULL : (const uint8_t*)memchr(data, 0, len);
+    size_t n = nul ? (size_t)(nul - data) : len;
+    bool padding = nul && (n > 0 ? data[n - 1] == '\r' : slot.crPending);
+    size_t out = nul && !padding ? n + 1 : n;
+    if (out > 0)
+    {
+      slot.crPending = data[out - 1] == '\r';
+      if (_onInput) _onInput(data, out);
+    }
+    if (padding)
+    {
+      slot.crPending = false;
+    }
+    n = nul ? n + 1 : n;
+    data += n;
+    len -= n;
+  }
+}
+
+//RFC 855 negotiation with loop prevention: requests for a state the option
+//is already in are not answered, and the reply to our own request is only
+//taken as an acknowledgement.
+void TelnetServer::negotiate(Slot &slot, uint8_t verb, uint8_t option)
+{
+  uint8_t bit = OptionBit(option);
+  bool enable = verb == TELNET_WILL || verb == TELNET_DO;
+  bool ours = verb == TELNET_DO || verb == TELNET_DONT; //about what we do
+  uint8_t &state = ours ? slot.local : slot.remote;
+  uint8_t &pending = ours ? slot.localPending : slot.remotePending;
+  bool supported = bit & (ours ? TELNET_LOCAL_OPTIONS : TELNET_REMOTE_OPTIONS);
+  uint8_t yes = ours ? TELNET_WILL : TELNET_DO;
+  uint8_t no = ours ? TELNET_WONT : TELNET_DONT;
+
+  if (pending & bit)
+  {
+    pending &= ~bit;
+    if (enable) state |= bit; else state &= ~bit;
+    return;
+  }
+  if (enable && !supported)
+  {
+    command(slot, no, option);
+  }
+  else if (enable && !(state & bit))
+  {
+    state |= bit;
+    command(slot, yes, option);
+  }
+  else if (!enable && (state & bit))
+  {
+    state &= ~bit;
+    command(slot, no, option);
+  }
+}
+
+void TelnetServer::subnegotiation(Slot &slot)
+{
+  if (slot.sbOption == TELNET_OPT_NAWS && slot.sbLen == 4)
+  {
+    slot.cols = (slot.sb[0] << 8) | slot.sb[1];
+    slot.rows = (slot.sb[2] << 8) | slot.sb[3];
+  }
+}
+
+bool TelnetServer::windowSize(uint8_t i, uint16_t &cols, uint16_t &rows) const
+{
+  if (i >= TELNET_MAX_CLIENTS || _slots[i].client == NULL || _slots[i].cols == 0)
+  {
+    return false;
+  }
+  cols = _slots[i].cols;
+  rows = _slots[i].rows;
+  return true;
+}
+
+uint8_t TelnetServer::count() const
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    if (_slots[i].client != NULL && _slots[i].client->connected())
+    {
+      n++;
+    }
+  }
+  return n;
+}
+
+size_t TelnetServer::queueRoom() const
+{
+  size_t room = TELNET_TX_QUEUE_SIZE;
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    if (_slots[i].client != NULL && _slots[i].client->connected() && _slots[i].queue.available() < room)
+    {
+      room = _slots[i].queue.available();
+    }
+  }
+  return room;
+}
@@ -0,0 +1,184 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include "TxPacer.h"
+
+TxPacer::TxPacer(Stream &port)
+  :_port(port)
+  ,_charMicros(UART_TX_CHAR_DELAY_US)
+  ,_lineMillis(UART_TX_LINE_DELAY_MS)
+  ,_flow(FLOW_NONE)
+  ,_ctsPin(-1)
+  ,_xoff(false)
+  ,_waiting(false)
+  ,_resumeMicros(0)
+  ,_overflow(false)
+  ,_bytesWritten(0)
+  ,_droppedBytes(0)
+  ,_xoffs(0)
+{
+}
+
+void TxPacer::setPacing(uint16_t char_us, uint16_t line_ms)
+{
+  _charMicros = char_us;
+  _lineMillis = line_ms;
+  _waiting = false;
+}
+
+void TxPacer::setFlow(Flow flow, int8_t cts_pin)
+{
+  if (flow == FLOW_CTS && cts_pin < 0)
+  {
+    flow = FLOW_NONE;
+  }
+  _flow = flow;
+  _ctsPin = cts_pin;
+  _xoff = false;
+  if (_flow == FLOW_CTS)
+  {
+    pinMode(_ctsPin, INPUT_PULLUP); //unplugged reads as "stop"
+  }
+}
+
+size_t TxPacer::push(const uint8_t *data, size_t len)
+{
+  //after an overflow nothing is taken until the queue ran empty, so a paste
+  //that does not fit loses its tail and not pieces in the middle
+  size_t room = _overflow ? 0 : _queue.available();
+  if (len > room)
+  {
+    _droppedBytes += len - room;
+    _overflow = true;
+    len = room;
+  }
+  _queue.push(data, len);
+  return len;
+}
+
+bool TxPacer::held() const
+{
+  if (_flow == FLOW_XONXOFF)
+  {
+    return _xoff;
+  }
+  if (_flow == FLOW_CTS)
+  {
+    return digitalRead(_ctsPin) == HIGH;
+  }
+  return false;
+}
+
+bool TxPacer::ready() const
+{
+  if (_queue.isEmpty() || held())
+  {
+    return false;
+  }
+  if (_waiting && (int32_t)(micros() - _resumeMicros) < 0)
+  {
+    return false;
+  }
+  return _port.availableForWrite() > 0;
+}
+
+void TxPacer::wait(uint32_t us)
+{
+  _waiting = true;
+  _resumeMicros = micros() + us;
+}
+
+void TxPacer::service()
+{
+  if (!ready())
+  {
+    return;
+  }
+  _waiting = false;
+  size_t room = _port.availableForWrite();
+  while (room > 0 && !_queue.isEmpty())
+  {
+    CircularBuffer<uint8_t,UART_TX_QUEUE_SIZE>::index_t n;
+    const uint8_t *run = _queue.span(0, n);
+    if (n > room) n = room;
+    if (_charMicros > 0)
+    {
+      n = 1;
+    }
+    else if (_lineMillis > 0)
+    {
+      //up to and including the next line end
+      for (CircularBuffer<uint8_t,UART_TX_QUEUE_SIZE>::index_t i = 0; i < n; i++)
+      {
+        if (run[i] == '\r' || run[i] == '\n')
+        {
+          n = i + 1;
+          break;
+        }
+      }
+    }
+    n = _port.write(run, n);
+    if (n == 0) break;
+    bool eol = run[n - 1] == '\r' || run[n - 1] == '\n';
+    _queue.shift(NULL, n);
+    _bytesWritten += n;
+    room -= n;
+    if (_lineMillis > 0 && eol)
+    {
+      wait((uint32_t)_lineMillis * 1000);
+      break;
+    }
+    if (_charMicros > 0)
+    {
+      wait(_charMicros);
+      break;
+    }
+  }
+  if (_queue.isEmpty())
+  {
+    _overflow = false;
+  }
+}
+
+//The last flow control byte of a chunk decides
+void TxPacer::onRx(const uint8_t *data, size_t len)
+{
+  if (_flow != FLOW_XONXOFF)
+  {
+    return;
+  }
+  for (size_t i = len; i > 0; i--)
+  {
+    if (data[i - 1] == TX_XOFF)
+    {
+      _xoff = true;
+      _xoffs++;
+      return;
+    }
+    if (data[i - 1] == TX_XON)
+    {
+      _xoff = false;
+      return;
+    }
+  }
+}
@@ -42,12 +42,18 @@
 #include <SPI.h>
 #include <SD.h>
 #include <CircularBuffer.h>
+#include "ScreenModel.h"
+#include "SdLogWriter.h"
+#include "StatusView.h"
+#include "Scheduler.h"
+#include "TelnetServer.h"
+#include "TxPacer.h"
+#include "RxBatcher.h"
 
-CircularBuffer<uint8_t,2000> cached_screen_bytes; //A typical telnet screen is 80*25=2000
+ScreenModel screen; //terminal state of the target, repainted to new web clients
 
 const int chipSelect = D8;
-File record_file;
-int record_file_opened = 0; //try once only at setup()
+SdLogWriter record_log; //opened once only at setup()
 File root;
 
 #define STATUS_LED  2
@@ -60,9 +66,49 @@ EasyLed led(STATUS_LED, EasyLed::ActiveLevel::Low, EasyLed::State::On);  //Use t
 // Declaration for an SSD1306 display connected to I2C (SDA, SCL pins)
 #define OLED_RESET     -1 // Reset pin # (or -1 if sharing Arduino reset pin)
 #define SCREEN_ADDRESS 0x3C ///< See datasheet for Address; 0x3D for 128x64, 0x3C for 128x32
-#define MAX_SRV_CLIENTS 5
-WiFiServer telnet_server(23);
-WiFiClient serverClients[MAX_SRV_CLIENTS];
+TelnetServer telnet(23);
+
+//What to do when a telnet client's send queue (TELNET_TX_QUEUE_SIZE) is full
+#define TELNET_POLICY_DROP_NEWEST   0 //keep reading UART, slow clients lose what does not fit
+#define TELNET_POLICY_PAUSE_READING 1 //stop reading UART until the slowest client catches up
+#define TELNET_BACKPRESSURE_POLICY TELNET_POLICY_DROP_NEWEST
+
+//UART RX ring of the core serial driver: filled from the UART interrupt and
+//drained in bulk by CheckSerialData(), it has to hold whatever arrives while
+//loop() is stalled (WiFi reconnect, card, display). 4KB is ~350ms at 115200.
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 4096
+#endif
+
+//Client input on its way to the target, paced and flow controlled as set
+//with the /pace request (see TxPacer.h). UART0's own RTS/CTS pins are taken
+//by the SD card, so a CTS line from the target goes to a spare GPIO set
+//here, -1 when not wired.
+#ifndef UART_TX_CTS_PIN
+#define UART_TX_CTS_PIN -1
+#endif
+TxPacer uart_tx(Serial);
+
+//UART reads, coalesced into batches for the fan-out
+RxBatcher uart_rx(Serial);
+#define SERIAL_BATCH_HIST_SIZE    10 //bucket k counts batches of 2^k..2^(k+1)-1 bytes
+uint32_t serial_batches = 0;
+uint32_t serial_batch_bytes = 0;
+uint32_t serial_batch_max = 0;
+uint32_t serial_batch_hist[SERIAL_BATCH_HIST_SIZE];
+
+//Bridge instrumentation, served as JSON on /stats and summarized on the OLED.
+//UART RX bytes are serial_batch_bytes, SD bytes come from record_log.
+#define LOOP_HIST_SIZE 16 //bucket k counts loop() passes of 2^k..2^(k+1)-1 us
+struct BridgeStats
+{
+  uint32_t rx_alloc_failures; //no heap for a UART chunk, retried later
+  uint32_t ws_bytes;          //queued to WebSocket clients, per client
+  uint32_t loops;
+  uint32_t loop_max_us;
+  uint32_t loop_hist[LOOP_HIST_SIZE];
+} bridge_stats;
+
 AsyncWebServer web(80);
 AsyncWebSocket ws("/ws");
 
@@ -71,8 +117,21 @@ int flashing_ip = 0;
 time_t last_active_time = 0;
 int has_active = 0;
 
+//LED blinks driven by the scheduler, EasyLed::flash() waits in delay()
+uint16_t led_toggles_left = 0;
+uint16_t led_on_ms = 0;
+uint16_t led_off_ms = 0;
+uint32_t led_next_toggle = 0;
+
+Scheduler scheduler; //runs the loop() tasks that have work, sleeps otherwise
+
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+StatusView status_view; //drawn by loop() at a bounded frame rate, the data path only updates it
 void BaseConfig();
+void BlinkLed(uint16_t count, uint16_t on_ms, uint16_t off_ms);
+void initScheduler();
+void HandleTelnetConnect(const IPAddress &ip);
+void HandleTelnetInput(const uint8_t *data, size_t len);
 
 struct EMPTY_SERIAL
 {
@@ -87,13 +146,36 @@ struct EMPTY_SERIAL
 #define Serial_debug  _EMPTY_SERIAL
 //#define Serial_debug  Serial
 
-void WriteSDFileRecord(uint8_t *buf, size_t len)
+//Only buffers, the card is written from loop() by record_log.service()
+//type is SD_REC_RX for target output, SD_REC_TX for input sent to it
+void WriteSDFileRecord(uint8_t type, const uint8_t *buf, size_t len)
+{
+  record_log.record(type, buf, len);
+}
+
+//Moves queued input into the UART TX FIFO as the pacing allows, never waits
+void DrainUartTx()
+{
+  uart_tx.service();
+}
+
+bool UartTxReady()
+{
+  return uart_tx.ready();
+}
+
+//Input from any client, logged and counted once per batch and queued for
+//the UART; the tail of a batch that does not fit is dropped
+void SendToUart(const uint8_t *data, size_t len)
 {
-  if (record_file_opened == 1)
+  //only what the queue took is logged and counted, uart_tx counts the rest
+  len = uart_tx.push(data, len);
+  if (len > 0)
   {
-    record_file.write(buf, len);
-    record_file.flush();
+    WriteSDFileRecord(SD_REC_TX, data, len);
+    status_view.onTx(len);
   }
+  DrainUartTx();
 }
 
 
@@ -269,15 +351,209 @@ void BaseConfig()
   display.print("WiFi connected.\nIP:");
   display.print(WiFi.localIP());
   display.display();
+  status_view.invalidate();
 }
 
 //WebSocket functions
+//What is left of a repaint when the console writes to the model is copied
+//into one of these blocks, a longer rest is cut. At least SCREEN_RENDER_MIN.
+#ifndef SCREEN_REPAINT_REST_SIZE
+#define SCREEN_REPAINT_REST_SIZE 1024
+#endif
+#ifndef SCREEN_REPAINT_RESTS
+#define SCREEN_REPAINT_RESTS 2
+#endif
+
+//Sends a new client the history plus a repaint of the current screen. The
+//model is rendered straight into the TCP send window, a frame at a time as it
+//opens up, with no heap buffer. The console must not write to the model
+//while a render is under way, so FanOutSerialChunk() first calls
+//DetachAll(), which renders what is left of any repaint still going out into
+//a pool block: at most SCREEN_REPAINT_REST_SIZE bytes, rendered once. The
+//client is then sent the screen as it was when it connected, followed by the
+//new output from the broadcast queued behind this message. A rest that does
+//not fit, or finds the pool empty, is cut and counted in truncated().
+class ScreenRepaintMessage: public AsyncWebSocketMessage
+{
+  private:
+    static AsyncWebPool<SCREEN_REPAINT_REST_SIZE, SCREEN_REPAINT_RESTS> _restPool;
+    static uint32_t _truncated;
+    static ScreenRepaintMessage *_live; //still rendering from the model
+    ScreenRepaintMessage *_next;
+    ScreenModel::RenderPos _pos;
+    bool _detached;
+    uint8_t *_rest; //what was left to render when detached
+    size_t _restLen;
+    size_t _restSent;
+    size_t _ack;
+    size_t _acked;
+    bool _started;
+    bool _done;
+
+    void unlink()
+    {
+      ScreenRepaintMessage **link = &_live;
+      while (*link != NULL && *link != this)
+      {
+        link = &(*link)->_next;
+      }
+      if (*link != NULL)
+      {
+        *link = _next;
+      }
+    }
+
+    void detach()
+    {
+      unlink();
+      _detached = true;
+      _rest = (uint8_t *)_restPool.alloc();
+      size_t n;
+      while (_rest != NULL &&
+             (n = screen.render(_pos, _rest + _restLen, SCREEN_REPAINT_REST_SIZE - _restLen)) > 0)
+      {
+        _restLen += n;
+      }
+      if (_pos.phase != ScreenModel::RENDER_DONE)
+      {
+        _truncated++; //the repaint ends early, the client sees part of the screen
+      }
+    }
+
+    //Next frame payload, final once nothing is left after it
+    size_t next(uint8_t *piece, size_t max, uint8_t **data, bool *final)
+    {
+      size_t n;
+      if (_detached)
+      {
+        n = _restLen - _restSent;
+        if (n > max) n = max;
+        *data = _rest + _restSent;
+        _restSent += n;
+        *final = (_restSent == _restLen);
+        return n;
+      }
+      n = screen.render(_pos, piece, max);
+      *data = piece;
+      *final = (_pos.phase == ScreenModel::RENDER_DONE);
+      return n;
+    }
+
+  public:
+    ScreenRepaintMessage()
+      :_detached(false)
+      ,_rest(NULL)
+      ,_restLen(0)
+      ,_restSent(0)
+      ,_ack(0)
+      ,_acked(0)
+      ,_started(false)
+      ,_done(false)
+    {
+      _opcode = WS_BINARY;
+      _mask = false;
+      _status = WS_MSG_SENDING;
+      screen.renderBegin(_pos);
+      _next = _live;
+      _live = this;
+    }
+    virtual ~ScreenRepaintMessage() override
+    {
+      unlink();
+      if (_rest != NULL)
+      {
+        _restPool.free(_rest);
+      }
+    }
+    static void DetachAll()
+    {
+      while (_live != NULL)
+      {
+        _live->detach();
+      }
+    }
+    static uint32_t truncated() { return _truncated; }
+    static AsyncWebPoolStats restPoolStats() { return _restPool.stats(); }
+    virtual bool betweenFrames() const override { return _acked == _ack; }
+    virtual bool sentAll() const override { return _done; }
+    virtual size_t ack(size_t len, uint32_t time) override
+    {
+      (void)time;
+      size_t extra = 0;
+      if (len > _ack - _acked)
+      {
+        extra = len - (_ack - _acked);
+        len -= extra;
+      }
+      _acked += len;
+      if (_done && _acked >= _ack)
+      {
+        _status = WS_MSG_SENT;
+      }
+      return extra;
+    }
+    virtual size_t send(AsyncClient *client) override
+    {
+      size_t sent = add(client);
+      if (sent)
+      {
+        client->send();
+      }
+      return sent;
+    }
+    //fills the window with frames of up to 256 bytes, the piece buffer is on
+    //the stack of the async callback
+    virtual size_t add(AsyncClient *client) override
+    {
+      if (_status != WS_MSG_SENDING || _acked < _ack)
+      {
+        return 0;
+      }
+      if (_done)
+      {
+        _status = WS_MSG_SENT;
+        return 0;
+      }
+      uint8_t piece[256];
+      size_t added = 0;
+      size_t window;
+      while (!_done && (window = webSocketSendFrameWindow(client)) >= SCREEN_RENDER_MIN)
+      {
+        uint8_t *data;
+        bool final;
+        size_t n = next(piece, window < sizeof(piece) ? window : sizeof(piece), &data, &final);
+        if (n == 0 && !_started)
+        {
+          //detached with nothing sent and nothing kept, no frame needed
+          _done = true;
+          _status = WS_MSG_SENT;
+          break;
+        }
+        if (webSocketAddFrame(client, final, _started ? (uint8_t)WS_CONTINUATION : _opcode, false, data, n) != n)
+        {
+          _status = WS_MSG_ERROR;
+          break;
+        }
+        _started = true;
+        _done = final;
+        _ack += n + ((n < 126) ? 2 : 4);
+        added += n;
+      }
+      return added;
+    }
+};
+AsyncWebPool<SCREEN_REPAINT_REST_SIZE, SCREEN_REPAINT_RESTS> ScreenRepaintMessage::_restPool;
+uint32_t ScreenRepaintMessage::_truncated = 0;
+ScreenRepaintMessage *ScreenRepaintMessage::_live = NULL;
+
 void handleWebSocketMessage(void *arg, uint8_t *data, size_t len)
 {
   AwsFrameInfo *info = (AwsFrameInfo*)arg;
-  if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)
+  //keystrokes need no reassembly, every piece of a text message goes straight
+  //out, so a paste bigger than one frame or one inflated window arrives whole
+  if (info->message_opcode == WS_TEXT)
   {
-    Serial.write(data, len);
+    SendToUart(data, len);
   }
 }
 
@@ -289,16 +565,8 @@ void onEvent(AsyncWebSocket *server1, AsyncWebSocketClient *client, AwsEventType
     case WS_EVT_CONNECT:
       has_active = 1;
       last_active_time = now();
-      {
-        //CircularBuffer<uint8_t,2000> cached_screen_bytes; 
-        uint8_t buf[cached_screen_bytes.size()];
-        CircularBuffer<uint8_t,2000>::index_t i;
-        for (i = 0; i < cached_screen_bytes.size(); i++)
-        {
-          buf[i] = cached_screen_bytes[i];
-        }
-        client->binary(buf, cached_screen_bytes.size());
-      }
+      client->message(new ScreenRepaintMessage());
+      status_view.event("Web client: ", client->remoteIP());
       
       Serial_debug.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
       break;
@@ -314,9 +582,155 @@ void onEvent(AsyncWebSocket *server1, AsyncWebSocketClient *client, AwsEventType
   }
 }
 
+//Instrumentation ------------------------------------------------------------
+//Every byte a sink lost: telnet queue overwrites, SD records that did not fit,
+//WebSocket messages refused by a full client queue, input the UART queue
+//could not take
+uint32_t TotalDroppedBytes()
+{
+  return telnet.droppedBytes() + record_log.bytesDropped() + ws.droppedBytes() +
+         uart_tx.droppedBytes();
+}
+
+void AddPoolStats(JsonObject &parent, const char *name, const AsyncWebPoolStats &stats)
+{
+  JsonObject pool = parent.createNestedObject(name);
+  pool["size"] = stats.size;
+  pool["used"] = stats.used;
+  pool["peak"] = stats.peak;
+  pool["misses"] = stats.misses;
+}
+
+const char *FlowName(TxPacer::Flow flow)
+{
+  switch (flow)
+  {
+    case TxPacer::FLOW_XONXOFF: return "xonxoff";
+    case TxPacer::FLOW_CTS:     return "cts";
+    default:                    return "none";
+  }
+}
+
+void SendStats(AsyncWebServerRequest *request)
+{
+  DynamicJsonDocument doc(3072);
+  doc["uptime_ms"] = millis();
+
+  JsonObject uart = doc.createNestedObject("uart");
+  uart["rx_bytes"] = serial_batch_bytes;
+  uart["tx_bytes"] = uart_tx.bytesWritten();
+  uart["tx_queued"] = uart_tx.queued();
+  uart["tx_dropped"] = uart_tx.droppedBytes();
+  uart["tx_held"] = uart_tx.held();
+  uart["tx_xoffs"] = uart_tx.xoffs();
+  JsonObject pace = uart.createNestedObject("pace");
+  pace["char_us"] = uart_tx.charDelay();
+  pace["line_ms"] = uart_tx.lineDelay();
+  pace["flow"] = FlowName(uart_tx.flow());
+  uart["overruns"] = uart_rx.overruns(); //overflows seen, not bytes lost
+  uart["alloc_failures"] = bridge_stats.rx_alloc_failures;
+  uart["batches"] = serial_batches;
+  uart["batch_max"] = serial_batch_max;
+  JsonArray batch_hist = uart.createNestedArray("batch_hist");
+  for (uint8_t i = 0; i < SERIAL_BATCH_HIST_SIZE; i++)
+  {
+    batch_hist.add(serial_batch_hist[i]);
+  }
+
+  JsonObject websocket = doc.createNestedObject("ws");
+  websocket["clients"] = ws.count();
+  websocket["bytes"] = bridge_stats.ws_bytes;
+  websocket["dropped_messages"] = ws.droppedMessages();
+  websocket["dropped_bytes"] = ws.droppedBytes();
+  websocket["repaints_truncated"] = ScreenRepaintMessage::truncated();
+  JsonArray queues = websocket.createNestedArray("queues");
+  for (const auto &c : ws.getClients())
+  {
+    JsonObject queue = queues.createNestedObject();
+    queue["id"] = c->id();
+    queue["messages"] = c->queueLength();
+    queue["bytes"] = c->queuedBytes();
+    queue["deflate"] = c->deflate();
+  }
+  const AsyncWebDeflateStats &deflate_stats = ws.deflateStats();
+  JsonObject deflate = websocket.createNestedObject("deflate");
+  deflate["messages"] = deflate_stats.messages;
+  deflate["skipped"] = deflate_stats.skipped;
+  deflate["bytes_in"] = deflate_stats.bytesIn;
+  deflate["bytes_out"] = deflate_stats.bytesOut;
+  deflate["us"] = deflate_stats.micros;
+  deflate["inflated"] = deflate_stats.inflated;
+  deflate["inflate_busy"] = deflate_stats.inflateBusy;
+  JsonObject pools = websocket.createNestedObject("pools");
+  AddPoolStats(pools, "buffers", AsyncWebSocket::bufferPoolStats());
+  AddPoolStats(pools, "data", AsyncWebSocket::dataPoolStats());
+  AddPoolStats(pools, "messages", AsyncWebSocket::messagePoolStats());
+  AddPoolStats(pools, "repaint", ScreenRepaintMessage::restPoolStats());
+
+  JsonObject tn = doc.createNestedObject("telnet");
+  tn["clients"] = telnet.count();
+  tn["bytes"] = telnet.bytesSent();
+  tn["dropped_bytes"] = telnet.droppedBytes();
+  JsonArray windows = tn.createNestedArray("windows");
+  for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    uint16_t cols, rows;
+    if (telnet.windowSize(i, cols, rows))
+    {
+      JsonArray size = windows.createNestedArray();
+      size.add(cols);
+      size.add(rows);
+    }
+  }
+
+  JsonObject sd = doc.createNestedObject("sd");
+  sd["open"] = record_log.isOpen();
+  sd["bytes"] = record_log.bytesWritten();
+  sd["dropped_bytes"] = record_log.bytesDropped();
+  sd["dropped_records"] = record_log.recordsDropped();
+  sd["buffered"] = record_log.buffered();
+  sd["flushes"] = record_log.flushes();
+  sd["rotations"] = record_log.rotations();
+  sd["segment"] = record_log.segment();
+  sd["service_max_us"] = record_log.maxServiceMicros();
+
+  JsonObject lp = doc.createNestedObject("loop");
+  lp["count"] = bridge_stats.loops;
+  lp["max_us"] = bridge_stats.loop_max_us;
+  JsonArray loop_hist = lp.createNestedArray("hist");
+  for (uint8_t i = 0; i < LOOP_HIST_SIZE; i++)
+  {
+    loop_hist.add(bridge_stats.loop_hist[i]);
+  }
+
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["free"] = ESP.getFreeHeap();
+  heap["max_block"] = ESP.getMaxFreeBlockSize();
+  heap["fragmentation"] = ESP.getHeapFragmentation();
+
+  doc["oled_frames"] = status_view.frames();
+
+  JsonObject sched = doc.createNestedObject("sched");
+  sched["idle_pct"] = scheduler.idlePercent();
+  sched["busy_passes"] = scheduler.busyPasses();
+  sched["idle_passes"] = scheduler.idlePasses();
+  JsonObject tasks = sched.createNestedObject("tasks");
+  for (uint8_t i = 0; i < scheduler.count(); i++)
+  {
+    JsonObject task = tasks.createNestedObject(scheduler.name(i));
+    task["runs"] = scheduler.runs(i);
+    task["max_us"] = scheduler.maxMicros(i);
+  }
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
 void initWebSocket()
 {
   ws.onEvent(onEvent);
+  ws.enableDeflate(true);
   web.addHandler(&ws);
 }
 
@@ -380,7 +794,7 @@ void printDirectory(File dir, int numTabs)
 void setup()
 {
   led.off();
-  Serial.setRxBufferSize(1024);
+  Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
   Serial.begin(115200);
   Serial_debug.begin(115200);
 
@@ -389,6 +803,8 @@ void setup()
   initFS();
 
   ConnectWifi(); //This may loop forever if wifi is not connected
+  status_view.begin(&display);
+  status_view.setBaud(115200);
 
   initWebSocket();
 
@@ -408,17 +824,61 @@ void setup()
       inputMessage = request->getParam("v")->value();
       rate = inputMessage.toInt();
       Serial_debug.end();
-      Serial.setRxBufferSize(1024);
+      Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
       Serial.begin(rate);
+      status_view.setBaud(rate);
     }
     request->send(200, "text/plain", "OK");
   });
 
+  // <ESP_IP>/pace?char_us=<n>&line_ms=<n>&flow=none|xonxoff|cts, omitted
+  // parameters keep their value
+  web.on("/pace", HTTP_GET, [] (AsyncWebServerRequest * request)
+  {
+    uint16_t char_us = uart_tx.charDelay();
+    uint16_t line_ms = uart_tx.lineDelay();
+    if (request->hasParam("char_us"))
+    {
+      char_us = request->getParam("char_us")->value().toInt();
+    }
+    if (request->hasParam("line_ms"))
+    {
+      line_ms = request->getParam("line_ms")->value().toInt();
+    }
+    uart_tx.setPacing(char_us, line_ms);
+    if (request->hasParam("flow"))
+    {
+      String flow = request->getParam("flow")->value();
+      if (flow == "xonxoff")
+      {
+        uart_tx.setFlow(TxPacer::FLOW_XONXOFF);
+      }
+      else if (flow == "cts" && UART_TX_CTS_PIN >= 0)
+      {
+        uart_tx.setFlow(TxPacer::FLOW_CTS, UART_TX_CTS_PIN);
+      }
+      else if (flow == "none")
+      {
+        uart_tx.setFlow(TxPacer::FLOW_NONE);
+      }
+      else
+      {
+        request->send(400, "text/plain", "Bad flow");
+        return;
+      }
+    }
+    request->send(200, "text/plain", "OK");
+  });
+
+  web.on("/stats", HTTP_GET, SendStats);
+
   web.serveStatic("/", SPIFFS, "/");
   web.begin();
 
-  telnet_server.begin();
-  telnet_server.setNoDelay(true);
+  telnet.onInput(HandleTelnetInput);
+  telnet.onConnect(HandleTelnetConnect);
+  telnet.begin();
+  initScheduler();
 
 
   Serial_debug.println("Server started");
@@ -437,14 +897,8 @@ void setup()
     root.rewindDirectory();
     //printDirectory(root, 0); //Display the card contents
     root.close();
-    record_file = SD.open("esp_ttl_log.txt", FILE_WRITE);
-    if (record_file) record_file_opened = 1;
-    //if (record_file) record_file.print("esp_ttl_log");
-    //WriteSDFileRecord((uint8_t *)"abc", 3);
-    //record_file.close();
-    char szTemp[64];
-    sprintf(szTemp, "system started.\r\n");
-    WriteSDFileRecord((uint8_t* )szTemp, strlen(szTemp));
+    //framed binary log in TTLnnnnn.BIN segments, see SdLogWriter.h
+    record_log.begin();
   }
 
  
@@ -453,126 +907,160 @@ void setup()
 
 //loop calls ----------------------------------------------------------------------------
 
-//AcceptTelnetClients
-void AcceptTelnetClients()
+//Telnet callbacks, run from the TCP stack between loop() passes
+void HandleTelnetConnect(const IPAddress &ip)
 {
-  // Check if there are any new clients ---------
-  uint8_t i;
-  if (telnet_server.hasClient())
-  {
-    display.clearDisplay();
-    display.setCursor(0, 0);
-    for (i = 0; i < MAX_SRV_CLIENTS; i++)
-    {
-      //find free/disconnected spot
-      if (!serverClients[i] || !serverClients[i].connected())
-      {
-        if (serverClients[i])
-        {
-          serverClients[i].stop();
-        }
-        serverClients[i] = telnet_server.available();
-        //Serial1.print("New client: "); Serial1.print(i);
-        if (serverClients[i].connected())
-        {
-          display.print("New client: ");
-          display.print(serverClients[i].remoteIP());
-          display.display();
-          has_active = 1;
-          last_active_time = now();
-        }
+  status_view.event("New client: ", ip);
+  has_active = 1;
+  last_active_time = now();
+}
 
-        continue;
-      }
-    }
-    // No free/disconnected spot so reject
-    WiFiClient serverClient = telnet_server.available();
-    serverClient.stop();
-  }
+//Input from a telnet client, whatever arrived in one TCP segment
+void HandleTelnetInput(const uint8_t *data, size_t len)
+{
+  SendToUart(data, len);
+}
+
+//UART fan-out: each read lands once in a shared, refcounted WebSocket message
+//buffer; local sinks consume it in place and the WebSocket clients take their
+//references last, so the buffer is freed when the last client has acked it.
+void FanOutSerialChunk(AsyncWebSocketMessageBuffer *chunk)
+{
+  uint8_t *data = chunk->get();
+  size_t len = chunk->length();
+
+  telnet.write(data, len); //queued per client, sent as the TCP windows allow
+  WriteSDFileRecord(SD_REC_RX, data, len);
+  ScreenRepaintMessage::DetachAll(); //repaints still going out keep the old screen
+  screen.write(data, len);
+  //hand over to the WebSocket clients, buffer is released once all acked
+  bridge_stats.ws_bytes += len * ws.count();
+  ws.binaryAll(chunk);
 }
 
-void CheckTelnetClientData()
+//Power of two histogram bucket of v, the last bucket takes everything above
+uint8_t Log2Bucket(uint32_t v, uint8_t buckets)
 {
-  unsigned char last_char = 0;
-  uint8_t i;
-  // check clients for data ------------------------
-  for (i = 0; i < MAX_SRV_CLIENTS; i++)
+  uint8_t bucket = 0;
+  while ((v >>= 1) != 0 && bucket < buckets - 1)
   {
-    if (serverClients[i] && serverClients[i].connected())
-    {
-      if (serverClients[i].available())
-      {
-        //get data from the telnet client and push it to the UART
-        while (serverClients[i].available())
-        {
-          last_char = serverClients[i].read();
-          Serial.write(last_char);
-          display.print("<");
-          display.display();
-        }
-      }
-    }
+    bucket++;
   }
+  return bucket;
+}
+
+void RecordSerialBatch(size_t len)
+{
+  serial_batches++;
+  serial_batch_bytes += len;
+  if (len > serial_batch_max) serial_batch_max = len;
+  serial_batch_hist[Log2Bucket(len, SERIAL_BATCH_HIST_SIZE)]++;
+}
+
+void RecordLoopTime(uint32_t us)
+{
+  bridge_stats.loops++;
+  if (us > bridge_stats.loop_max_us) bridge_stats.loop_max_us = us;
+  bridge_stats.loop_hist[Log2Bucket(us, LOOP_HIST_SIZE)]++;
 }
 
 void CheckSerialData()
 {
-  uint32_t i;
   // check UART for data --------------------------
-  if (Serial.available())
+  size_t room = SERIAL_COALESCE_MAX_BYTES;
+#if TELNET_BACKPRESSURE_POLICY == TELNET_POLICY_PAUSE_READING
+  room = telnet.queueRoom(); //the rest stays in the UART RX buffer
+#endif
+  size_t len = uart_rx.poll(room);
+  if (len == 0)
   {
-    size_t len = Serial.available();
-    uint8_t sbuf[len];
-    Serial.readBytes(sbuf, len);
-    if (len > 0)
-    {
-      ws.binaryAll(sbuf, len);
-      display.print(">");
-      display.display();
-      led.flash(2, 20, 20, 0, 0);
-      last_active_time = now();
-      has_active = 1;
-      //push UART data to all connected telnet clients
-      for (i = 0; i < MAX_SRV_CLIENTS; i++)
-      {
-        if (serverClients[i] && serverClients[i].connected()) {
-          serverClients[i].write(sbuf, len);
-          delay(1);
-        }
-      }
-      WriteSDFileRecord(sbuf, len);
-      for (i = 0; i < len; i++)
-      {
-        cached_screen_bytes.push(sbuf[i]);
-      }
-    }
+    return;
+  }
+  AsyncWebSocketMessageBuffer *chunk = ws.makeBuffer(len);
+  if (chunk == NULL || chunk->get() == NULL)
+  {
+    bridge_stats.rx_alloc_failures++;
+    return; //out of memory, leave the bytes in the RX buffer for next loop
+  }
+  uart_rx.read(chunk->get(), len);
+  RecordSerialBatch(len);
+  uart_tx.onRx(chunk->get(), len);
+  status_view.onRx(len);
+  BlinkLed(2, 20, 20);
+  last_active_time = now();
+  has_active = 1;
+  FanOutSerialChunk(chunk);
+}
 
-    
+//Refreshes the polled parts of the status view when a frame is due and
+//keeps its display transfer going
+void UpdateStatusView()
+{
+  if (status_view.frameDue())
+  {
+    status_view.setClients(telnet.count(), ws.count());
+    status_view.setIP(WiFi.localIP());
+    status_view.setSummary(TotalDroppedBytes(), bridge_stats.loop_max_us,
+                           ESP.getFreeHeap(), ESP.getHeapFragmentation());
   }
+  status_view.service();
 }
 
-void loop(void)
+//Starts count off-blinks of the LED, ignored while a pattern is running
+void BlinkLed(uint16_t count, uint16_t on_ms, uint16_t off_ms)
 {
-  WiFiWatchDog();
-  AcceptTelnetClients();
+  if (led_toggles_left > 0)
+  {
+    return;
+  }
+  led_toggles_left = count * 2;
+  led_on_ms = on_ms;
+  led_off_ms = off_ms;
+  led_next_toggle = millis();
+}
 
+bool LedReady()
+{
+  return led_toggles_left > 0 && (int32_t)(millis() - led_next_toggle) >= 0;
+}
+
+void ServiceLed()
+{
+  led.toggle();
+  led_toggles_left--;
+  led_next_toggle = millis() + (led.isOn() ? led_on_ms : led_off_ms);
+}
 
+void CheckIdleIpFlash()
+{
   if (has_active == 0 && (now() - last_active_time > 60)) //no active after 1min
   {
     if (flashing_ip == 0)
     {
       IPAddress ip = WiFi.localIP();
-      led.flash(ip[3], 300, 100, 0, 0); //255*600ms， we need at least 153000ms, 153s to finish
+      BlinkLed(ip[3], 300, 100); //255*400ms, about 100s, the bridge keeps running meanwhile
       flashing_ip = 1;
     }
   }
-  CheckTelnetClientData();
-  CheckSerialData();
+}
 
-  if (display.getCursorY() >= 64)
+//Readiness checks of the scheduler tasks, all cheap polls
+void initScheduler()
+{
+  scheduler.add("wifi", NULL, [] { WiFiWatchDog(); }, 1000);
+  scheduler.add("idle_ip", NULL, CheckIdleIpFlash, 1000);
+  scheduler.add("uart_rx", [] { return uart_rx.ready(); }, CheckSerialData);
+  scheduler.add("uart_tx", UartTxReady, DrainUartTx);
+  scheduler.add("sd", [] { return record_log.serviceDue(); }, [] { record_log.service(); });
+  scheduler.add("oled", [] { return status_view.busy(); }, UpdateStatusView, STATUS_VIEW_FRAME_MS);
+  scheduler.add("led", LedReady, ServiceLed);
+}
+
+void loop(void)
+{
+  uint32_t loop_start = micros();
+  if (scheduler.runOnce() > 0)
   {
-    display.clearDisplay();
-    display.setCursor(0, 0);
-    display.display();
+    RecordLoopTime(micros() - loop_start); //idle passes only sleep
   }
 }
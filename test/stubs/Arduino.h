@@ -0,0 +1,91 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+//Stand-in for the parts of the ESP8266 Arduino core the bridge classes use,
+//for the native env. Time is simulated: it only moves when a test, delay()
+//or one of the device stubs advances it, so runs are repeatable and the
+//benchmarks report modelled device time, not host time.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+class __FlashStringHelper;
+#define F(s) (s)
+
+#define LOW          0
+#define HIGH         1
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+struct HostClock
+{
+  static inline uint64_t micros = 0;
+
+  static void set(uint64_t us) { micros = us; }
+  static void advance(uint64_t us) { micros += us; }
+  static void reset() { micros = 0; }
+};
+
+//Input levels seen by digitalRead(), outputs land here too
+struct HostPins
+{
+  static inline uint8_t level[32] = {};
+};
+
+inline uint32_t micros() { return (uint32_t)HostClock::micros; }
+inline uint32_t millis() { return (uint32_t)(HostClock::micros / 1000); }
+inline void delay(uint32_t ms) { HostClock::advance((uint64_t)ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { HostClock::advance(us); }
+inline void yield() {}
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (mode == INPUT_PULLUP && pin < 32) HostPins::level[pin] = HIGH;
+}
+inline int digitalRead(uint8_t pin) { return pin < 32 ? HostPins::level[pin] : LOW; }
+inline void digitalWrite(uint8_t pin, uint8_t val) { if (pin < 32) HostPins::level[pin] = val; }
+
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "IPAddress.h"
+
+#endif
@@ -0,0 +1,212 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_ESPASYNCTCP_H_
+#define HOST_ESPASYNCTCP_H_
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+//TCP connection with the send side of lwIP modelled: add() copies into a
+//send buffer of `window` bytes, send() puts what was added on the wire as
+//MSS sized segments, and the test plays the peer with ack(), receive()
+//(onData) and disconnect() (onDisconnect, whose handler may delete the
+//client). As in ESPAsyncTCP, canSend() is false from send() until
+//everything in flight is acked, and only that last ack runs the onAck
+//handler, with all bytes acked since.
+class AsyncClient
+{
+  public:
+    //lwIP on the ESP8266: TCP_MSS 1460, TCP_SND_BUF 2 * TCP_MSS
+    size_t window = 2920;
+    size_t mss = 1460;
+    //what reached the peer, only kept with keepData
+    bool keepData = true;
+    std::string received;
+    //stats
+    uint32_t sends = 0;
+    uint32_t segments = 0;
+    uint64_t bytesSent = 0;
+
+    AsyncClient() {}
+    virtual ~AsyncClient() {}
+
+    bool connected() const { return _connected; }
+    bool canSend() const { return !_busy && space() > 0; }
+    size_t space() const { return _connected ? window - _inFlight - _added : 0; }
+
+    size_t add(const char *data, size_t len, uint8_t /*flags*/ = ASYNC_WRITE_FLAG_COPY)
+    {
+      size_t n = len < space() ? len : space();
+      if (keepData) _pending.append(data, n);
+      _added += n;
+      return n;
+    }
+    bool send()
+    {
+      if (_added == 0 || !_connected) return false;
+      sends++;
+      segments += (_added + mss - 1) / mss;
+      bytesSent += _added;
+      if (keepData) received += _pending;
+      _pending.clear();
+      _inFlight += _added;
+      _added = 0;
+      _busy = true;
+      return true;
+    }
+    size_t write(const char *data, size_t len)
+    {
+      size_t n = add(data, len);
+      send();
+      return n;
+    }
+
+    void setNoDelay(bool) {}
+    void setRxTimeout(uint32_t) {}
+    //received data is always acked
+    void ackLater() {}
+    void close(bool /*now*/ = false) { _connected = false; }
+    void free() {}
+    IPAddress remoteIP() const { return _ip; }
+    uint16_t remotePort() const { return 50000; }
+
+    void onData(AcDataHandler handler, void *arg = NULL) { _onData = handler; _dataArg = arg; }
+    void onAck(AcAckHandler handler, void *arg = NULL) { _onAck = handler; _ackArg = arg; }
+    void onPoll(AcConnectHandler handler, void *arg = NULL) { _onPoll = handler; _pollArg = arg; }
+    void onDisconnect(AcConnectHandler handler, void *arg = NULL) { _onDisconnect = handler; _disconnectArg = arg; }
+    void onError(AcErrorHandler, void * = NULL) {}
+    void onTimeout(AcTimeoutHandler, void * = NULL) {}
+
+    //Peer side, called by tests
+    size_t inFlight() const { return _inFlight; }
+    void setRemoteIP(const IPAddress &ip) { _ip = ip; }
+    size_t ack(size_t len = (size_t)-1)
+    {
+      if (len > _inFlight) len = _inFlight;
+      if (len == 0) return 0;
+      _inFlight -= len;
+      _acked += len;
+      if (_inFlight == 0)
+      {
+        size_t acked = _acked;
+        _acked = 0;
+        _busy = false;
+        if (_onAck) _onAck(_ackArg, this, acked, 0);
+      }
+      return len;
+    }
+    void receive(const void *data, size_t len)
+    {
+      if (_onData) _onData(_dataArg, this, (void*)data, len);
+    }
+    void poll()
+    {
+      if (_onPoll) _onPoll(_pollArg, this);
+    }
+    //Last call on the client, the handler usually deletes it
+    void disconnect()
+    {
+      _connected = false;
+      if (_onDisconnect) _onDisconnect(_disconnectArg, this);
+    }
+
+  private:
+    bool _connected = true;
+    bool _busy = false;
+    size_t _added = 0;
+    size_t _inFlight = 0;
+    size_t _acked = 0;
+    std::string _pending;
+    IPAddress _ip;
+    AcDataHandler _onData;
+    void *_dataArg = NULL;
+    AcAckHandler _onAck;
+    void *_ackArg = NULL;
+    AcConnectHandler _onPoll;
+    void *_pollArg = NULL;
+    AcConnectHandler _onDisconnect;
+    void *_disconnectArg = NULL;
+};
+
+//Listening socket, tests hand it connections with accept()
+class AsyncServer
+{
+  public:
+    AsyncServer(uint16_t port) : _port(port) {}
+    ~AsyncServer()
+    {
+      for (AsyncServer *&s : _listening)
+      {
+        if (s == this) s = NULL;
+      }
+    }
+
+    void onClient(AcConnectHandler handler, void *arg) { _onClient = handler; _arg = arg; }
+    void setNoDelay(bool) {}
+    void begin()
+    {
+      for (AsyncServer *&s : _listening)
+      {
+        if (s == NULL || s->_port == _port)
+        {
+          s = this;
+          return;
+        }
+      }
+    }
+
+    //Peer side: a new connection to the server listening on port
+    static bool accept(uint16_t port, AsyncClient *client)
+    {
+      for (AsyncServer *s : _listening)
+      {
+        if (s != NULL && s->_port == port && s->_onClient)
+        {
+          s->_onClient(s->_arg, client);
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    static inline AsyncServer *_listening[4] = {};
+    uint16_t _port;
+    AcConnectHandler _onClient;
+    void *_arg = NULL;
+};
+
+#endif
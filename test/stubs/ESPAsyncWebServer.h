@@ -0,0 +1,182 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_ESPASYNCWEBSERVER_H_
+#define HOST_ESPASYNCWEBSERVER_H_
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <ESPAsyncTCP.h>
+#include "StringArray.h"
+
+//The request and response side of ESPAsyncWebServer as far as
+//AsyncWebSocket uses it, so the WebSocket code builds on the host without
+//the HTTP server. A request is a client connection plus the headers a test
+//sets; responses handed to send() are only counted.
+
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+typedef enum {
+  HTTP_GET     = 0b00000001,
+  HTTP_POST    = 0b00000010,
+  HTTP_ANY     = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+typedef enum { RCT_NOT_USED = -1, RCT_DEFAULT = 0, RCT_HTTP, RCT_WS, RCT_EVENT, RCT_MAX } RequestedConnectionType;
+
+typedef enum {
+  RESPONSE_SETUP, RESPONSE_HEADERS, RESPONSE_CONTENT, RESPONSE_WAIT_ACK, RESPONSE_END, RESPONSE_FAILED
+} WebResponseState;
+
+typedef std::function<bool(AsyncWebServerRequest *request)> ArRequestFilterFunction;
+
+class AsyncWebHeader
+{
+  public:
+    AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+
+  private:
+    String _name;
+    String _value;
+};
+
+class AsyncWebServerResponse
+{
+  public:
+    AsyncWebServerResponse()
+      : _code(0), _contentLength(0), _sendContentLength(true), _chunked(false),
+        _headLength(0), _sentLength(0), _ackedLength(0), _writtenLength(0), _state(RESPONSE_SETUP) {}
+    virtual ~AsyncWebServerResponse() {}
+    virtual void setCode(int code) { _code = code; }
+    virtual void addHeader(const String &name, const String &value) { _head += name + ": " + value + "\r\n"; }
+    virtual String _assembleHead(uint8_t version)
+    {
+      String out = String("HTTP/1.") + String(version) + " " + String(_code) + "\r\n" + _head + "\r\n";
+      _headLength = out.length();
+      return out;
+    }
+    virtual bool _started() const { return _state > RESPONSE_SETUP; }
+    virtual bool _finished() const { return _state > RESPONSE_WAIT_ACK; }
+    virtual bool _failed() const { return _state == RESPONSE_FAILED; }
+    virtual bool _sourceValid() const { return false; }
+    virtual void _respond(AsyncWebServerRequest *) { _state = RESPONSE_END; }
+    virtual size_t _ack(AsyncWebServerRequest *, size_t, uint32_t) { return 0; }
+
+  protected:
+    int _code;
+    String _head;
+    size_t _contentLength;
+    bool _sendContentLength;
+    bool _chunked;
+    size_t _headLength;
+    size_t _sentLength;
+    size_t _ackedLength;
+    size_t _writtenLength;
+    WebResponseState _state;
+};
+
+class AsyncWebServerRequest
+{
+  public:
+    //status of the last response sent, 0 for none
+    int sentCode = 0;
+
+    AsyncWebServerRequest(AsyncClient *client, const String &url = "/ws")
+      : _client(client), _url(url) {}
+    ~AsyncWebServerRequest()
+    {
+      for (auto &h : _headers) delete h.second;
+    }
+
+    //Test side
+    void setHeader(const String &name, const String &value)
+    {
+      delete _headers[name];
+      _headers[name] = new AsyncWebHeader(name, value);
+    }
+
+    AsyncClient *client() { return _client; }
+    uint8_t version() const { return 1; }
+    WebRequestMethodComposite method() const { return HTTP_GET; }
+    const String &url() const { return _url; }
+    bool isExpectedRequestedConnType(RequestedConnectionType erct1, RequestedConnectionType = RCT_NOT_USED,
+                                     RequestedConnectionType = RCT_NOT_USED) { return erct1 == RCT_WS; }
+    void addInterestingHeader(const String &) {}
+    bool hasHeader(const String &name) const { return _headers.count(name) > 0; }
+    AsyncWebHeader *getHeader(const String &name) const
+    {
+      auto it = _headers.find(name);
+      return it == _headers.end() ? NULL : it->second;
+    }
+    bool authenticate(const char *, const char *, const char * = NULL, bool = false) { return true; }
+    void requestAuthentication(const char * = NULL, bool = true) { sentCode = 401; }
+    AsyncWebServerResponse *beginResponse(int code, const String & = String(), const String & = String())
+    {
+      AsyncWebServerResponse *response = new AsyncWebServerResponse();
+      response->setCode(code);
+      return response;
+    }
+    void send(AsyncWebServerResponse *response)
+    {
+      response->_respond(this);
+      delete response;
+    }
+    void send(int code, const String & = String(), const String & = String()) { sentCode = code; }
+
+  private:
+    AsyncClient *_client;
+    String _url;
+    std::map<std::string, AsyncWebHeader*> _headers;
+};
+
+class AsyncWebHandler
+{
+  public:
+    AsyncWebHandler() : _username(""), _password("") {}
+    virtual ~AsyncWebHandler() {}
+    AsyncWebHandler &setFilter(ArRequestFilterFunction fn) { _filter = fn; return *this; }
+    AsyncWebHandler &setAuthentication(const char *username, const char *password)
+    {
+      _username = String(username);
+      _password = String(password);
+      return *this;
+    }
+    bool filter(AsyncWebServerRequest *request) { return _filter == NULL || _filter(request); }
+    virtual bool canHandle(AsyncWebServerRequest *) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest *) {}
+    virtual void handleUpload(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool) {}
+    virtual void handleBody(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t) {}
+    virtual bool isRequestHandlerTrivial() { return true; }
+
+  protected:
+    ArRequestFilterFunction _filter;
+    String _username;
+    String _password;
+};
+
+#endif
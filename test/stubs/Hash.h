@@ -0,0 +1,74 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_HASH_H_
+#define HOST_HASH_H_
+
+#include <Arduino.h>
+
+//SHA-1 of the ESP8266 core's Hash library, used for the WebSocket accept key
+inline void sha1(const uint8_t *data, uint32_t size, uint8_t hash[20])
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  uint64_t bits = (uint64_t)size * 8;
+  uint32_t total = ((size + 8) / 64 + 1) * 64;
+  for (uint32_t block = 0; block < total; block += 64)
+  {
+    uint32_t w[80];
+    for (int i = 0; i < 64; i++)
+    {
+      uint32_t at = block + i;
+      uint8_t b = at < size ? data[at] : at == size ? 0x80 : at >= total - 8 ? (uint8_t)(bits >> ((total - 1 - at) * 8)) : 0;
+      if (i % 4 == 0) w[i / 4] = 0;
+      w[i / 4] |= (uint32_t)b << ((3 - i % 4) * 8);
+    }
+    for (int i = 16; i < 80; i++)
+    {
+      uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+      w[i] = (x << 1) | (x >> 31);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++)
+    {
+      uint32_t f, k;
+      if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+      uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+      e = d; d = c; c = (b << 30) | (b >> 2); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+  for (int i = 0; i < 20; i++)
+  {
+    hash[i] = (uint8_t)(h[i / 4] >> ((3 - i % 4) * 8));
+  }
+}
+
+inline void sha1(const String &data, uint8_t hash[20])
+{
+  sha1((const uint8_t*)data.c_str(), data.length(), hash);
+}
+
+#endif
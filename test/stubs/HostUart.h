@@ -0,0 +1,170 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_UART_H_
+#define HOST_UART_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//UART model for the native env. Written bytes wait in a TX FIFO of `fifo`
+//bytes and leave it one frame (10 bits) at a time at `baud`, in HostClock
+//time; what left is appended to `wire` with the time it went into the FIFO
+//and the time it was fully sent.
+//The RX side works like the core's uart.c: feed() plays the UART interrupt
+//and may run on another thread, readers hold the ring's lock the way the
+//core masks the interrupt. The ring keeps size - 1 bytes; when it is full
+//the oldest byte is discarded, hasOverrun() reports that once and
+//overruns counts the bytes lost.
+class HostUart : public HardwareSerial
+{
+  public:
+    uint32_t baud;
+    size_t fifo;
+    //TX side
+    std::string wire;
+    std::vector<uint64_t> queuedAt;
+    std::vector<uint64_t> sentAt;
+    //RX side
+    std::atomic<uint32_t> overruns{0};
+
+    HostUart(uint32_t baud = 115200, size_t fifo = 128) : baud(baud), fifo(fifo), _rx(256) {}
+
+    uint64_t frameNanos() const { return 10000000000ULL / baud; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *data, size_t len) override
+    {
+      update();
+      if (len > fifo - _tx.size()) len = fifo - _tx.size();
+      uint64_t now = HostClock::micros * 1000;
+      for (size_t i = 0; i < len; i++)
+      {
+        uint64_t start = _lastDone > now ? _lastDone : now;
+        _lastDone = start + frameNanos();
+        _tx.push_back({ data[i], now, _lastDone });
+      }
+      return len;
+    }
+    int availableForWrite() override
+    {
+      update();
+      return fifo - _tx.size();
+    }
+    //Advances HostClock until the FIFO is empty
+    void drain()
+    {
+      if (_lastDone > HostClock::micros * 1000)
+      {
+        HostClock::set((_lastDone + 999) / 1000);
+      }
+      update();
+    }
+
+    //Core default 256
+    void setRxBufferSize(size_t size)
+    {
+      std::lock_guard<std::mutex> lock(_rxLock);
+      _rx.assign(size, 0);
+      _rpos = _wpos = 0;
+    }
+    bool hasOverrun() override
+    {
+      return _rxOverrun.exchange(false);
+    }
+
+    void feed(const uint8_t *data, size_t len)
+    {
+      std::lock_guard<std::mutex> lock(_rxLock);
+      for (size_t i = 0; i < len; i++)
+      {
+        size_t next = (_wpos + 1) % _rx.size();
+        if (next == _rpos)
+        {
+          _rxOverrun = true;
+          overruns++;
+          _rpos = (_rpos + 1) % _rx.size(); //discard oldest
+        }
+        _rx[_wpos] = data[i];
+        _wpos = next;
+      }
+    }
+    int available() override
+    {
+      std::lock_guard<std::mutex> lock(_rxLock);
+      return (_wpos + _rx.size() - _rpos) % _rx.size();
+    }
+    int read() override
+    {
+      uint8_t c;
+      return readBytes(&c, 1) == 1 ? c : -1;
+    }
+    int peek() override
+    {
+      std::lock_guard<std::mutex> lock(_rxLock);
+      return _rpos == _wpos ? -1 : _rx[_rpos];
+    }
+    //Bulk copy out of the ring, as HardwareSerial::readBytes() does
+    size_t readBytes(uint8_t *buffer, size_t length) override
+    {
+      std::lock_guard<std::mutex> lock(_rxLock);
+      size_t n = 0;
+      while (n < length && _rpos != _wpos)
+      {
+        buffer[n++] = _rx[_rpos];
+        _rpos = (_rpos + 1) % _rx.size();
+      }
+      return n;
+    }
+
+  private:
+    struct Frame
+    {
+      uint8_t c;
+      uint64_t queued, done;  //ns
+    };
+    std::deque<Frame> _tx;
+    uint64_t _lastDone = 0;
+    std::mutex _rxLock;
+    std::vector<uint8_t> _rx;
+    size_t _rpos = 0, _wpos = 0;
+    std::atomic<bool> _rxOverrun{false};
+
+    void update()
+    {
+      uint64_t now = HostClock::micros * 1000;
+      while (!_tx.empty() && _tx.front().done <= now)
+      {
+        wire += (char)_tx.front().c;
+        queuedAt.push_back(_tx.front().queued / 1000);
+        sentAt.push_back(_tx.front().done / 1000);
+        _tx.pop_front();
+      }
+    }
+};
+
+#endif
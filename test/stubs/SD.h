@@ -0,0 +1,163 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_SD_H_
+#define HOST_SD_H_
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+#include <dirent.h>
+#include <unistd.h>
+
+#define FILE_READ  0
+#define FILE_WRITE 1
+
+//Card model: the card root is a host directory, and every operation charges
+//its modelled duration to HostClock, so a writer's loop stall and
+//throughput can be measured. Defaults are those of a common class 4 card
+//on the ESP8266's 20MHz SPI bus: 400ns a byte, 300us per write call, a
+//FAT and directory update on sync, open and remove.
+struct HostCard
+{
+  static inline std::string root;
+  static inline uint32_t byteNanos = 400;
+  static inline uint32_t writeMicros = 300;
+  static inline uint32_t syncMicros = 6000;
+  static inline uint32_t openMicros = 8000;
+  static inline uint32_t removeMicros = 8000;
+  //stats and fault injection
+  static inline uint32_t writes = 0;
+  static inline uint32_t syncs = 0;
+  static inline uint32_t maxOpMicros = 0;
+  static inline bool failWrites = false;
+
+  static void charge(uint32_t us)
+  {
+    HostClock::advance(us);
+    if (us > maxOpMicros) maxOpMicros = us;
+  }
+  static std::string path(const char *name)
+  {
+    return root + (name[0] == '/' ? "" : "/") + name;
+  }
+  static void resetStats()
+  {
+    writes = syncs = maxOpMicros = 0;
+  }
+};
+
+class File
+{
+  public:
+    File() {}
+    File(FILE *f, const char *name) : _f(f, fclose), _name(BaseName(name)) {}
+    File(DIR *d, const char *name) : _d(d, closedir), _name(BaseName(name)) {}
+
+    explicit operator bool() const { return _f || _d; }
+    const char *name() const { return _name.c_str(); }
+    bool isDirectory() const { return (bool)_d; }
+
+    size_t write(const uint8_t *data, size_t len)
+    {
+      if (!_f || HostCard::failWrites) return 0;
+      HostCard::charge(HostCard::writeMicros + (uint32_t)((uint64_t)len * HostCard::byteNanos / 1000));
+      HostCard::writes++;
+      return fwrite(data, 1, len, _f.get());
+    }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    int read(uint8_t *data, size_t len) { return _f ? (int)fread(data, 1, len, _f.get()) : -1; }
+    void flush()
+    {
+      if (!_f) return;
+      HostCard::charge(HostCard::syncMicros);
+      HostCard::syncs++;
+      fflush(_f.get());
+    }
+    uint32_t size() const
+    {
+      if (!_f) return 0;
+      long pos = ftell(_f.get());
+      fseek(_f.get(), 0, SEEK_END);
+      long size = ftell(_f.get());
+      fseek(_f.get(), pos, SEEK_SET);
+      return (uint32_t)size;
+    }
+    void close()
+    {
+      if (_f) fflush(_f.get());
+      _f.reset();
+      _d.reset();
+    }
+
+    File openNextFile()
+    {
+      if (!_d) return File();
+      struct dirent *entry;
+      while ((entry = readdir(_d.get())) != NULL)
+      {
+        if (entry->d_name[0] == '.') continue;
+        FILE *f = fopen(HostCard::path(entry->d_name).c_str(), "rb");
+        if (f) return File(f, entry->d_name);
+      }
+      return File();
+    }
+
+  private:
+    std::shared_ptr<FILE> _f;
+    std::shared_ptr<DIR> _d;
+    std::string _name;
+
+    static const char *BaseName(const char *name)
+    {
+      const char *slash = strrchr(name, '/');
+      return slash ? slash + 1 : name;
+    }
+};
+
+class SDClass
+{
+  public:
+    File open(const char *name, uint8_t mode = FILE_READ)
+    {
+      std::string path = HostCard::path(name);
+      if (strcmp(name, "/") == 0)
+      {
+        DIR *d = opendir(HostCard::root.c_str());
+        return d ? File(d, name) : File();
+      }
+      HostCard::charge(HostCard::openMicros);
+      FILE *f = fopen(path.c_str(), mode == FILE_WRITE ? "ab+" : "rb");
+      return f ? File(f, name) : File();
+    }
+    bool exists(const char *name) { return access(HostCard::path(name).c_str(), F_OK) == 0; }
+    bool remove(const char *name)
+    {
+      HostCard::charge(HostCard::removeMicros);
+      return unlink(HostCard::path(name).c_str()) == 0;
+    }
+};
+
+inline SDClass SD;
+
+#endif
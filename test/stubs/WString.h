@@ -0,0 +1,92 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_WSTRING_H_
+#define HOST_WSTRING_H_
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+//Arduino String on top of std::string, the members the bridge and the
+//WebSocket code use
+class String : public std::string
+{
+  public:
+    using std::string::string;
+    String() {}
+    String(const std::string &s) : std::string(s) {}
+    explicit String(char c) : std::string(1, c) {}
+    explicit String(int value) : std::string(std::to_string(value)) {}
+    explicit String(unsigned int value) : std::string(std::to_string(value)) {}
+    explicit String(long value) : std::string(std::to_string(value)) {}
+    explicit String(unsigned long value) : std::string(std::to_string(value)) {}
+    explicit String(unsigned char value) : std::string(std::to_string(value)) {}
+
+    explicit operator bool() const { return true; }
+
+    bool equals(const String &s) const { return compare(s) == 0; }
+    bool equalsIgnoreCase(const String &s) const
+    {
+      return length() == s.length() && strncasecmp(c_str(), s.c_str(), length()) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+      size_t at = find(c, from);
+      return at == npos ? -1 : (int)at;
+    }
+    int indexOf(const String &s, unsigned int from = 0) const
+    {
+      size_t at = find(s, from);
+      return at == npos ? -1 : (int)at;
+    }
+    String substring(unsigned int from) const
+    {
+      return from < length() ? String(substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const
+    {
+      if (from > to) std::swap(from, to);
+      if (from >= length()) return String();
+      return String(substr(from, to - from));
+    }
+    void trim()
+    {
+      size_t start = find_first_not_of(" \t\r\n");
+      size_t end = find_last_not_of(" \t\r\n");
+      *this = start == npos ? String() : String(substr(start, end - start + 1));
+    }
+    void replace(const String &find, const String &replace)
+    {
+      if (find.empty()) return;
+      for (size_t at = this->find(find); at != npos; at = this->find(find, at + replace.length()))
+      {
+        std::string::replace(at, find.length(), replace);
+      }
+    }
+    long toInt() const { return strtol(c_str(), NULL, 10); }
+    bool concat(const String &s) { append(s); return true; }
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_WIRE_H_
+#define HOST_WIRE_H_
+
+#include <Arduino.h>
+
+//Same transmit buffer as the ESP8266 core
+#define I2C_BUFFER_LENGTH 128
+#define BUFFER_LENGTH I2C_BUFFER_LENGTH
+
+//I2C master with an SSD1306 on the other end. Counts bus bytes (address
+//byte included) and transmissions, charges each transmission's bus time at
+//the current clock to HostClock, and keeps the controller's display RAM as
+//the command and data streams (horizontal addressing) leave it, so tests can
+//compare it with the frame buffer.
+class TwoWire
+{
+  public:
+    uint32_t bytes = 0;
+    uint32_t transmissions = 0;
+    uint32_t maxTransmissionMicros = 0;
+    uint8_t ram[8][128] = {};
+
+    void begin() {}
+    void setClock(uint32_t hz) { _clock = hz; }
+
+    void beginTransmission(uint8_t) { _len = 0; }
+    size_t write(uint8_t data)
+    {
+      if (_len >= sizeof(_tx)) return 0;
+      _tx[_len++] = data;
+      return 1;
+    }
+    size_t write(const uint8_t *data, size_t len)
+    {
+      size_t n = 0;
+      while (n < len && write(data[n])) n++;
+      return n;
+    }
+    uint8_t endTransmission(bool /*stop*/ = true)
+    {
+      //start, address, data bytes and their acks, stop
+      uint32_t bits = 2 + (_len + 1) * 9;
+      uint32_t us = (uint32_t)(((uint64_t)bits * 1000000 + _clock - 1) / _clock);
+      HostClock::advance(us);
+      if (us > maxTransmissionMicros) maxTransmissionMicros = us;
+      bytes += _len + 1;
+      transmissions++;
+      if (_len > 0)
+      {
+        if (_tx[0] == 0x40)
+        {
+          for (size_t i = 1; i < _len; i++) data(_tx[i]);
+        }
+        else
+        {
+          for (size_t i = 1; i < _len; i++) command(_tx[i]);
+        }
+      }
+      return 0;
+    }
+
+    void resetCounters()
+    {
+      bytes = transmissions = maxTransmissionMicros = 0;
+    }
+
+  private:
+    uint32_t _clock = 100000;
+    uint8_t _tx[BUFFER_LENGTH];
+    size_t _len = 0;
+    //controller state
+    uint8_t _cmd = 0, _args = 0, _arg[2] = {};
+    uint8_t _col0 = 0, _col1 = 127, _page0 = 0, _page1 = 7;
+    uint8_t _col = 0, _page = 0;
+
+    void data(uint8_t b)
+    {
+      ram[_page & 7][_col & 127] = b;
+      if (++_col > _col1)
+      {
+        _col = _col0;
+        if (++_page > _page1) _page = _page0;
+      }
+    }
+
+    static uint8_t argCount(uint8_t cmd)
+    {
+      switch (cmd)
+      {
+        case 0x21: case 0x22: case 0xA3: return 2;
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB: return 1;
+        case 0x26: case 0x27: return 6;
+        case 0x29: case 0x2A: return 5;
+        default: return 0;
+      }
+    }
+
+    //Commands keep their state across transmissions, a list may be split
+    void command(uint8_t b)
+    {
+      if (_args == 0)
+      {
+        _cmd = b;
+        _args = argCount(b);
+        return;
+      }
+      uint8_t i = argCount(_cmd) - _args;
+      if (i < 2) _arg[i] = b;
+      if (--_args > 0) return;
+      if (_cmd == 0x21)
+      {
+        _col = _col0 = _arg[0] & 127;
+        _col1 = _arg[1] & 127;
+      }
+      else if (_cmd == 0x22)
+      {
+        _page = _page0 = _arg[0] & 7;
+        _page1 = _arg[1] & 7;
+      }
+    }
+};
+
+inline TwoWire Wire;
+
+#endif
@@ -0,0 +1,82 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#ifndef HOST_CENCODE_H_
+#define HOST_CENCODE_H_
+
+//Base64 encoder with libb64's interface, the state only carries the bytes
+//of an incomplete group between blocks
+typedef struct
+{
+  int count;
+  unsigned char group[3];
+} base64_encodestate;
+
+inline void base64_init_encodestate(base64_encodestate *state)
+{
+  state->count = 0;
+}
+
+inline char base64_encode_value(unsigned char value)
+{
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  return table[value & 63];
+}
+
+inline int base64_encode_block(const char *plaintext_in, int length_in, char *code_out, base64_encodestate *state)
+{
+  int out = 0;
+  for (int i = 0; i < length_in; i++)
+  {
+    state->group[state->count++] = (unsigned char)plaintext_in[i];
+    if (state->count == 3)
+    {
+      unsigned char *g = state->group;
+      code_out[out++] = base64_encode_value(g[0] >> 2);
+      code_out[out++] = base64_encode_value((g[0] << 4) | (g[1] >> 4));
+      code_out[out++] = base64_encode_value((g[1] << 2) | (g[2] >> 6));
+      code_out[out++] = base64_encode_value(g[2]);
+      state->count = 0;
+    }
+  }
+  return out;
+}
+
+inline int base64_encode_blockend(char *code_out, base64_encodestate *state)
+{
+  int out = 0;
+  unsigned char *g = state->group;
+  if (state->count > 0)
+  {
+    unsigned char g1 = state->count > 1 ? g[1] : 0;
+    code_out[out++] = base64_encode_value(g[0] >> 2);
+    code_out[out++] = base64_encode_value((g[0] << 4) | (g1 >> 4));
+    code_out[out++] = state->count > 1 ? base64_encode_value(g1 << 2) : '=';
+    code_out[out++] = '=';
+  }
+  code_out[out] = 0;
+  state->count = 0;
+  return out;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <AsyncWebDeflate.h>
+
+//64 KB of boot log compressed in the chunk sizes the bridge broadcasts, each
+//chunk as its own message the way AsyncWebSocket compresses them. Chunks
+//that do not shrink are sent as they are and count at full size. Times are
+//host time, only good for comparing the chunk sizes with each other.
+#define LOG_BYTES 65536
+
+static AsyncWebDeflater deflater;
+static AsyncWebInflater inflater;
+static std::string inflated;
+
+//Kernel, systemd and shell output with MAC addresses, sizes and timestamps
+static std::string BootLog()
+{
+  std::string log;
+  uint32_t seed = 1;
+  for (int i = 0; log.size() < LOG_BYTES; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    uint32_t r = seed >> 8;
+    char line[160];
+    switch ((seed >> 16) % 5)
+    {
+      case 0: snprintf(line, sizeof(line), "[%8.3f] wlan0: associated with %02x:%02x:1c:3b:%02x:%02x rssi -%u\r\n",
+                       i * 0.013, r & 0xFF, (r >> 8) & 0xFF, (r >> 4) & 0xFF, (r >> 12) & 0xFF, 40 + r % 40); break;
+      case 1: snprintf(line, sizeof(line), "[%8.3f] systemd[1]: Started Session %u of user root.\r\n", i * 0.013, r % 1000); break;
+      case 2: snprintf(line, sizeof(line), "\x1b[0;32m  OK  \x1b[0m] Reached target Network is Online.\r\n"); break;
+      case 3: snprintf(line, sizeof(line), "root@router:~# grep Mem%d /proc/meminfo\r\nMemFree: %u kB\r\n", i % 3, r % 100000); break;
+      default: snprintf(line, sizeof(line), "[%8.3f] usb 1-1: new high-speed USB device number %u using ehci-platform\r\n", i * 0.013, r % 10); break;
+    }
+    log += line;
+  }
+  return log.substr(0, LOG_BYTES);
+}
+
+static void Collect(void *arg, uint8_t *data, size_t len, bool last)
+{
+  (void)arg;
+  (void)last;
+  inflated.append((const char*)data, len);
+}
+
+static void Run(size_t chunk)
+{
+  std::string log = BootLog();
+  static uint8_t out[4096];
+  size_t bytes_out = 0;
+  uint32_t skipped = 0;
+  double deflate_us = 0, inflate_us = 0;
+  for (size_t at = 0; at + chunk <= log.size(); at += chunk)
+  {
+    const uint8_t *in = (const uint8_t*)log.data() + at;
+    auto t0 = std::chrono::steady_clock::now();
+    size_t n = webSocketDeflate(&deflater, in, chunk, out, chunk - 1);
+    deflate_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    if (n == 0)
+    {
+      bytes_out += chunk;
+      skipped++;
+      continue;
+    }
+    bytes_out += n;
+    inflated.clear();
+    t0 = std::chrono::steady_clock::now();
+    webSocketInflateBegin(&inflater);
+    TEST_ASSERT_TRUE(webSocketInflate(&inflater, out, n, true, Collect, NULL));
+    inflate_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    TEST_ASSERT_EQUAL(chunk, inflated.size());
+    TEST_ASSERT_EQUAL_MEMORY(in, inflated.data(), chunk);
+  }
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%4u B chunks: %.1f%% of the input, %u of %u sent as they are, deflate %.1f us/KB, inflate %.1f us/KB",
+           (unsigned)chunk, bytes_out * 100.0 / log.size(), (unsigned)skipped, (unsigned)(log.size() / chunk),
+           deflate_us * 1024 / log.size(), inflate_us * 1024 / log.size());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(bytes_out < log.size());
+}
+
+void setUp()
+{
+  memset(&deflater, 0, sizeof(deflater));
+}
+
+void tearDown()
+{
+}
+
+void test_128_byte_chunks() { Run(128); }
+void test_512_byte_chunks() { Run(512); }
+void test_2048_byte_chunks() { Run(2048); }
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_128_byte_chunks);
+  RUN_TEST(test_512_byte_chunks);
+  RUN_TEST(test_2048_byte_chunks);
+  return UNITY_END();
+}
@@ -0,0 +1,88 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#include <AsyncWebMask.h>
+
+//Unmasking a 64 KB payload a byte at a time, as _onData() did, against
+//webSocketMask(), for word aligned and unaligned data; best of RUNS, host
+//time, so only the ratio carries over to the ESP8266
+#define PAYLOAD (64 * 1024)
+#define RUNS    50
+
+static const uint8_t key[4] = { 0xA1, 0x5C, 0x03, 0xFE };
+
+__attribute__((noinline)) static void PerByte(uint8_t *data, size_t len, const uint8_t *mask, size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    data[i] ^= mask[(offset + i) % 4];
+  }
+}
+
+static void Run(size_t align)
+{
+  std::vector<uint8_t> buf(PAYLOAD + 8);
+  double per_byte = 1e9, word = 1e9;
+  for (int r = 0; r < RUNS; r++)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    PerByte(&buf[align], PAYLOAD, key, r);
+    auto t1 = std::chrono::steady_clock::now();
+    webSocketMask(&buf[align], PAYLOAD, key, r);
+    auto t2 = std::chrono::steady_clock::now();
+    per_byte = std::min(per_byte, std::chrono::duration<double, std::micro>(t1 - t0).count());
+    word = std::min(word, std::chrono::duration<double, std::micro>(t2 - t1).count());
+  }
+  //both ran RUNS times with the same offsets, the payload is back as it was
+  for (size_t i = 0; i < PAYLOAD; i++)
+  {
+    TEST_ASSERT_EQUAL(0, buf[align + i]);
+  }
+  char msg[120];
+  snprintf(msg, sizeof(msg), "64 KB, %s: per byte %.1f us, word %.1f us (%.1fx)",
+           align ? "unaligned" : "aligned", per_byte, word, per_byte / word);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(word < per_byte);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_aligned() { Run(0); }
+void test_unaligned() { Run(1); }
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_aligned);
+  RUN_TEST(test_unaligned);
+  return UNITY_END();
+}
@@ -0,0 +1,207 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <Wire.h>
+#include <StatusView.h>
+
+//Status updates on the 128x64 SSD1306 through the I2C model in
+//test/stubs/Wire.h, which counts bus bytes (address bytes included) and
+//keeps the controller's RAM, so every update is also checked to leave the
+//panel showing the frame buffer.
+
+//getBuffer() marks the whole screen dirty, the check must not
+struct Panel : public Adafruit_SSD1306
+{
+  using Adafruit_SSD1306::Adafruit_SSD1306;
+  const uint8_t *frame() const { return buffer; }
+};
+
+static Panel *display;
+static StatusView *view;
+
+//What the panel shows is what the frame buffer holds
+static void CheckPanel()
+{
+  TEST_ASSERT_EQUAL_MEMORY(display->frame(), Wire.ram, sizeof(Wire.ram));
+}
+
+//Runs service() as loop() would until the next frame has been sent,
+//returns its bus bytes
+static uint32_t Frame()
+{
+  delay(STATUS_VIEW_FRAME_MS);
+  Wire.resetCounters();
+  view->service();
+  while (view->busy())
+  {
+    view->service();
+  }
+  CheckPanel();
+  return Wire.bytes;
+}
+
+static void Report(const char *name, uint32_t bytes)
+{
+  char msg[100];
+  snprintf(msg, sizeof(msg), "%s: %u bus bytes", name, (unsigned)bytes);
+  TEST_MESSAGE(msg);
+}
+
+void setUp()
+{
+  HostClock::set(1000000);
+  memset(Wire.ram, 0, sizeof(Wire.ram));
+  display = new Panel(128, 64, &Wire, -1);
+  TEST_ASSERT_TRUE(display->begin(SSD1306_SWITCHCAPVCC, 0x3C));
+  view = new StatusView();
+  view->begin(display);
+  view->setIP(IPAddress(192, 168, 4, 1));
+  view->setBaud(115200);
+  Frame();
+}
+
+void tearDown()
+{
+  delete view;
+  delete display;
+}
+
+//The old path: display() of the whole frame after every UART read
+void test_full_frame()
+{
+  display->markDirty(0, 0, 127, 7);
+  Wire.resetCounters();
+  display->display();
+  CheckPanel();
+  Report("display(), full frame", Wire.bytes);
+  TEST_ASSERT_TRUE(Wire.bytes > 1024);
+}
+
+void test_status_updates()
+{
+  view->invalidate();
+  uint32_t redraw = Frame();
+  Report("status view, full redraw", redraw);
+
+  view->onRx(200);
+  uint32_t first_rx = Frame();
+  Report("RX marker on and counter", first_rx);
+  view->onRx(37);
+  uint32_t tick = Frame();
+  Report("RX counter tick", tick);
+  delay(STATUS_VIEW_ACTIVITY_MS);
+  uint32_t marker = Frame();
+  Report("RX marker off", marker);
+  uint32_t idle = Frame();
+  Report("idle frame", idle);
+
+  view->setClients(1, 0);
+  view->event("Telnet ", IPAddress(192, 168, 4, 2));
+  uint32_t connect = Frame();
+  Report("client connect", connect);
+
+  TEST_ASSERT_EQUAL(0, idle);
+  TEST_ASSERT_TRUE(tick < 64);
+  TEST_ASSERT_TRUE(marker < 32);
+  TEST_ASSERT_TRUE(connect < 300);
+  TEST_ASSERT_TRUE(redraw <= 1100);
+}
+
+//The partial display() API on its own, one character cell
+void test_partial_window()
+{
+  display->drawChar(60, 24, 'X', SSD1306_WHITE, SSD1306_BLACK, 1);
+  Wire.resetCounters();
+  display->display(60, 3, 65, 3);
+  CheckPanel();
+  Report("display(60, 3, 65, 3)", Wire.bytes);
+  TEST_ASSERT_TRUE(Wire.bytes < 20);
+  //the dirty tracking found the same cell
+  display->drawChar(0, 56, 'Y', SSD1306_WHITE, SSD1306_BLACK, 1);
+  Wire.resetCounters();
+  display->display();
+  CheckPanel();
+  TEST_ASSERT_TRUE(Wire.bytes < 20);
+}
+
+//A full frame sent in slices from loop(): the longest a single pass waits
+//on the bus, against the blocking display()
+void test_sliced_transfer_stall()
+{
+  display->markDirty(0, 0, 127, 7);
+  uint32_t start = micros();
+  display->display();
+  uint32_t blocking = micros() - start;
+
+  view->invalidate();
+  delay(STATUS_VIEW_FRAME_MS);
+  uint32_t worst = 0, passes = 0;
+  do
+  {
+    start = micros();
+    view->service();
+    if (micros() - start > worst) worst = micros() - start;
+    passes++;
+  }
+  while (view->busy());
+  CheckPanel();
+  char msg[120];
+  snprintf(msg, sizeof(msg), "full frame: display() blocks %u us, sliced %u passes of at most %u us",
+           (unsigned)blocking, (unsigned)passes, (unsigned)worst);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(worst * 4 < blocking);
+}
+
+//Drawing goes on while a frame is on the wire, the panel gets the frame as
+//it was when the transfer started and the change in the next one
+void test_draw_during_transfer()
+{
+  display->fillRect(0, 0, 128, 64, SSD1306_WHITE);
+  TEST_ASSERT_TRUE(display->startDisplay());
+  uint8_t sent[8 * 128];
+  memcpy(sent, display->frame(), sizeof(sent));
+  display->displayService();
+  display->fillRect(0, 0, 64, 64, SSD1306_BLACK);
+  while (!display->displayService())
+  {
+  }
+  TEST_ASSERT_EQUAL_MEMORY(sent, Wire.ram, sizeof(Wire.ram));
+  TEST_ASSERT_TRUE(display->isDirty());
+  display->startDisplay();
+  while (!display->displayService())
+  {
+  }
+  CheckPanel();
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_full_frame);
+  RUN_TEST(test_status_updates);
+  RUN_TEST(test_partial_window);
+  RUN_TEST(test_sliced_transfer_stall);
+  RUN_TEST(test_draw_during_transfer);
+  return UNITY_END();
+}
@@ -0,0 +1,162 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <deque>
+#include <string>
+#include <HostUart.h>
+#include <TxPacer.h>
+
+//A U-Boot style script pasted at 115200 baud into a target without flow
+//control: it reads its 16 byte RX FIFO as bytes arrive, but stops reading
+//for 20 ms to run each command when it sees the line end, and whatever
+//arrives while that FIFO is full is lost.
+#define BAUD         115200
+#define PASS_US      100
+#define TARGET_FIFO  16
+#define TARGET_RUN_US 20000
+#define LINES        32
+
+static HostUart *uart;
+static TxPacer *pacer;
+
+//The target, fed from the UART wire in arrival order
+struct Target
+{
+  size_t seen = 0;
+  uint64_t free = 0;            //when it reads again
+  std::deque<uint64_t> pending; //read times of bytes waiting in its FIFO
+  std::string got;
+  uint32_t lost = 0;
+
+  void update(const HostUart &uart)
+  {
+    while (seen < uart.wire.size())
+    {
+      uint64_t at = uart.sentAt[seen];
+      char c = uart.wire[seen++];
+      while (!pending.empty() && pending.front() <= at)
+      {
+        pending.pop_front();
+      }
+      if (pending.size() >= TARGET_FIFO)
+      {
+        lost++;
+        continue;
+      }
+      uint64_t read = at > free ? at : free;
+      free = read + (c == '\r' ? TARGET_RUN_US : 0);
+      pending.push_back(read);
+      got += c;
+    }
+  }
+};
+
+static std::string Script()
+{
+  std::string s;
+  for (int i = 0; i < LINES; i++)
+  {
+    char line[80];
+    snprintf(line, sizeof(line), "setenv arg%02d console=ttyS0,%d root=/dev/mmcblk0p2\r", i, BAUD);
+    s += line;
+  }
+  return s;
+}
+
+//Pastes the script in one piece and runs loop() until it is out
+static void Paste(const char *name, Target &target)
+{
+  std::string script = Script();
+  TEST_ASSERT_EQUAL(script.size(), pacer->push((const uint8_t*)script.data(), script.size()));
+  uint32_t start = micros();
+  while (pacer->queued() > 0)
+  {
+    if (pacer->ready())
+    {
+      pacer->service();
+    }
+    delayMicroseconds(PASS_US);
+    uart->availableForWrite();
+    target.update(*uart);
+  }
+  uart->drain();
+  target.update(*uart);
+  uint32_t us = micros() - start;
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%s: %u bytes in %.2f s, %.0f B/s (%.0f%% of line rate), target lost %u (%.1f%%)",
+           name, (unsigned)script.size(), us / 1000000.0, script.size() / (us / 1000000.0),
+           script.size() * 100 / (us / 1000000.0) / (BAUD / 10.0), (unsigned)target.lost,
+           target.lost * 100.0 / script.size());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(script.size(), target.got.size() + target.lost);
+  TEST_ASSERT_EQUAL(0, pacer->droppedBytes());
+}
+
+void setUp()
+{
+  HostClock::set(1000000);
+  uart = new HostUart(BAUD);
+  pacer = new TxPacer(*uart);
+}
+
+void tearDown()
+{
+  delete pacer;
+  delete uart;
+}
+
+void test_unpaced()
+{
+  Target target;
+  Paste("unpaced", target);
+  TEST_ASSERT_TRUE(target.lost > 0);
+}
+
+//One character per millisecond still outruns a 20 ms command
+void test_char_delay()
+{
+  pacer->setPacing(1000, 0);
+  Target target;
+  Paste("char_us=1000", target);
+  TEST_ASSERT_TRUE(target.lost > 0);
+}
+
+//A gap after each line longer than the command runs loses nothing
+void test_line_delay()
+{
+  pacer->setPacing(0, 25);
+  Target target;
+  Paste("line_ms=25", target);
+  TEST_ASSERT_EQUAL(0, target.lost);
+  TEST_ASSERT_EQUAL_STRING(Script().c_str(), target.got.c_str());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_unpaced);
+  RUN_TEST(test_char_delay);
+  RUN_TEST(test_line_delay);
+  return UNITY_END();
+}
@@ -0,0 +1,185 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <Wire.h>
+#include <HostUart.h>
+#include <Adafruit_SSD1306.h>
+#include <TelnetServer.h>
+#include <TxPacer.h>
+
+//A script pasted into telnet at 115200 baud. The client sends it as fast as
+//the network allows, one MSS sized segment per millisecond; the old path
+//read it a byte at a time with a blocking Serial.write() and a full OLED
+//frame per byte, the new one takes each segment whole through TelnetServer
+//into TxPacer, which loop() drains into the TX FIFO every pass.
+#define BAUD     115200
+#define SEG_US   1000
+#define PASS_US  100   //rest of a loop() pass
+
+static HostUart *uart;
+static TxPacer *pacer;
+static TelnetServer *server;
+static AsyncClient *client;
+static uint32_t accepted;
+
+static std::string Script(size_t size)
+{
+  std::string s;
+  for (int i = 0; s.size() < size; i++)
+  {
+    char line[80];
+    snprintf(line, sizeof(line), "setenv bootargs${%d} console=ttyS0,%d root=/dev/mmcblk0p%d rw\r\n", i, BAUD, i % 4);
+    s += line;
+  }
+  s.resize(size);
+  return s;
+}
+
+static void Input(const uint8_t *data, size_t len)
+{
+  accepted += pacer->push(data, len);
+  pacer->service();
+}
+
+static void Report(const char *name, size_t size, uint32_t us)
+{
+  char msg[160];
+  double rate = accepted / (us / 1000000.0);
+  snprintf(msg, sizeof(msg), "%s, %u bytes: %.2f s, %.0f B/s (%.0f%% of line rate), %u dropped",
+           name, (unsigned)size, us / 1000000.0, rate, rate * 100 / (BAUD / 10.0),
+           (unsigned)(size - accepted));
+  TEST_MESSAGE(msg);
+}
+
+void setUp()
+{
+  HostClock::set(1000000);
+  uart = new HostUart(BAUD);
+  pacer = new TxPacer(*uart);
+  server = new TelnetServer(23);
+  server->begin();
+  server->onInput(Input);
+  client = new AsyncClient();
+  AsyncServer::accept(23, client);
+  accepted = 0;
+}
+
+void tearDown()
+{
+  client->disconnect();
+  delete server;
+  delete pacer;
+  delete uart;
+}
+
+//The old CheckTelnetClientData(): read(), Serial.write() and display()
+//of the whole frame for every byte
+void test_byte_at_a_time()
+{
+  Adafruit_SSD1306 display(128, 64, &Wire, -1);
+  TEST_ASSERT_TRUE(display.begin(SSD1306_SWITCHCAPVCC, 0x3C));
+  std::string script = Script(2048);
+  uint32_t start = micros();
+  for (char c : script)
+  {
+    while (uart->write((uint8_t)c) == 0)
+    {
+      HostClock::advance(1);
+    }
+    accepted++;
+    display.print("<");
+    display.markDirty(0, 0, 127, 7);
+    display.display();
+  }
+  uart->drain();
+  Report("byte at a time", script.size(), micros() - start);
+  TEST_ASSERT_EQUAL_STRING(script.c_str(), uart->wire.c_str());
+}
+
+//Segments go in whole, returns the simulated time until the UART sent the
+//last byte the queue took
+static uint32_t Paste(const std::string &script)
+{
+  uint32_t start = micros();
+  uint32_t next_segment = start;
+  size_t sent = 0;
+  while (sent < script.size() || pacer->queued() > 0)
+  {
+    if (sent < script.size() && (int32_t)(micros() - next_segment) >= 0)
+    {
+      size_t n = script.size() - sent < client->mss ? script.size() - sent : client->mss;
+      client->receive(script.data() + sent, n);
+      sent += n;
+      next_segment += SEG_US;
+    }
+    if (pacer->ready())
+    {
+      pacer->service();
+    }
+    delayMicroseconds(PASS_US);
+  }
+  uart->drain();
+  return micros() - start;
+}
+
+//Up to the queue and the FIFO the paste goes out at line rate, complete
+void test_bulk()
+{
+  static const size_t sizes[] = { 256, 1024, UART_TX_QUEUE_SIZE };
+  for (size_t size : sizes)
+  {
+    uart->wire.clear();
+    accepted = 0;
+    std::string script = Script(size);
+    uint32_t us = Paste(script);
+    Report("bulk", size, us);
+    TEST_ASSERT_EQUAL(size, accepted);
+    TEST_ASSERT_EQUAL_STRING(script.c_str(), uart->wire.c_str());
+    //within a segment time and a pass of the bytes' own line time
+    TEST_ASSERT_UINT32_WITHIN(SEG_US + PASS_US, size * uart->frameNanos() / 1000, us);
+  }
+}
+
+//A larger paste arriving at once keeps the head and drops the tail that no
+//longer fits, the UART still runs at line rate
+void test_bulk_overflow()
+{
+  std::string script = Script(4 * UART_TX_QUEUE_SIZE);
+  uint32_t us = Paste(script);
+  Report("bulk", script.size(), us);
+  TEST_ASSERT_TRUE(accepted < script.size());
+  TEST_ASSERT_EQUAL(script.size() - accepted, pacer->droppedBytes());
+  TEST_ASSERT_EQUAL_STRING(script.substr(0, accepted).c_str(), uart->wire.c_str());
+  TEST_ASSERT_UINT32_WITHIN(SEG_US + PASS_US, accepted * uart->frameNanos() / 1000, us);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_byte_at_a_time);
+  RUN_TEST(test_bulk);
+  RUN_TEST(test_bulk_overflow);
+  return UNITY_END();
+}
@@ -0,0 +1,191 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <HostUart.h>
+#include <Scheduler.h>
+#include <RxBatcher.h>
+
+//loop() of the bridge with the task set of initScheduler() in main.cpp,
+//over RUN_MS of simulated time at 115200 baud. Task costs are modelled
+//with delayMicroseconds(); the idle share is the time spent in the idle
+//sleep, where the WiFi stack gets the CPU and the modem may sleep. Latency
+//is from the first byte of a burst reaching the RX ring to CheckSerialData()
+//reading it.
+#define RUN_MS        10000
+#define BURST_MS      100   //a prompt or log line every 100ms when busy
+#define BURST_BYTES   80
+//modelled costs
+#define POLL_US       3     //one available()/hasClient()/status() poll
+#define WIFI_US       50    //WiFiWatchDog()
+#define READ_US       30    //read plus fan-out of a chunk, and per byte:
+#define READ_BYTE_NS  500
+#define OLED_US       300   //drawing a status frame
+
+static HostUart *uart;
+static RxBatcher *rx;
+static Scheduler *scheduler;
+static bool busy;
+static uint32_t next_burst, burst_at, burst_pending;
+static uint32_t worst_latency, total_latency, bursts;
+
+//Bursts of console output arrive at line rate
+static void Arrive()
+{
+  if (!busy || (int32_t)(millis() - next_burst) < 0)
+  {
+    return;
+  }
+  uint8_t line[BURST_BYTES];
+  memset(line, 'x', sizeof(line));
+  uart->feed(line, sizeof(line));
+  //the whole line at once, latency counts from here
+  if (burst_pending == 0) burst_at = micros();
+  burst_pending++;
+  next_burst += BURST_MS;
+}
+
+//Fan-out of a chunk that was read
+static void FanOut(size_t len)
+{
+  delayMicroseconds(READ_US + len * READ_BYTE_NS / 1000);
+  if (burst_pending > 0)
+  {
+    uint32_t latency = micros() - burst_at;
+    if (latency > worst_latency) worst_latency = latency;
+    total_latency += latency;
+    bursts++;
+    burst_pending = 0;
+  }
+}
+
+static void CheckSerialData()
+{
+  size_t len = rx->poll();
+  if (len == 0)
+  {
+    return;
+  }
+  uint8_t buf[SERIAL_COALESCE_MAX_BYTES];
+  FanOut(rx->read(buf, len));
+}
+
+void setUp()
+{
+  HostClock::set(0);
+  uart = new HostUart();
+  uart->setRxBufferSize(4096);
+  rx = new RxBatcher(*uart);
+  scheduler = new Scheduler();
+  next_burst = 0;
+  burst_pending = 0;
+  worst_latency = total_latency = bursts = 0;
+  scheduler->add("wifi", NULL, [] { delayMicroseconds(WIFI_US); }, 1000);
+  scheduler->add("idle_ip", NULL, [] { delayMicroseconds(POLL_US); }, 1000);
+  scheduler->add("uart_rx", [] { return rx->ready(); }, CheckSerialData);
+  scheduler->add("uart_tx", [] { return false; }, [] {});
+  scheduler->add("sd", [] { return false; }, [] {});
+  scheduler->add("oled", [] { return false; }, [] { delayMicroseconds(OLED_US); }, 250);
+  scheduler->add("led", [] { return false; }, [] {});
+}
+
+void tearDown()
+{
+  delete scheduler;
+  delete rx;
+  delete uart;
+}
+
+//Every ready() check is a poll too
+static void RunScheduler()
+{
+  while (millis() < RUN_MS)
+  {
+    Arrive();
+    delayMicroseconds(scheduler->count() * POLL_US);
+    scheduler->runOnce();
+  }
+}
+
+static void Report(const char *name, uint8_t idle, uint32_t passes)
+{
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%s: idle %u%%, %u passes/s, latency worst %u us mean %u us",
+           name, idle, (unsigned)(passes / (RUN_MS / 1000)), (unsigned)worst_latency,
+           (unsigned)(bursts ? total_latency / bursts : 0));
+  TEST_MESSAGE(msg);
+}
+
+//The old loop(): WiFiWatchDog(), AcceptTelnetClients(),
+//CheckTelnetClientData() for 5 clients and CheckSerialData() on every
+//pass, never idle
+void test_tight_polling()
+{
+  busy = true;
+  uint32_t passes = 0, last_wifi = 0;
+  while (millis() < RUN_MS)
+  {
+    Arrive();
+    if (millis() - last_wifi >= 1000)
+    {
+      delayMicroseconds(WIFI_US);
+      last_wifi = millis();
+    }
+    delayMicroseconds(POLL_US * (1 + 1 + 5 + 1));
+    if (uart->available() > 0)
+    {
+      uint8_t buf[SERIAL_COALESCE_MAX_BYTES];
+      FanOut(uart->readBytes(buf, sizeof(buf)));
+    }
+    passes++;
+  }
+  Report("tight polling, busy", 0, passes);
+}
+
+void test_scheduler_idle()
+{
+  busy = false;
+  RunScheduler();
+  Report("scheduler, idle", scheduler->idlePercent(), scheduler->idlePasses() + scheduler->busyPasses());
+  TEST_ASSERT_TRUE(scheduler->idlePercent() >= 95);
+}
+
+void test_scheduler_busy()
+{
+  busy = true;
+  RunScheduler();
+  Report("scheduler, line every 100ms", scheduler->idlePercent(), scheduler->idlePasses() + scheduler->busyPasses());
+  TEST_ASSERT_EQUAL(RUN_MS / BURST_MS, bursts);
+  TEST_ASSERT_TRUE(scheduler->idlePercent() >= 90);
+  //coalescing window plus one idle sleep plus the other tasks
+  TEST_ASSERT_LESS_OR_EQUAL(SERIAL_COALESCE_MAX_US + SCHED_IDLE_SLEEP_MS * 1000 + WIFI_US + OLED_US + 200, worst_latency);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tight_polling);
+  RUN_TEST(test_scheduler_idle);
+  RUN_TEST(test_scheduler_busy);
+  return UNITY_END();
+}
@@ -0,0 +1,200 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <SdLogWriter.h>
+
+//Console output logged to the SD card model of test/stubs/SD.h (write
+//call 300us + 400ns/byte, sync 6ms) for RUN_MS of simulated time. The
+//loop stall is the longest single card call a loop() pass made.
+#define RUN_MS  3000
+#define PASS_US 100   //rest of a loop() pass
+#define CHUNK   512   //SERIAL_COALESCE_MAX_BYTES, one UART read
+
+static char card[] = "/tmp/ttlbenchXXXXXX";
+static std::string output;
+
+static void RemoveCard()
+{
+  File root = SD.open("/");
+  File entry;
+  while ((entry = root.openNextFile()))
+  {
+    std::string name = entry.name();
+    entry.close();
+    unlink(HostCard::path(name.c_str()).c_str());
+  }
+}
+
+void setUp()
+{
+  strcpy(card, "/tmp/ttlbenchXXXXXX");
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  HostCard::root = card;
+  HostCard::resetStats();
+  HostClock::set(0);
+  output.clear();
+  for (int i = 0; output.size() < CHUNK; i++)
+  {
+    output += "[    1.234] eth0: link up 100Mbps full duplex\r\n";
+  }
+}
+
+void tearDown()
+{
+  RemoveCard();
+  rmdir(card);
+}
+
+static void Report(const char *name, uint64_t offered, uint64_t logged, uint32_t stall)
+{
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%s: %.1f KB/s offered, %.1f KB/s logged, worst loop stall %.2f ms",
+           name, offered / 1024.0 / (RUN_MS / 1000.0), logged / 1024.0 / (RUN_MS / 1000.0), stall / 1000.0);
+  TEST_MESSAGE(msg);
+}
+
+//The old WriteSDFileRecord(): write() and flush() on every UART read, as
+//fast as the card allows
+void test_flush_per_read()
+{
+  File file = SD.open("/RECORD.LOG", FILE_WRITE);
+  uint64_t logged = 0;
+  uint32_t stall = 0;
+  while (millis() < RUN_MS)
+  {
+    uint32_t start = micros();
+    file.write((const uint8_t*)output.data(), 64);
+    file.flush();
+    logged += 64;
+    if (micros() - start > stall) stall = micros() - start;
+    delayMicroseconds(PASS_US);
+  }
+  file.close();
+  Report("write+flush per 64 byte read", logged, logged, stall);
+  TEST_ASSERT_TRUE(stall >= HostCard::syncMicros);
+}
+
+//Offers len bytes every interval_us, returns the bytes logged
+static uint64_t Run(SdLogWriter &writer, size_t len, uint32_t interval_us, uint64_t &offered)
+{
+  uint32_t next = 0;
+  offered = 0;
+  while (millis() < RUN_MS)
+  {
+    if ((int32_t)(micros() - next) >= 0)
+    {
+      writer.record(SD_REC_RX, (const uint8_t*)output.data(), len);
+      offered += len;
+      next += interval_us;
+    }
+    if (writer.serviceDue())
+    {
+      writer.service();
+    }
+    delayMicroseconds(PASS_US);
+  }
+  uint64_t logged = offered - writer.bytesDropped();
+  writer.end();
+  return logged;
+}
+
+//Most the writer can take: a full 512 byte read on every pass
+void test_writer_throughput()
+{
+  SdLogWriter writer;
+  writer.begin();
+  HostCard::resetStats();
+  uint64_t offered;
+  uint64_t logged = Run(writer, CHUNK, 0, offered);
+  Report("write-behind, saturated", offered, logged, writer.maxServiceMicros());
+  char msg[120];
+  snprintf(msg, sizeof(msg), "%u card writes, %u syncs, %u segment rotations",
+           (unsigned)HostCard::writes, (unsigned)HostCard::syncs, (unsigned)writer.rotations());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(logged > 200 * 1024 * (RUN_MS / 1000));
+  TEST_ASSERT_LESS_OR_EQUAL(HostCard::syncMicros, writer.maxServiceMicros());
+}
+
+//921600 baud console output: nothing dropped, the loop never waits on a
+//sync it did not need
+void test_writer_921600()
+{
+  SdLogWriter writer;
+  writer.begin();
+  HostCard::resetStats();
+  uint64_t offered;
+  //512 bytes at 921600 baud take 5.56ms on the wire
+  uint64_t logged = Run(writer, CHUNK, 5556, offered);
+  Report("write-behind, 921600 baud", offered, logged, writer.maxServiceMicros());
+  TEST_ASSERT_EQUAL(0, writer.recordsDropped());
+  TEST_ASSERT_LESS_OR_EQUAL(HostCard::syncMicros, writer.maxServiceMicros());
+}
+
+//Trickle of short reads: every byte is on the card and synced within
+//SD_LOG_FLUSH_MS plus a pass
+void test_data_loss_window()
+{
+  SdLogWriter writer;
+  writer.begin();
+  writer.flush();
+  uint32_t worst = 0, offered_at = 0;
+  uint32_t synced = HostCard::syncs;
+  bool waiting = false;
+  while (millis() < RUN_MS)
+  {
+    if (!waiting && millis() % 700 == 0)
+    {
+      writer.record(SD_REC_RX, (const uint8_t*)"$ ", 2);
+      offered_at = millis();
+      synced = HostCard::syncs;
+      waiting = true;
+    }
+    if (writer.serviceDue())
+    {
+      writer.service();
+    }
+    if (waiting && HostCard::syncs != synced && writer.buffered() == 0)
+    {
+      if (millis() - offered_at > worst) worst = millis() - offered_at;
+      waiting = false;
+    }
+    delayMicroseconds(PASS_US);
+  }
+  writer.end();
+  char msg[100];
+  snprintf(msg, sizeof(msg), "data-loss window: %u ms (SD_LOG_FLUSH_MS %u)", (unsigned)worst, SD_LOG_FLUSH_MS);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_OR_EQUAL(SD_LOG_FLUSH_MS + 10, worst);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_flush_per_read);
+  RUN_TEST(test_writer_throughput);
+  RUN_TEST(test_writer_921600);
+  RUN_TEST(test_data_loss_window);
+  return UNITY_END();
+}
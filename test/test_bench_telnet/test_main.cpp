@@ -0,0 +1,257 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <HostUart.h>
+#include <TelnetServer.h>
+
+//Console output at 921600 baud fanned out to 5 telnet clients for 5
+//seconds of simulated time. The UART fills its RX ring at line rate while
+//loop() runs; every client acks what it has in flight once per RTT, so one
+//client's throughput is bounded by window / RTT.
+#define BAUD        921600
+#define RUN_MS      5000
+#define PASS_US     100   //rest of a loop() pass: WiFi stack, other tasks
+#define RTT_MS      10
+#define SLOW_RTT_MS 200
+#define RX_BUFFER   4096  //SERIAL_RX_BUFFER_SIZE in main.cpp
+#define BATCH_BYTES 512   //SERIAL_COALESCE_MAX_BYTES
+#define BATCH_US    2000  //SERIAL_COALESCE_MAX_US
+
+struct Peer
+{
+  AsyncClient *client;
+  uint32_t rttMillis;
+  uint32_t nextAck;
+};
+
+static HostUart *uart;
+static TelnetServer *server;
+static Peer peers[TELNET_MAX_CLIENTS];
+static uint64_t arrived;
+static std::string output;
+
+static void Connect(uint32_t rtt_ms)
+{
+  for (Peer &p : peers)
+  {
+    if (p.client == NULL)
+    {
+      p.client = new AsyncClient();
+      p.client->keepData = false;
+      p.rttMillis = rtt_ms;
+      p.nextAck = millis() + rtt_ms;
+      AsyncServer::accept(23, p.client);
+      return;
+    }
+  }
+}
+
+//What the target sent since the last call lands in the RX ring
+static void Arrive()
+{
+  uint64_t due = HostClock::micros * 1000 / uart->frameNanos();
+  while (arrived < due)
+  {
+    size_t n = due - arrived < 256 ? due - arrived : 256;
+    uint8_t chunk[256];
+    for (size_t i = 0; i < n; i++)
+    {
+      chunk[i] = output[(arrived + i) % output.size()];
+    }
+    uart->feed(chunk, n);
+    arrived += n;
+  }
+}
+
+static void Acks()
+{
+  for (Peer &p : peers)
+  {
+    if (p.client && (int32_t)(millis() - p.nextAck) >= 0)
+    {
+      p.client->ack();
+      p.nextAck = millis() + p.rttMillis;
+    }
+  }
+}
+
+void setUp()
+{
+  HostClock::set(0);
+  uart = new HostUart(BAUD);
+  uart->setRxBufferSize(RX_BUFFER);
+  server = new TelnetServer(23);
+  server->begin();
+  arrived = 0;
+  output.clear();
+  for (int i = 0; output.size() < 4096; i++)
+  {
+    char line[80];
+    snprintf(line, sizeof(line), "[%8.3f] eth0: rx packets %d bytes %d\r\n", i * 0.013, i * 7, i * 1514);
+    output += line;
+  }
+}
+
+void tearDown()
+{
+  for (Peer &p : peers)
+  {
+    if (p.client) p.client->disconnect();
+    p.client = NULL;
+  }
+  delete server;
+  delete uart;
+}
+
+static void Report(const char *name, uint64_t read, uint32_t passes, uint32_t max_pass, double write_us)
+{
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%s: %.1f KB/s read of %.1f KB/s sent, UART overruns %u, max pass %u us, %u passes",
+           name, read / 1024.0 / (RUN_MS / 1000.0), arrived / 1024.0 / (RUN_MS / 1000.0),
+           (unsigned)uart->overruns.load(), (unsigned)max_pass, (unsigned)passes);
+  TEST_MESSAGE(msg);
+  if (write_us > 0)
+  {
+    snprintf(msg, sizeof(msg), "%s: telnet.write() %.2f us/KB host time", name, write_us * 1024 / read);
+    TEST_MESSAGE(msg);
+  }
+}
+
+//The old CheckSerialData(): a blocking write and delay(1) per client after
+//every read, with the core's default 256 byte RX buffer
+void test_delay_per_client()
+{
+  uart->setRxBufferSize(256);
+  uint64_t read = 0;
+  uint32_t passes = 0, max_pass = 0;
+  while (millis() < RUN_MS)
+  {
+    uint32_t start = micros();
+    Arrive();
+    size_t len = uart->available();
+    if (len > 0)
+    {
+      uint8_t buf[RX_BUFFER];
+      read += uart->readBytes(buf, len);
+      delay(TELNET_MAX_CLIENTS);
+    }
+    delayMicroseconds(PASS_US);
+    passes++;
+    if (micros() - start > max_pass) max_pass = micros() - start;
+  }
+  Report("delay(1) per client", read, passes, max_pass, 0);
+  TEST_ASSERT_TRUE(uart->overruns > 0);
+}
+
+//CheckSerialData() now: coalesced reads handed to TelnetServer, which
+//queues per client and never waits
+static void Bridge(uint64_t &read, uint32_t &passes, uint32_t &max_pass, double &write_us)
+{
+  bool pending = false;
+  uint32_t pending_since = 0;
+  while (millis() < RUN_MS)
+  {
+    uint32_t start = micros();
+    Arrive();
+    Acks();
+    size_t len = uart->available();
+    if (len > 0 && !pending)
+    {
+      pending = true;
+      pending_since = micros();
+    }
+    if (len > 0 && (len >= BATCH_BYTES || micros() - pending_since >= BATCH_US))
+    {
+      if (len > BATCH_BYTES) len = BATCH_BYTES;
+      uint8_t buf[BATCH_BYTES];
+      uart->readBytes(buf, len);
+      pending = uart->available() > 0;
+      pending_since = micros();
+      auto t0 = std::chrono::steady_clock::now();
+      server->write(buf, len);
+      write_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+      read += len;
+    }
+    delayMicroseconds(PASS_US);
+    passes++;
+    if (micros() - start > max_pass) max_pass = micros() - start;
+  }
+}
+
+void test_five_clients()
+{
+  for (int i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    Connect(RTT_MS);
+  }
+  uint64_t read = 0;
+  uint32_t passes = 0, max_pass = 0;
+  double write_us = 0;
+  Bridge(read, passes, max_pass, write_us);
+  Report("5 clients", read, passes, max_pass, write_us);
+  TEST_ASSERT_EQUAL(0, uart->overruns);
+  TEST_ASSERT_EQUAL(0, server->droppedBytes());
+  for (Peer &p : peers)
+  {
+    //all but what is still queued or in flight
+    TEST_ASSERT_TRUE(p.client->bytesSent + 2 * TELNET_TX_QUEUE_SIZE + p.client->window >= read);
+  }
+}
+
+//One client on a bad link loses whole writes, the others and the UART
+//do not notice
+void test_one_slow_client()
+{
+  Connect(SLOW_RTT_MS);
+  for (int i = 1; i < TELNET_MAX_CLIENTS; i++)
+  {
+    Connect(RTT_MS);
+  }
+  uint64_t read = 0;
+  uint32_t passes = 0, max_pass = 0;
+  double write_us = 0;
+  Bridge(read, passes, max_pass, write_us);
+  Report("4 clients + 1 slow", read, passes, max_pass, write_us);
+  char msg[120];
+  snprintf(msg, sizeof(msg), "slow client got %.1f KB/s, dropped %.1f KB",
+           peers[0].client->bytesSent / 1024.0 / (RUN_MS / 1000.0), server->droppedBytes() / 1024.0);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(0, uart->overruns);
+  TEST_ASSERT_TRUE(server->droppedBytes() > 0);
+  for (int i = 1; i < TELNET_MAX_CLIENTS; i++)
+  {
+    TEST_ASSERT_TRUE(peers[i].client->bytesSent + 2 * TELNET_TX_QUEUE_SIZE + peers[i].client->window >= read);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_delay_per_client);
+  RUN_TEST(test_five_clients);
+  RUN_TEST(test_one_slow_client);
+  return UNITY_END();
+}
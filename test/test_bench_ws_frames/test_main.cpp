@@ -0,0 +1,185 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <AsyncWebSocket.h>
+
+//1 MB of console output broadcast in messages of one size to a WebSocket
+//client over the TCP model in test/stubs/ESPAsyncTCP.h (2920 byte send
+//window, MSS 1460, no Nagle as the web server sets, nothing more to send
+//until all in flight is acked). The peer acks what was sent ACK_TICKS ticks
+//earlier; loop() queues messages whenever the client can take them, so
+//small ones arrive in bursts while a send is waiting for its ack. Frames
+//are counted in what reached the peer.
+#define TOTAL_BYTES (1024 * 1024)
+#define ACK_TICKS   3
+
+static AsyncWebSocket *ws;
+static AsyncClient *tcp;
+static AsyncWebSocketClient *client;
+
+void setUp()
+{
+  HostClock::set(1000000);
+  ws = new AsyncWebSocket("/ws");
+  tcp = new AsyncClient();
+  client = new AsyncWebSocketClient(new AsyncWebServerRequest(tcp), ws);
+}
+
+void tearDown()
+{
+  tcp->disconnect();
+  delete ws;
+}
+
+//Unmasked server frames: returns how many, and their payload
+static uint32_t Frames(const std::string &stream, std::string &payload)
+{
+  uint32_t frames = 0;
+  size_t at = 0;
+  while (at + 2 <= stream.size())
+  {
+    size_t len = (uint8_t)stream[at + 1] & 0x7F;
+    size_t head = 2;
+    if (len == 126)
+    {
+      len = ((uint8_t)stream[at + 2] << 8) | (uint8_t)stream[at + 3];
+      head = 4;
+    }
+    TEST_ASSERT_TRUE(at + head + len <= stream.size());
+    payload.append(stream, at + head, len);
+    at += head + len;
+    frames++;
+  }
+  TEST_ASSERT_EQUAL(stream.size(), at);
+  return frames;
+}
+
+//one_at_a_time queues a message only when the last one is acked, which is
+//how the old _runQueue() sent them: one frame and one send() per round trip
+struct Result
+{
+  uint32_t frames, sends, segments, ticks;
+};
+
+static Result Run(size_t size, bool one_at_a_time)
+{
+  std::string message(size, ' ');
+  std::string sent;
+  uint64_t history[ACK_TICKS] = {};
+  uint64_t acked = 0;
+  uint32_t ticks = 0;
+  uint32_t messages = 0;
+  while (sent.size() < TOTAL_BYTES || client->queueLength() > 0 || tcp->inFlight() > 0)
+  {
+    while (sent.size() < TOTAL_BYTES && !client->queueIsFull() &&
+           client->queuedBytes() + size <= WS_MAX_QUEUED_BYTES &&
+           (!one_at_a_time || client->queueLength() == 0))
+    {
+      for (size_t i = 0; i < size; i++)
+      {
+        message[i] = 'a' + (messages + i) % 26;
+      }
+      client->binary(message.data(), size);
+      sent += message;
+      messages++;
+    }
+    //what went out ACK_TICKS ticks ago is acked now
+    uint64_t due = history[ticks % ACK_TICKS];
+    history[ticks % ACK_TICKS] = tcp->bytesSent;
+    if (due > acked)
+    {
+      tcp->ack(due - acked);
+      acked = due;
+    }
+    ticks++;
+    delay(1);
+  }
+  std::string payload;
+  uint32_t frames = Frames(tcp->received, payload);
+  TEST_ASSERT_TRUE(sent == payload);
+  double mb = sent.size() / (1024.0 * 1024.0);
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%4u B messages, %s: %6.0f frames, %6.0f sends, %6.0f segments, %6.0f ticks per MB",
+           (unsigned)size, one_at_a_time ? "one per round trip" : "as queued         ",
+           frames / mb, tcp->sends / mb, tcp->segments / mb, ticks / mb);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(frames <= messages);
+  TEST_ASSERT_EQUAL(0, ws->droppedBytes());
+  return { frames, tcp->sends, tcp->segments, ticks };
+}
+
+//Small binary messages queued during a round trip go out as one frame in
+//one send(), frames and segments per MB drop by at least gain. 2048 byte
+//ones fill the window alone: one message per round trip as before, and no
+//partial frames, since the next message is queued after the ack
+static void Compare(size_t size, uint32_t gain)
+{
+  Result before = Run(size, true);
+  tearDown();
+  setUp();
+  Result after = Run(size, false);
+  TEST_ASSERT_TRUE(after.frames * gain <= before.frames);
+  TEST_ASSERT_TRUE(after.segments * gain <= before.segments);
+  TEST_ASSERT_TRUE(after.ticks * gain <= before.ticks);
+}
+
+//Only binary messages are merged, a text message keeps its own frame and
+//splits the run
+void test_text_is_not_merged()
+{
+  client->binary("0");
+  client->binary("ab");
+  client->binary("cd");
+  client->text("ef");
+  client->binary("gh");
+  client->binary("ij");
+  tcp->ack();
+  const uint8_t expected[] = {
+    0x82, 1, '0',
+    0x82, 4, 'a', 'b', 'c', 'd',
+    0x81, 2, 'e', 'f',
+    0x82, 4, 'g', 'h', 'i', 'j',
+  };
+  TEST_ASSERT_EQUAL(sizeof(expected), tcp->received.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected, tcp->received.data(), sizeof(expected));
+  tcp->ack();
+  TEST_ASSERT_EQUAL(0, client->queueLength());
+}
+
+void test_32_byte_messages() { Compare(32, 8); }
+void test_128_byte_messages() { Compare(128, 8); }
+void test_512_byte_messages() { Compare(512, 2); }
+void test_2048_byte_messages() { Compare(2048, 1); }
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_text_is_not_merged);
+  RUN_TEST(test_32_byte_messages);
+  RUN_TEST(test_128_byte_messages);
+  RUN_TEST(test_512_byte_messages);
+  RUN_TEST(test_2048_byte_messages);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <deque>
+#include <CircularBuffer.h>
+
+//Capacity that makes runs wrap at odd places
+typedef CircularBuffer<uint8_t,37> Ring;
+
+static uint32_t seed;
+
+static uint32_t Random()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void CheckSame(const Ring &ring, const std::deque<uint8_t> &ref)
+{
+  TEST_ASSERT_EQUAL(ref.size(), ring.size());
+  TEST_ASSERT_EQUAL(37 - ref.size(), ring.available());
+  for (size_t i = 0; i < ref.size(); i++)
+  {
+    TEST_ASSERT_EQUAL_UINT8(ref[i], ring[i]);
+  }
+  //at most two runs, together the whole content
+  Ring::index_t n1, n2;
+  const uint8_t *run1 = ring.span(0, n1);
+  const uint8_t *run2 = ring.span(n1, n2);
+  TEST_ASSERT_EQUAL(ref.size(), n1 + n2);
+  for (size_t i = 0; i < n1; i++) TEST_ASSERT_EQUAL_UINT8(ref[i], run1[i]);
+  for (size_t i = 0; i < n2; i++) TEST_ASSERT_EQUAL_UINT8(ref[n1 + i], run2[i]);
+}
+
+void setUp()
+{
+  seed = 1;
+}
+
+void tearDown()
+{
+}
+
+void test_push_bulk_fits()
+{
+  Ring ring;
+  uint8_t data[30];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i;
+  TEST_ASSERT_TRUE(ring.push(data, 20));
+  ring.shift(NULL, 15);
+  //wraps around the end of the storage
+  TEST_ASSERT_TRUE(ring.push(data, 30));
+  TEST_ASSERT_EQUAL(35, ring.size());
+  uint8_t out[35];
+  TEST_ASSERT_EQUAL(35, ring.copyOut(out, sizeof(out)));
+  for (uint8_t i = 0; i < 5; i++) TEST_ASSERT_EQUAL_UINT8(15 + i, out[i]);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out + 5, 30);
+}
+
+void test_push_bulk_overwrites_oldest()
+{
+  Ring ring;
+  uint8_t data[50];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i;
+  TEST_ASSERT_TRUE(ring.push(data, 10));
+  TEST_ASSERT_FALSE(ring.push(data + 10, 40));
+  TEST_ASSERT_TRUE(ring.isFull());
+  TEST_ASSERT_EQUAL_UINT8(13, ring.first());
+  TEST_ASSERT_EQUAL_UINT8(49, ring.last());
+  //longer than the whole buffer keeps the newest elements
+  Ring big;
+  TEST_ASSERT_FALSE(big.push(data, sizeof(data)));
+  TEST_ASSERT_EQUAL_UINT8(13, big.first());
+  TEST_ASSERT_EQUAL_UINT8(49, big.last());
+}
+
+void test_shift_bulk()
+{
+  Ring ring;
+  uint8_t data[20], out[20];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = 100 + i;
+  ring.push(data, sizeof(data));
+  TEST_ASSERT_EQUAL(8, ring.shift(out, 8));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, 8);
+  //without a destination the elements are only dropped
+  TEST_ASSERT_EQUAL(2, ring.shift(NULL, 2));
+  TEST_ASSERT_EQUAL_UINT8(110, ring.first());
+  //asking for more than there is
+  TEST_ASSERT_EQUAL(10, ring.shift(out, 30));
+  TEST_ASSERT_TRUE(ring.isEmpty());
+  TEST_ASSERT_EQUAL(0, ring.shift(out, 1));
+}
+
+void test_copy_out_does_not_remove()
+{
+  Ring ring;
+  uint8_t data[30], out[30];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i;
+  ring.push(data, 25);
+  ring.shift(NULL, 20);
+  ring.push(data, 30);
+  TEST_ASSERT_EQUAL(10, ring.copyOut(out, 10, 20));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 15, out, 10);
+  TEST_ASSERT_EQUAL(35, ring.size());
+  TEST_ASSERT_EQUAL(0, ring.copyOut(out, 10, 35));
+}
+
+void test_span_empty()
+{
+  Ring ring;
+  Ring::index_t n = 99;
+  TEST_ASSERT_NULL(ring.span(0, n));
+  TEST_ASSERT_EQUAL(0, n);
+}
+
+//Random mix of single and bulk operations against std::deque
+void test_matches_reference()
+{
+  Ring ring;
+  std::deque<uint8_t> ref;
+  for (int step = 0; step < 50000; step++)
+  {
+    uint8_t buf[80];
+    size_t n;
+    switch (Random() % 6)
+    {
+      case 0:
+        buf[0] = Random();
+        TEST_ASSERT_EQUAL(ref.size() < 37, ring.push(buf[0]));
+        ref.push_back(buf[0]);
+        if (ref.size() > 37) ref.pop_front();
+        break;
+      case 1:
+        n = Random() % sizeof(buf);
+        for (size_t i = 0; i < n; i++) buf[i] = Random();
+        TEST_ASSERT_EQUAL(ref.size() + n <= 37, ring.push(buf, n));
+        for (size_t i = 0; i < n; i++)
+        {
+          ref.push_back(buf[i]);
+          if (ref.size() > 37) ref.pop_front();
+        }
+        break;
+      case 2:
+        n = Random() % 50;
+        n = ring.shift(Random() % 2 ? buf : NULL, n);
+        TEST_ASSERT_LESS_OR_EQUAL(ref.size(), n);
+        ref.erase(ref.begin(), ref.begin() + n);
+        break;
+      case 3:
+        if (!ref.empty())
+        {
+          TEST_ASSERT_EQUAL_UINT8(ref.front(), ring.shift());
+          ref.pop_front();
+        }
+        break;
+      case 4:
+        if (!ref.empty())
+        {
+          TEST_ASSERT_EQUAL_UINT8(ref.back(), ring.pop());
+          ref.pop_back();
+        }
+        break;
+      case 5:
+      {
+        size_t index = Random() % 40;
+        n = ring.copyOut(buf, Random() % 50, index);
+        for (size_t i = 0; i < n; i++) TEST_ASSERT_EQUAL_UINT8(ref[index + i], buf[i]);
+        break;
+      }
+    }
+    CheckSame(ring, ref);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_push_bulk_fits);
+  RUN_TEST(test_push_bulk_overwrites_oldest);
+  RUN_TEST(test_shift_bulk);
+  RUN_TEST(test_copy_out_does_not_remove);
+  RUN_TEST(test_span_empty);
+  RUN_TEST(test_matches_reference);
+  return UNITY_END();
+}
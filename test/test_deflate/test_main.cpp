@@ -0,0 +1,310 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <AsyncWebDeflate.h>
+
+static AsyncWebDeflater deflater;
+static AsyncWebInflater inflater;
+
+//Raw DEFLATE bits, codes MSB first as RFC 1951 packs them
+struct BitWriter
+{
+  std::string out;
+  uint32_t bits = 0;
+  uint8_t count = 0;
+
+  void put(uint32_t value, uint8_t n)
+  {
+    bits |= value << count;
+    count += n;
+    while (count >= 8)
+    {
+      out += (char)(bits & 0xFF);
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  void code(uint32_t code, uint8_t n)
+  {
+    for (uint8_t i = n; i > 0; i--) put((code >> (i - 1)) & 1, 1);
+  }
+  void align()
+  {
+    if (count > 0) put(0, 8 - count);
+  }
+  //header of the empty stored block whose 00 00 FF FF the peer leaves out
+  std::string finish()
+  {
+    put(0, 3);
+    align();
+    return out;
+  }
+  void literal(uint8_t c) { code(0x30 + c, 8); }
+  void endOfBlock() { code(0, 7); }
+};
+
+//Log like text, lines repeat with small changes as a terminal's output does
+static std::string Text(size_t len)
+{
+  std::string text;
+  uint32_t seed = 1;
+  for (int i = 0; text.size() < len; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    char line[100];
+    switch ((seed >> 16) % 3)
+    {
+      case 0: snprintf(line, sizeof(line), "[%8.3f] usb 1-1: new high-speed USB device number %u\r\n", i * 0.013, (seed >> 8) % 10); break;
+      case 1: snprintf(line, sizeof(line), "[%8.3f] systemd[1]: Started Session %u of user root.\r\n", i * 0.013, (seed >> 4) % 1000); break;
+      default: snprintf(line, sizeof(line), "\x1b[0;32m  OK  \x1b[0m] Reached target Network is Online.\r\n"); break;
+    }
+    text += line;
+  }
+  return text.substr(0, len);
+}
+
+struct Sink
+{
+  std::string data;
+  int pieces = 0;
+  bool ended = false;
+};
+
+static void Collect(void *arg, uint8_t *data, size_t len, bool last)
+{
+  Sink *sink = (Sink*)arg;
+  TEST_ASSERT_FALSE(sink->ended);
+  TEST_ASSERT_LESS_OR_EQUAL(1 << WS_INFLATE_WINDOW_BITS, len);
+  sink->data.append((const char*)data, len);
+  sink->pieces++;
+  sink->ended = last;
+}
+
+//Feeds a message the way frames arrive, piece bytes at a time
+static bool Inflate(const std::string &in, size_t piece, Sink &sink)
+{
+  webSocketInflateBegin(&inflater);
+  for (size_t i = 0; i < in.size() || i == 0; i += piece)
+  {
+    size_t n = in.size() - i < piece ? in.size() - i : piece;
+    if (!webSocketInflate(&inflater, (const uint8_t*)in.data() + i, n, i + n >= in.size(), Collect, &sink))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::string Deflate(const std::string &in)
+{
+  std::string out(in.size() + 64, '\0');
+  size_t n = webSocketDeflate(&deflater, (const uint8_t*)in.data(), in.size(), (uint8_t*)&out[0], out.size());
+  out.resize(n);
+  return out;
+}
+
+void setUp()
+{
+  memset(&deflater, 0, sizeof(deflater));
+}
+
+void tearDown()
+{
+}
+
+void test_round_trip()
+{
+  static const size_t sizes[] = { 32, 100, 512, 2048, 5000, 20000 };
+  static const size_t pieces[] = { 1, 3, 64, 1400, 100000 };
+  for (size_t size : sizes)
+  {
+    std::string text = Text(size);
+    std::string compressed = Deflate(text);
+    TEST_ASSERT_TRUE(compressed.size() > 0);
+    for (size_t piece : pieces)
+    {
+      Sink sink;
+      TEST_ASSERT_TRUE(Inflate(compressed, piece, sink));
+      TEST_ASSERT_TRUE(sink.ended);
+      TEST_ASSERT_TRUE(text == sink.data);
+    }
+  }
+}
+
+//Nothing from the previous message is referenced, the match finder left
+//over from it included
+void test_messages_are_independent()
+{
+  std::string a = Text(1000), b = Text(3000).substr(1000);
+  std::string first = Deflate(a);
+  Deflate(b);
+  TEST_ASSERT_TRUE(first == Deflate(a));
+  TEST_ASSERT_TRUE(Deflate(a).size() < a.size() / 2);
+}
+
+//Incompressible input does not fit in max and is reported, never overruns
+void test_output_limit()
+{
+  std::string noise;
+  uint32_t seed = 7;
+  for (int i = 0; i < 1000; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    noise += (char)(seed >> 16);
+  }
+  uint8_t out[1000 + 16];
+  memset(out, 0xA5, sizeof(out));
+  TEST_ASSERT_EQUAL(0, webSocketDeflate(&deflater, (const uint8_t*)noise.data(), noise.size(), out, 999));
+  for (size_t i = 999; i < sizeof(out); i++)
+  {
+    TEST_ASSERT_EQUAL_HEX8(0xA5, out[i]);
+  }
+  std::string text = Text(1000);
+  size_t n = Deflate(text).size();
+  TEST_ASSERT_EQUAL(0, webSocketDeflate(&deflater, (const uint8_t*)text.data(), text.size(), out, n - 1));
+  TEST_ASSERT_EQUAL(n, webSocketDeflate(&deflater, (const uint8_t*)text.data(), text.size(), out, n));
+}
+
+//Dynamic Huffman blocks as zlib sends them (level 9, 2KB window, sync flush)
+void test_zlib_dynamic_block()
+{
+  static const uint8_t zlib[] =
+  {
+    0x8c, 0xd4, 0x41, 0x8a, 0xd5, 0x41, 0x0c, 0xc4, 0xe1, 0xbd, 0xe0, 0x1d, 0xfe, 0x07, 0x90,
+    0x22, 0x95, 0xa4, 0x93, 0x8e, 0x77, 0xf0, 0x04, 0x83, 0x1b, 0x71, 0x44, 0xf1, 0x21, 0x03,
+    0x3a, 0x30, 0xc7, 0xb7, 0x71, 0x25, 0x3c, 0x1e, 0xd4, 0x3e, 0x34, 0xcd, 0x8f, 0xe2, 0x7b,
+    0xba, 0xae, 0xcb, 0x60, 0x66, 0x9f, 0xaf, 0xe7, 0x3f, 0xdf, 0xed, 0xe3, 0x75, 0xfb, 0xf1,
+    0xeb, 0xe7, 0xf5, 0xfa, 0xf2, 0xe1, 0xa2, 0x5d, 0x9f, 0xbe, 0xbc, 0xfc, 0xbe, 0xbe, 0xbd,
+    0xde, 0x6e, 0xd7, 0xd7, 0xd7, 0x97, 0xdb, 0xf3, 0xdb, 0xfb, 0x77, 0x4f, 0xe7, 0x3c, 0x60,
+    0xcd, 0x7f, 0xe7, 0xfc, 0xef, 0xdc, 0x1f, 0x9d, 0x17, 0x98, 0x7e, 0xf7, 0x7a, 0x3c, 0x3a,
+    0x1f, 0x38, 0xe3, 0xee, 0xf5, 0x47, 0x9f, 0xa1, 0xc3, 0x77, 0xde, 0xbd, 0xfe, 0xe8, 0x33,
+    0x5c, 0x88, 0xb5, 0xee, 0x5e, 0x7f, 0xf4, 0x19, 0x6e, 0xa4, 0x97, 0x5c, 0xc6, 0x89, 0x9c,
+    0x96, 0xcb, 0x78, 0x62, 0xd5, 0x96, 0xcb, 0x78, 0xa3, 0x62, 0xe4, 0x32, 0x61, 0x68, 0x9a,
+    0x5c, 0x26, 0x02, 0xbd, 0x29, 0x97, 0x89, 0xc2, 0x5e, 0x2e, 0x97, 0x89, 0xc1, 0x78, 0xc8,
+    0x65, 0xd2, 0x31, 0x93, 0x72, 0x99, 0x5c, 0xb0, 0x5a, 0x72, 0x99, 0xdc, 0x60, 0x94, 0x5c,
+    0x66, 0x11, 0x6e, 0x2d, 0x97, 0x59, 0x09, 0xef, 0x2d, 0x97, 0x59, 0x8d, 0xc8, 0x91, 0xcb,
+    0x94, 0x9d, 0x45, 0x9a, 0x5c, 0xa6, 0xe2, 0x2c, 0x92, 0x72, 0x99, 0xaa, 0xb3, 0x48, 0x97,
+    0xcb, 0xd4, 0x9c, 0x45, 0x86, 0x5c, 0xa6, 0x1d, 0x6d, 0x29, 0x97, 0xe9, 0x85, 0xee, 0x25,
+    0x97, 0xe9, 0x8d, 0x9d, 0x25, 0x97, 0xd9, 0xc4, 0xb0, 0xe5, 0x32, 0x3b, 0x31, 0x7b, 0xcb,
+    0x65, 0x76, 0xc3, 0xd6, 0xc8, 0x65, 0xc6, 0xce, 0x22, 0x75, 0x81, 0x27, 0xce, 0x22, 0x75,
+    0x81, 0xa7, 0xce, 0x22, 0x75, 0x81, 0x67, 0xce, 0x22, 0x65, 0x81, 0x69, 0x8e, 0xa4, 0x2c,
+    0x30, 0x6d, 0x21, 0xb7, 0x2c, 0x30, 0x6d, 0x63, 0x2d, 0x59, 0x60, 0x92, 0x28, 0x97, 0x05,
+    0x26, 0x13, 0x35, 0xb2, 0xc0, 0x64, 0xa3, 0x4b, 0x16, 0x98, 0x6e, 0x67, 0x91, 0xb2, 0xc0,
+    0xf4, 0x38, 0x8b, 0x94, 0x05, 0xa6, 0xd7, 0x59, 0xa4, 0x2c, 0x30, 0x7d, 0xce, 0x22, 0x65,
+    0x81, 0x19, 0x0e, 0xba, 0x2c, 0x30, 0x63, 0x81, 0x23, 0x0b, 0xcc, 0xd8, 0xf0, 0x92, 0x05,
+    0x66, 0x12, 0x11, 0xb2, 0xc0, 0xcc, 0x44, 0x9a, 0x2c, 0x30, 0xb3, 0x91, 0x2d, 0x0b, 0xcc,
+    0x65, 0x67, 0x91, 0xb2, 0xc0, 0x5c, 0x71, 0x16, 0x29, 0x0b, 0xcc, 0x55, 0x67, 0x91, 0xb2,
+    0xc0, 0x5c, 0x73, 0x16, 0x29, 0x0b, 0xcc, 0x72, 0xec, 0x90, 0x05, 0x66, 0x2d, 0x8c, 0xc9,
+    0x02, 0xb3, 0x36, 0xa6, 0x65, 0x81, 0xd9, 0x84, 0xa5, 0x2c, 0x30, 0x3b, 0x41, 0xca, 0x02,
+    0xb3, 0x1b, 0xdc, 0xa2, 0xc0, 0x7f, 0x01
+  };
+  std::string text;
+  for (int i = 0; i < 60; i++)
+  {
+    char line[64];
+    snprintf(line, sizeof(line), "[%4d.%03d] eth%d: link up, %d Mbps full duplex\r\n", i * 3, i * 71 % 1000, i % 2, 10 * (1 + i % 3));
+    text += line;
+  }
+  std::string compressed((const char*)zlib, sizeof(zlib));
+  for (size_t piece : { 1, 5, 397 })
+  {
+    Sink sink;
+    TEST_ASSERT_TRUE(Inflate(compressed, piece, sink));
+    TEST_ASSERT_TRUE(text == sink.data);
+    //2820 bytes through a 2KB window
+    TEST_ASSERT_TRUE(sink.pieces >= 2);
+  }
+}
+
+void test_stored_block()
+{
+  std::string text = Text(3000);
+  BitWriter w;
+  w.put(0, 1);
+  w.put(0, 2);
+  w.align();
+  w.put(text.size(), 16);
+  w.put(~text.size() & 0xFFFF, 16);
+  w.out += text;
+  std::string message = w.finish();
+  Sink sink;
+  TEST_ASSERT_TRUE(Inflate(message, 700, sink));
+  TEST_ASSERT_TRUE(text == sink.data);
+  //LEN and NLEN disagree
+  message[3] ^= 1;
+  Sink broken;
+  TEST_ASSERT_FALSE(Inflate(message, 700, broken));
+}
+
+void test_fixed_block_match()
+{
+  BitWriter w;
+  w.put(0, 1);
+  w.put(1, 2);
+  w.literal('a');
+  w.literal('b');
+  w.literal('c');
+  w.code(1, 7);   //length 3
+  w.code(2, 5);   //distance 3
+  w.endOfBlock();
+  Sink sink;
+  TEST_ASSERT_TRUE(Inflate(w.finish(), 1, sink));
+  TEST_ASSERT_EQUAL_STRING("abcabc", sink.data.c_str());
+}
+
+//A match before the start of the message is corrupt, not a read out of bounds
+void test_match_out_of_range()
+{
+  BitWriter w;
+  w.put(0, 1);
+  w.put(1, 2);
+  w.literal('a');
+  w.code(1, 7);   //length 3
+  w.code(21, 5);  //distance 1537 + 463
+  w.put(463, 9);
+  w.endOfBlock();
+  Sink sink;
+  TEST_ASSERT_FALSE(Inflate(w.finish(), 100, sink));
+}
+
+void test_reserved_block_type()
+{
+  Sink sink;
+  TEST_ASSERT_FALSE(Inflate(std::string("\x07\x00", 2), 2, sink));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_messages_are_independent);
+  RUN_TEST(test_output_limit);
+  RUN_TEST(test_zlib_dynamic_block);
+  RUN_TEST(test_stored_block);
+  RUN_TEST(test_fixed_block_match);
+  RUN_TEST(test_match_out_of_range);
+  RUN_TEST(test_reserved_block_type);
+  return UNITY_END();
+}
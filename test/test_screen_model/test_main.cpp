@@ -0,0 +1,258 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <ScreenModel.h>
+
+static ScreenModel model;
+static uint32_t seed;
+
+static uint32_t Random()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void Write(ScreenModel &m, const std::string &s)
+{
+  m.write((const uint8_t*)s.data(), s.size());
+}
+
+//Whole render in pieces of at most max bytes
+static std::string Render(const ScreenModel &m, size_t max = 4096)
+{
+  ScreenModel::RenderPos pos;
+  m.renderBegin(pos);
+  std::string out;
+  uint8_t piece[4096];
+  size_t n;
+  while ((n = m.render(pos, piece, max)) > 0)
+  {
+    TEST_ASSERT_LESS_OR_EQUAL(max, n);
+    out.append((const char*)piece, n);
+  }
+  TEST_ASSERT_EQUAL(ScreenModel::RENDER_DONE, pos.phase);
+  return out;
+}
+
+//The cells only, without the final cursor and mode sequences
+static std::string Screen(const std::string &render)
+{
+  return render.substr(0, render.rfind("\r\x1b["));
+}
+
+static std::string Lines(int n)
+{
+  std::string s;
+  while (n-- > 0) s += "\r\n";
+  return s;
+}
+
+void setUp()
+{
+  seed = 1;
+  model.reset();
+}
+
+void tearDown()
+{
+}
+
+void test_plain_text()
+{
+  Write(model, "hello\r\nworld");
+  std::string expected = "\x1b[0m\x1b(B" "hello\r\nworld" + Lines(22) + "\r\x1b[22A\x1b[5C\x1b[0m\x1b(B\x1b[?25h";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), Render(model).c_str());
+}
+
+void test_attributes()
+{
+  Write(model, "\x1b[1;31mred\x1b[0m plain \x1b[7mrev\x1b[m");
+  std::string expected = "\x1b[0m\x1b(B" "\x1b[0;1;31m\x1b(Bred\x1b[0m\x1b(B plain \x1b[0;7m\x1b(Brev\x1b[0m\x1b(B" + Lines(23) +
+                         "\r\x1b[23A\x1b[13C\x1b[0m\x1b(B\x1b[?25h";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), Render(model).c_str());
+}
+
+void test_cursor_region_and_modes()
+{
+  Write(model, "\x1b[2J\x1b[5;10Hx\x1b[?25l\x1b[3;20r");
+  std::string expected = "\x1b[0m\x1b(B" + Lines(4) + "         x" + Lines(19) + "\x1b[3;20r\x1b[1;1H\x1b[0m\x1b(B\x1b[?25l";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), Render(model).c_str());
+}
+
+//Escape sequences and UTF-8 split over any number of writes
+void test_split_writes()
+{
+  std::string input = "\x1b[1;33mwarn\x1b[0m \xe2\x94\x80\xe2\x94\x80 \xc3\xa9t\xc3\xa9\r\n\x1b[10;4H\x1b[Kend";
+  Write(model, input);
+  std::string whole = Render(model);
+  for (size_t step = 1; step < 5; step++)
+  {
+    ScreenModel split;
+    for (size_t i = 0; i < input.size(); i += step)
+    {
+      Write(split, input.substr(i, step));
+    }
+    TEST_ASSERT_EQUAL_STRING(whole.c_str(), Render(split).c_str());
+  }
+  TEST_ASSERT_TRUE(whole.find("\xe2\x94\x80\xe2\x94\x80 \xc3\xa9t\xc3\xa9") != std::string::npos);
+}
+
+//The output does not depend on the piece size, units never straddle pieces
+void test_render_piece_sizes()
+{
+  for (int i = 0; i < 40; i++)
+  {
+    Write(model, "\x1b[" + std::to_string(31 + i % 7) + "mline " + std::to_string(i) + " \xe2\x96\x88\x1b[0m\r\n");
+  }
+  std::string whole = Render(model, 4096);
+  TEST_ASSERT_EQUAL_STRING(whole.c_str(), Render(model, SCREEN_RENDER_MIN).c_str());
+  TEST_ASSERT_EQUAL_STRING(whole.c_str(), Render(model, SCREEN_RENDER_MIN + 1).c_str());
+  TEST_ASSERT_EQUAL_STRING(whole.c_str(), Render(model, 200).c_str());
+}
+
+//Lines scrolled off the top come first, as plain text
+void test_history()
+{
+  for (int i = 0; i < 30; i++)
+  {
+    Write(model, "\x1b[32mline " + std::to_string(i) + "\x1b[0m\r\n");
+  }
+  std::string out = Render(model);
+  TEST_ASSERT_EQUAL(0, out.find("\x1b[0m\x1b(Bline 0\r\nline 1\r\n"));
+  size_t history_end = out.find("line 6\r\n") + 8;
+  TEST_ASSERT_EQUAL(0, out.compare(history_end, 7, "\x1b[0;32m"));
+}
+
+//Once the history ring wrapped, the repaint starts at a whole line
+void test_history_wrap()
+{
+  for (int i = 0; i < 400; i++)
+  {
+    Write(model, "history line " + std::to_string(i) + "\r\n");
+  }
+  std::string out = Render(model);
+  TEST_ASSERT_EQUAL(0, out.find("\x1b[0m\x1b(Bhistory line "));
+  TEST_ASSERT_TRUE(out.find("history line 375\r\n") != std::string::npos);
+}
+
+//A repaint fed to a second model repaints the same
+void test_repaint_is_stable()
+{
+  for (int round = 0; round < 50; round++)
+  {
+    model.reset();
+    for (int i = 0; i < 30; i++)
+    {
+      std::string s = "\x1b[" + std::to_string(1 + Random() % 22) + ";" + std::to_string(1 + Random() % 70) + "H";
+      switch (Random() % 4)
+      {
+        case 0: s += "\x1b[" + std::to_string(30 + Random() % 8) + ";" + std::to_string(40 + Random() % 8) + "m"; break;
+        case 1: s += "\x1b[" + std::to_string(Random() % 3) + "K"; break;
+        case 2: s += "\x1b[0m"; break;
+        default: break;
+      }
+      s += Random() % 2 ? "text" : "\xe2\x95\x94\xe2\x95\x90";
+      Write(model, s);
+    }
+    std::string first = Render(model);
+    ScreenModel copy;
+    Write(copy, first);
+    TEST_ASSERT_EQUAL_STRING(first.c_str(), Render(copy).c_str());
+  }
+}
+
+//Entering the alternate screen keeps the shell lines as history, leaving it
+//repaints from a blank screen below them
+void test_alternate_screen()
+{
+  Write(model, "$ ls\r\nREADME\r\n$ less README\r\n");
+  Write(model, "\x1b[?1049h\x1b[2J\x1b[Hpager text\x1b[24;1H:");
+  std::string inside = Render(model);
+  TEST_ASSERT_EQUAL(0, inside.find("\x1b[0m\x1b(B$ ls\r\nREADME\r\n$ less README\r\n"));
+  TEST_ASSERT_TRUE(inside.find("pager text") != std::string::npos);
+
+  Write(model, "\x1b[?1049l$ ");
+  std::string after = Render(model);
+  TEST_ASSERT_EQUAL(0, after.find("\x1b[0m\x1b(B$ ls\r\nREADME\r\n$ less README\r\n$\r\n"));
+  TEST_ASSERT_TRUE(after.find("pager") == std::string::npos);
+  //switching to the screen already shown does nothing
+  Write(model, "\x1b[?1049l");
+  TEST_ASSERT_EQUAL_STRING(after.c_str(), Render(model).c_str());
+}
+
+//More distinct characters than the glyph table holds show as '?', and the
+//table is reused once they left the screen
+void test_glyph_table_limit()
+{
+  std::string s;
+  for (int i = 0; i < 200; i++)
+  {
+    uint16_t cp = 0x400 + i;
+    s += (char)(0xC0 | (cp >> 6));
+    s += (char)(0x80 | (cp & 0x3F));
+    if (i % 50 == 49) s += "\r\n";
+  }
+  Write(model, s);
+  std::string full = Screen(Render(model));
+  TEST_ASSERT_TRUE(full.find("?") != std::string::npos);
+  TEST_ASSERT_TRUE(full.find("\xd0\x80") != std::string::npos);
+
+  Write(model, "\x1b[2J\x1b[H\xe2\x94\x8c\xe2\x94\x90");
+  std::string cleared = Screen(Render(model));
+  TEST_ASSERT_TRUE(cleared.find("\xe2\x94\x8c\xe2\x94\x90") != std::string::npos);
+  TEST_ASSERT_TRUE(cleared.find("?") == std::string::npos);
+}
+
+//Attribute combinations beyond the palette fall back to the defaults
+void test_attribute_table_limit()
+{
+  for (int i = 0; i < 100; i++)
+  {
+    Write(model, "\x1b[" + std::to_string(30 + i % 8) + ";" + std::to_string(40 + (i / 8) % 8) + (i >= 64 ? ";1" : "") + "mx");
+  }
+  std::string full = Screen(Render(model));
+  TEST_ASSERT_TRUE(full.find("\x1b[0;31;41m") != std::string::npos);
+  TEST_ASSERT_TRUE(full.find("\x1b[0;1;") == std::string::npos);
+
+  Write(model, "\x1b[0m\x1b[2J\x1b[H\x1b[1;35mbold");
+  TEST_ASSERT_TRUE(Render(model).find("\x1b[0;1;35m\x1b(Bbold") != std::string::npos);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_plain_text);
+  RUN_TEST(test_attributes);
+  RUN_TEST(test_cursor_region_and_modes);
+  RUN_TEST(test_split_writes);
+  RUN_TEST(test_render_piece_sizes);
+  RUN_TEST(test_history);
+  RUN_TEST(test_history_wrap);
+  RUN_TEST(test_repaint_is_stable);
+  RUN_TEST(test_alternate_screen);
+  RUN_TEST(test_glyph_table_limit);
+  RUN_TEST(test_attribute_table_limit);
+  return UNITY_END();
+}
@@ -0,0 +1,408 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include <TimeLib.h>
+#include <SdLogWriter.h>
+
+struct Record
+{
+  uint8_t type;
+  uint32_t ms;
+  std::string payload;
+  uint32_t offset;
+};
+
+static char card[] = "/tmp/ttlcardXXXXXX";
+static SdLogWriter *writer;
+
+static uint32_t U32(const std::string &s, size_t i)
+{
+  return (uint8_t)s[i] | ((uint8_t)s[i + 1] << 8) | ((uint8_t)s[i + 2] << 16) | ((uint32_t)(uint8_t)s[i + 3] << 24);
+}
+
+static std::string ReadFile(const char *name)
+{
+  std::string data;
+  FILE *f = fopen(HostCard::path(name).c_str(), "rb");
+  if (f)
+  {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    fclose(f);
+  }
+  return data;
+}
+
+//Splits a segment into records, failing on broken framing
+static std::vector<Record> Records(const char *name)
+{
+  std::string data = ReadFile(name);
+  std::vector<Record> records;
+  size_t i = 0;
+  while (i < data.size())
+  {
+    TEST_ASSERT_LESS_OR_EQUAL(data.size(), i + SD_REC_HEADER_SIZE);
+    TEST_ASSERT_EQUAL_HEX8(SD_LOG_MAGIC, data[i]);
+    size_t len = (uint8_t)data[i + 2] | ((uint8_t)data[i + 3] << 8);
+    TEST_ASSERT_LESS_OR_EQUAL(data.size(), i + SD_REC_HEADER_SIZE + len);
+    records.push_back({ (uint8_t)data[i + 1], U32(data, i + 4), data.substr(i + SD_REC_HEADER_SIZE, len), (uint32_t)i });
+    i += SD_REC_HEADER_SIZE + len;
+  }
+  return records;
+}
+
+static void Log(uint8_t type, const std::string &s)
+{
+  TEST_ASSERT_TRUE(writer->record(type, (const uint8_t*)s.data(), s.size()));
+}
+
+//service() until the writer has nothing left to do
+static void Drain()
+{
+  for (int i = 0; i < 100 && writer->serviceDue(); i++)
+  {
+    writer->service();
+  }
+}
+
+static void RemoveCard()
+{
+  File root = SD.open("/");
+  File entry;
+  while ((entry = root.openNextFile()))
+  {
+    std::string name = entry.name();
+    entry.close();
+    unlink(HostCard::path(name.c_str()).c_str());
+  }
+}
+
+void setUp()
+{
+  strcpy(card, "/tmp/ttlcardXXXXXX");
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  HostCard::root = card;
+  HostCard::resetStats();
+  HostCard::failWrites = false;
+  HostClock::set(5000 * 1000ULL);
+  writer = new SdLogWriter();
+}
+
+void tearDown()
+{
+  delete writer;
+  RemoveCard();
+  rmdir(card);
+}
+
+void test_boot_record()
+{
+  TEST_ASSERT_TRUE(writer->begin());
+  writer->flush();
+  std::vector<Record> records = Records("/TTL00001.BIN");
+  TEST_ASSERT_EQUAL(1, records.size());
+  TEST_ASSERT_EQUAL(SD_REC_BOOT, records[0].type);
+  //stamped after the segment was opened
+  TEST_ASSERT_EQUAL(5000 + HostCard::openMicros / 1000, records[0].ms);
+  TEST_ASSERT_EQUAL(9, records[0].payload.size());
+  TEST_ASSERT_EQUAL_MEMORY("ETTL", records[0].payload.data(), 4);
+  TEST_ASSERT_EQUAL(SD_LOG_VERSION, records[0].payload[4]);
+  TEST_ASSERT_EQUAL_UINT32(HostTime::boot + 5, U32(records[0].payload, 5));
+}
+
+void test_records_in_order()
+{
+  writer->begin();
+  uint32_t start = millis();
+  Log(SD_REC_RX, "login: ");
+  delay(3);
+  Log(SD_REC_TX, "root\r");
+  delay(1);
+  Log(SD_REC_RX, std::string(1000, 'x'));
+  writer->flush();
+  std::vector<Record> records = Records("/TTL00001.BIN");
+  TEST_ASSERT_EQUAL(4, records.size());
+  TEST_ASSERT_EQUAL(SD_REC_RX, records[1].type);
+  TEST_ASSERT_EQUAL_STRING("login: ", records[1].payload.c_str());
+  TEST_ASSERT_EQUAL(start, records[1].ms);
+  TEST_ASSERT_EQUAL(SD_REC_TX, records[2].type);
+  TEST_ASSERT_EQUAL_STRING("root\r", records[2].payload.c_str());
+  TEST_ASSERT_EQUAL(start + 3, records[2].ms);
+  TEST_ASSERT_EQUAL(1000, records[3].payload.size());
+  TEST_ASSERT_EQUAL(start + 4, records[3].ms);
+}
+
+//A full buffer drops whole records, the file stays parseable
+void test_full_buffer_drops_whole_records()
+{
+  writer->begin();
+  std::string chunk(300, 'a');
+  int accepted = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    if (writer->record(SD_REC_RX, (const uint8_t*)chunk.data(), chunk.size())) accepted++;
+  }
+  TEST_ASSERT_EQUAL(6, accepted);
+  TEST_ASSERT_EQUAL(4, writer->recordsDropped());
+  TEST_ASSERT_EQUAL(4 * 300, writer->bytesDropped());
+  writer->flush();
+  TEST_ASSERT_EQUAL(7, Records("/TTL00001.BIN").size());
+}
+
+//Writes end on sector boundaries of the file, one sector per service() call
+void test_service_writes_whole_sectors()
+{
+  writer->begin();
+  std::string line(100, 'l');
+  for (int i = 0; i < 15; i++)
+  {
+    Log(SD_REC_RX, line);
+  }
+  TEST_ASSERT_TRUE(writer->serviceDue());
+  uint32_t written = 0;
+  while (writer->serviceDue())
+  {
+    writer->service();
+    TEST_ASSERT_EQUAL(0, writer->bytesWritten() % SD_SECTOR_SIZE);
+    TEST_ASSERT_LESS_OR_EQUAL(SD_SECTOR_SIZE, writer->bytesWritten() - written);
+    written = writer->bytesWritten();
+  }
+  TEST_ASSERT_EQUAL(3 * SD_SECTOR_SIZE, written);
+  TEST_ASSERT_EQUAL(3, HostCard::writes);
+  TEST_ASSERT_EQUAL(0, HostCard::syncs);
+}
+
+//Past the deadline the buffer is drained a sector per pass, then synced on
+//a pass of its own
+void test_deadline_drains_then_syncs()
+{
+  writer->begin();
+  std::string line(100, 'l');
+  for (int i = 0; i < 18; i++)
+  {
+    Log(SD_REC_RX, line);
+  }
+  Drain();
+  TEST_ASSERT_TRUE(writer->buffered() > 0);
+  delay(SD_LOG_FLUSH_MS);
+  TEST_ASSERT_TRUE(writer->serviceDue());
+  int passes = 0;
+  while (writer->serviceDue())
+  {
+    uint32_t writes = HostCard::writes, syncs = HostCard::syncs;
+    writer->service();
+    TEST_ASSERT_LESS_OR_EQUAL(1, (HostCard::writes - writes) + (HostCard::syncs - syncs));
+    passes++;
+  }
+  TEST_ASSERT_EQUAL(2, passes);
+  TEST_ASSERT_EQUAL(0, writer->buffered());
+  TEST_ASSERT_EQUAL(1, HostCard::syncs);
+  TEST_ASSERT_EQUAL(ReadFile("/TTL00001.BIN").size(), writer->bytesWritten());
+}
+
+//Periodic syncs after SD_LOG_FLUSH_BYTES also get a pass of their own
+void test_one_card_operation_per_pass()
+{
+  writer->begin();
+  std::string line(500, 'o');
+  for (int i = 0; i < 100; i++)
+  {
+    Log(SD_REC_RX, line);
+    while (writer->serviceDue())
+    {
+      uint32_t written = writer->bytesWritten(), syncs = HostCard::syncs;
+      writer->service();
+      //a sector may take two write calls where it wraps in the ring
+      bool wrote = writer->bytesWritten() != written;
+      TEST_ASSERT_TRUE(wrote != (HostCard::syncs != syncs));
+      TEST_ASSERT_LESS_OR_EQUAL(SD_SECTOR_SIZE, writer->bytesWritten() - written);
+    }
+  }
+  TEST_ASSERT_EQUAL(100 * 508 / SD_LOG_FLUSH_BYTES, HostCard::syncs);
+}
+
+//An index record every SD_LOG_INDEX_INTERVAL bytes, pointing at records
+void test_index_records()
+{
+  writer->begin();
+  std::string line(200, 'i');
+  for (int i = 0; i < 700; i++)
+  {
+    Log(SD_REC_RX, line);
+    delay(1);
+    Drain();
+  }
+  writer->flush();
+  std::vector<Record> records = Records("/TTL00001.BIN");
+  std::vector<Record> index;
+  for (const Record &r : records)
+  {
+    if (r.type == SD_REC_INDEX) index.push_back(r);
+  }
+  TEST_ASSERT_EQUAL(2, index.size());
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, U32(index[0].payload, 0));
+  TEST_ASSERT_EQUAL_UINT32(index[0].offset, U32(index[1].payload, 0));
+  uint16_t count = (uint8_t)index[1].payload[4] | ((uint8_t)index[1].payload[5] << 8);
+  TEST_ASSERT_EQUAL(SD_LOG_INDEX_ENTRIES, count);
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint32_t ms = U32(index[1].payload, 6 + i * 8);
+    uint32_t offset = U32(index[1].payload, 10 + i * 8);
+    bool found = false;
+    for (const Record &r : records)
+    {
+      if (r.offset == offset)
+      {
+        TEST_ASSERT_EQUAL_UINT32(r.ms, ms);
+        found = true;
+      }
+    }
+    TEST_ASSERT_TRUE(found);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, U32(index[1].payload, 6 + count * 8));
+}
+
+//Index records count the millis() wraps since boot
+void test_millis_wrap_is_counted()
+{
+  HostClock::set((0x100000000ULL - 20) * 1000);
+  writer->begin();
+  std::string line(200, 'w');
+  for (int i = 0; i < 400; i++)
+  {
+    Log(SD_REC_RX, line);
+    delay(1);
+    Drain();
+  }
+  writer->flush();
+  uint32_t wraps = 0xFFFFFFFF;
+  for (const Record &r : Records("/TTL00001.BIN"))
+  {
+    if (r.type == SD_REC_INDEX)
+    {
+      wraps = U32(r.payload, r.payload.size() - 4);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, wraps);
+}
+
+//Crossing SD_LOG_SEGMENT_SIZE closes the segment with an index, the next
+//starts with a segment record even when the buffer was full at the cut
+void test_segment_rotation()
+{
+  writer->begin();
+  std::string chunk(1000, 's');
+  uint32_t total = 0;
+  while (writer->rotations() == 0)
+  {
+    Log(SD_REC_RX, chunk);
+    total++;
+    Drain();
+  }
+  Log(SD_REC_TX, "after");
+  writer->end();
+  TEST_ASSERT_EQUAL(1, writer->rotations());
+  TEST_ASSERT_EQUAL(0, writer->recordsDropped());
+  std::vector<Record> first = Records("/TTL00001.BIN");
+  std::vector<Record> second = Records("/TTL00002.BIN");
+  TEST_ASSERT_EQUAL(SD_REC_INDEX, first.back().type);
+  TEST_ASSERT_EQUAL(SD_REC_SEGMENT, second[0].type);
+  TEST_ASSERT_EQUAL_MEMORY("ETTL", second[0].payload.data(), 4);
+  TEST_ASSERT_EQUAL_UINT32(2, U32(second[0].payload, 5));
+  TEST_ASSERT_EQUAL_STRING("after", second.back().payload.c_str());
+  uint32_t data = 0;
+  for (const Record &r : first) data += r.type == SD_REC_RX;
+  for (const Record &r : second) data += r.type == SD_REC_RX;
+  TEST_ASSERT_EQUAL_UINT32(total, data);
+}
+
+//Segment records go in also when the buffer has no room for data
+void test_segment_header_reserved()
+{
+  writer->begin();
+  std::string chunk(1000, 'r');
+  while (writer->bytesWritten() + writer->buffered() < SD_LOG_SEGMENT_SIZE - 1500)
+  {
+    Log(SD_REC_RX, chunk);
+    Drain();
+  }
+  //the card stops taking data, records pile up until the buffer is full
+  HostCard::failWrites = true;
+  while (writer->record(SD_REC_RX, (const uint8_t*)chunk.data(), chunk.size()))
+  {
+  }
+  HostCard::failWrites = false;
+  TEST_ASSERT_EQUAL(1, writer->recordsDropped());
+  while (writer->rotations() == 0)
+  {
+    writer->record(SD_REC_RX, (const uint8_t*)chunk.data(), chunk.size());
+    Drain();
+  }
+  writer->end();
+  std::vector<Record> first = Records("/TTL00001.BIN");
+  std::vector<Record> second = Records("/TTL00002.BIN");
+  TEST_ASSERT_EQUAL(SD_REC_INDEX, first.back().type);
+  TEST_ASSERT_EQUAL(SD_REC_SEGMENT, second[0].type);
+}
+
+//begin() appends to the newest segment and removes what is over the limit
+void test_begin_resumes_and_prunes()
+{
+  for (uint32_t n = 3; n <= SD_LOG_MAX_SEGMENTS + 4; n++)
+  {
+    char name[16];
+    sprintf(name, "/TTL%05u.BIN", (unsigned)n);
+    FILE *f = fopen(HostCard::path(name).c_str(), "wb");
+    fclose(f);
+  }
+  writer->begin();
+  writer->flush();
+  TEST_ASSERT_EQUAL_UINT32(SD_LOG_MAX_SEGMENTS + 4, writer->segment());
+  TEST_ASSERT_FALSE(SD.exists("/TTL00003.BIN"));
+  TEST_ASSERT_FALSE(SD.exists("/TTL00004.BIN"));
+  TEST_ASSERT_TRUE(SD.exists("/TTL00005.BIN"));
+  char last[16];
+  sprintf(last, "/TTL%05u.BIN", SD_LOG_MAX_SEGMENTS + 4);
+  TEST_ASSERT_EQUAL(SD_REC_BOOT, Records(last)[0].type);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_record);
+  RUN_TEST(test_records_in_order);
+  RUN_TEST(test_full_buffer_drops_whole_records);
+  RUN_TEST(test_service_writes_whole_sectors);
+  RUN_TEST(test_deadline_drains_then_syncs);
+  RUN_TEST(test_one_card_operation_per_pass);
+  RUN_TEST(test_index_records);
+  RUN_TEST(test_millis_wrap_is_counted);
+  RUN_TEST(test_segment_rotation);
+  RUN_TEST(test_segment_header_reserved);
+  RUN_TEST(test_begin_resumes_and_prunes);
+  return UNITY_END();
+}
@@ -0,0 +1,292 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <TelnetServer.h>
+
+#define PORT 23
+
+static TelnetServer *server;
+static AsyncClient *clients[TELNET_MAX_CLIENTS + 1];
+static std::string input;
+static IPAddress connected;
+
+static void Input(const uint8_t *data, size_t len)
+{
+  input.append((const char*)data, len);
+}
+
+static void Connected(const IPAddress &ip)
+{
+  connected = ip;
+}
+
+static AsyncClient *Connect(int i)
+{
+  clients[i] = new AsyncClient();
+  clients[i]->setRemoteIP(IPAddress(192, 168, 4, 10 + i));
+  AsyncServer::accept(PORT, clients[i]);
+  return clients[i];
+}
+
+//Peer sends, returns what the server answered
+static std::string Send(AsyncClient *c, const std::string &data)
+{
+  size_t before = c->received.size();
+  c->receive(data.data(), data.size());
+  return c->received.substr(before);
+}
+
+static std::string Cmd(uint8_t verb, uint8_t option)
+{
+  return std::string({ (char)TELNET_IAC, (char)verb, (char)option });
+}
+
+void setUp()
+{
+  input.clear();
+  connected = IPAddress();
+  server = new TelnetServer(PORT);
+  server->onInput(Input);
+  server->onConnect(Connected);
+  server->begin();
+}
+
+void tearDown()
+{
+  for (AsyncClient *&c : clients)
+  {
+    if (c) c->disconnect();
+    c = NULL;
+  }
+  delete server;
+}
+
+void test_offer_on_connect()
+{
+  AsyncClient *c = Connect(0);
+  std::string offer = Cmd(TELNET_WILL, TELNET_OPT_ECHO) + Cmd(TELNET_WILL, TELNET_OPT_SGA) +
+    Cmd(TELNET_WILL, TELNET_OPT_BINARY) + Cmd(TELNET_DO, TELNET_OPT_BINARY) + Cmd(TELNET_DO, TELNET_OPT_NAWS);
+  TEST_ASSERT_TRUE(offer == c->received);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)IPAddress(192, 168, 4, 10), (uint32_t)connected);
+  TEST_ASSERT_EQUAL(1, server->count());
+}
+
+void test_plain_data_and_escaped_iac()
+{
+  AsyncClient *c = Connect(0);
+  Send(c, "ls -l\r");
+  Send(c, std::string("a\xff\xff" "b", 4));
+  TEST_ASSERT_TRUE(std::string("ls -l\ra\xff" "b", 9) == input);
+}
+
+//Commands split over several TCP segments at every byte
+void test_split_sequences()
+{
+  AsyncClient *c = Connect(0);
+  std::string stream = std::string("x\xff\xff", 3) + Cmd(TELNET_DO, TELNET_OPT_ECHO) +
+    std::string("\xff\xfa\x1f\x00\x50\x00\x18\xff\xf0y", 10);
+  for (char ch : stream)
+  {
+    TEST_ASSERT_EQUAL(0, Send(c, std::string(1, ch)).size());
+  }
+  TEST_ASSERT_TRUE(std::string("x\xffy", 3) == input);
+  uint16_t cols, rows;
+  TEST_ASSERT_TRUE(server->windowSize(0, cols, rows));
+  TEST_ASSERT_EQUAL(80, cols);
+  TEST_ASSERT_EQUAL(24, rows);
+}
+
+//Replies to our own offer are acknowledgements, not answered again
+void test_negotiation_acknowledged()
+{
+  AsyncClient *c = Connect(0);
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_DO, TELNET_OPT_ECHO)).size());
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_DO, TELNET_OPT_SGA)).size());
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_WILL, TELNET_OPT_NAWS)).size());
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_DONT, TELNET_OPT_BINARY)).size());
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_WONT, TELNET_OPT_BINARY)).size());
+}
+
+void test_negotiation_replies()
+{
+  AsyncClient *c = Connect(0);
+  Send(c, Cmd(TELNET_DO, TELNET_OPT_ECHO));
+  //unsupported options are refused
+  TEST_ASSERT_TRUE(Cmd(TELNET_DONT, 24) == Send(c, Cmd(TELNET_WILL, 24)));
+  TEST_ASSERT_TRUE(Cmd(TELNET_WONT, 6) == Send(c, Cmd(TELNET_DO, 6)));
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_WONT, 24)).size());
+  //switching off is confirmed once, asking again for the same state is not
+  TEST_ASSERT_TRUE(Cmd(TELNET_WONT, TELNET_OPT_ECHO) == Send(c, Cmd(TELNET_DONT, TELNET_OPT_ECHO)));
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_DONT, TELNET_OPT_ECHO)).size());
+  TEST_ASSERT_TRUE(Cmd(TELNET_WILL, TELNET_OPT_ECHO) == Send(c, Cmd(TELNET_DO, TELNET_OPT_ECHO)));
+  TEST_ASSERT_EQUAL(0, Send(c, Cmd(TELNET_DO, TELNET_OPT_ECHO)).size());
+  TEST_ASSERT_EQUAL(0, input.size());
+}
+
+void test_naws_with_escaped_byte()
+{
+  AsyncClient *c = Connect(0);
+  uint16_t cols = 0, rows = 0;
+  TEST_ASSERT_FALSE(server->windowSize(0, cols, rows));
+  Send(c, std::string("\xff\xfa\x1f\x01\xff\xff\x00\x30\xff\xf0", 10));
+  TEST_ASSERT_TRUE(server->windowSize(0, cols, rows));
+  TEST_ASSERT_EQUAL(0x1FF, cols);
+  TEST_ASSERT_EQUAL(48, rows);
+  //other subnegotiations are skipped
+  Send(c, std::string("\xff\xfa\x18\x00xterm\xff\xf0z", 12));
+  TEST_ASSERT_EQUAL_STRING("z", input.c_str());
+  TEST_ASSERT_TRUE(server->windowSize(0, cols, rows));
+  TEST_ASSERT_EQUAL(0x1FF, cols);
+}
+
+void test_interrupt_process()
+{
+  AsyncClient *c = Connect(0);
+  Send(c, std::string("sleep 100\r\xff\xf4\xff\xf1", 14));
+  TEST_ASSERT_EQUAL_STRING("sleep 100\r\x03", input.c_str());
+}
+
+//A NUL after CR is padding outside binary mode, any other NUL is data
+void test_cr_nul()
+{
+  AsyncClient *c = Connect(0);
+  Send(c, std::string("ls\r\0pwd\r", 8));
+  Send(c, std::string("\0a\0b", 4));
+  TEST_ASSERT_TRUE(std::string("ls\rpwd\ra\0b", 10) == input);
+  input.clear();
+  Send(c, Cmd(TELNET_WILL, TELNET_OPT_BINARY));
+  Send(c, std::string("\r\0", 2));
+  TEST_ASSERT_TRUE(std::string("\r\0", 2) == input);
+}
+
+void test_write_escapes_iac()
+{
+  AsyncClient *c = Connect(0);
+  c->window = 65536;
+  c->received.clear();
+  std::string data;
+  for (int i = 0; i < 1000; i++)
+  {
+    data += (char)(i % 3 ? 0xFF : i);
+  }
+  server->write((const uint8_t*)data.data(), data.size());
+  std::string expected;
+  for (char ch : data)
+  {
+    expected += ch;
+    if ((uint8_t)ch == TELNET_IAC) expected += ch;
+  }
+  TEST_ASSERT_EQUAL(expected.size(), c->received.size());
+  TEST_ASSERT_TRUE(expected == c->received);
+  TEST_ASSERT_EQUAL(0, server->droppedBytes());
+}
+
+//What does not fit in the window is queued, a write that does not fit in
+//the queue is dropped whole and the queue drains on ack
+void test_queue_and_drop()
+{
+  AsyncClient *c = Connect(0);
+  c->ack();
+  c->received.clear();
+  std::string a(2000, 'a'), b(1500, 'b'), d(500, 'd'), e(100, 'e');
+  server->write((const uint8_t*)a.data(), a.size());
+  server->write((const uint8_t*)b.data(), b.size());
+  TEST_ASSERT_EQUAL(TELNET_TX_QUEUE_SIZE - (a.size() + b.size() - c->window), server->queueRoom());
+  server->write((const uint8_t*)d.data(), d.size());
+  TEST_ASSERT_EQUAL(d.size(), server->droppedBytes());
+  c->ack();
+  server->write((const uint8_t*)e.data(), e.size());
+  c->ack();
+  TEST_ASSERT_TRUE(a + b + e == c->received);
+  TEST_ASSERT_EQUAL(TELNET_TX_QUEUE_SIZE, server->queueRoom());
+  TEST_ASSERT_EQUAL(15 + a.size() + b.size() + e.size(), server->bytesSent());
+}
+
+//A slow client does not hold back the others, and only loses whole writes
+void test_slow_client()
+{
+  AsyncClient *slow = Connect(0);
+  AsyncClient *fast = Connect(1);
+  slow->ack();
+  fast->ack();
+  slow->received.clear();
+  fast->received.clear();
+  std::string sent;
+  for (int i = 0; i < 100; i++)
+  {
+    std::string line = "line " + std::string(i < 10 ? "00" : "0") + std::to_string(i) + " ";
+    line.resize(200, '0');
+    server->write((const uint8_t*)line.data(), line.size());
+    sent += line;
+    fast->ack();
+  }
+  TEST_ASSERT_TRUE(sent == fast->received);
+  TEST_ASSERT_TRUE(server->droppedBytes() > 0);
+  TEST_ASSERT_EQUAL(0, server->droppedBytes() % 200);
+  while (slow->ack())
+  {
+  }
+  TEST_ASSERT_EQUAL(sent.size(), slow->received.size() + server->droppedBytes());
+  for (size_t i = 0; i < slow->received.size(); i += 200)
+  {
+    TEST_ASSERT_TRUE(slow->received.compare(i, 5, "line ") == 0);
+  }
+}
+
+void test_client_limit_and_disconnect()
+{
+  for (int i = 0; i < TELNET_MAX_CLIENTS; i++)
+  {
+    Connect(i);
+  }
+  TEST_ASSERT_EQUAL(TELNET_MAX_CLIENTS, server->count());
+  //one too many is closed and freed by the server
+  AsyncClient *extra = new AsyncClient();
+  AsyncServer::accept(PORT, extra);
+  TEST_ASSERT_EQUAL(TELNET_MAX_CLIENTS, server->count());
+  clients[2]->disconnect();
+  clients[2] = NULL;
+  TEST_ASSERT_EQUAL(TELNET_MAX_CLIENTS - 1, server->count());
+  Connect(TELNET_MAX_CLIENTS);
+  TEST_ASSERT_EQUAL(TELNET_MAX_CLIENTS, server->count());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_offer_on_connect);
+  RUN_TEST(test_plain_data_and_escaped_iac);
+  RUN_TEST(test_split_sequences);
+  RUN_TEST(test_negotiation_acknowledged);
+  RUN_TEST(test_negotiation_replies);
+  RUN_TEST(test_naws_with_escaped_byte);
+  RUN_TEST(test_interrupt_process);
+  RUN_TEST(test_cr_nul);
+  RUN_TEST(test_write_escapes_iac);
+  RUN_TEST(test_queue_and_drop);
+  RUN_TEST(test_slow_client);
+  RUN_TEST(test_client_limit_and_disconnect);
+  return UNITY_END();
+}
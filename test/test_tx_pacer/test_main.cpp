@@ -0,0 +1,205 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <string>
+#include <HostUart.h>
+#include <TxPacer.h>
+
+#define CTS_PIN 5
+
+static HostUart *uart;
+static TxPacer *pacer;
+
+static size_t Push(const std::string &s)
+{
+  return pacer->push((const uint8_t*)s.data(), s.size());
+}
+
+static void Rx(const std::string &s)
+{
+  pacer->onRx((const uint8_t*)s.data(), s.size());
+}
+
+//loop() passes every step_us for us microseconds
+static void Run(uint32_t us, uint32_t step_us = 100)
+{
+  for (uint32_t t = 0; t < us; t += step_us)
+  {
+    pacer->service();
+    HostClock::advance(step_us);
+  }
+  uart->drain();
+}
+
+void setUp()
+{
+  HostClock::set(1000000);
+  uart = new HostUart();
+  pacer = new TxPacer(*uart);
+}
+
+void tearDown()
+{
+  delete pacer;
+  delete uart;
+}
+
+//Writes only what the FIFO takes, nothing is lost or reordered
+void test_unpaced()
+{
+  std::string data;
+  for (int i = 0; i < 1500; i++)
+  {
+    data += (char)('a' + i % 26);
+  }
+  TEST_ASSERT_EQUAL(data.size(), Push(data));
+  TEST_ASSERT_TRUE(pacer->ready());
+  pacer->service();
+  TEST_ASSERT_EQUAL(uart->fifo, pacer->bytesWritten());
+  TEST_ASSERT_FALSE(pacer->ready());
+  Run(200000);
+  TEST_ASSERT_TRUE(data == uart->wire);
+  TEST_ASSERT_EQUAL(data.size(), pacer->bytesWritten());
+  TEST_ASSERT_EQUAL(0, pacer->queued());
+  //at line rate: the FIFO never ran dry while input was queued
+  TEST_ASSERT_UINT32_WITHIN(200, (uint64_t)data.size() * uart->frameNanos() / 1000, uart->sentAt.back() - 1000000);
+}
+
+void test_queue_full_drops_tail()
+{
+  std::string data(UART_TX_QUEUE_SIZE + 100, 'x');
+  TEST_ASSERT_EQUAL(UART_TX_QUEUE_SIZE, Push(data));
+  TEST_ASSERT_EQUAL(100, pacer->droppedBytes());
+  TEST_ASSERT_EQUAL(0, Push("y"));
+  TEST_ASSERT_EQUAL(101, pacer->droppedBytes());
+  //room again, but the rest of the paste must not follow its lost middle
+  Run(100 * 1000);
+  TEST_ASSERT_TRUE(pacer->queued() > 0);
+  TEST_ASSERT_EQUAL(0, Push("z"));
+  TEST_ASSERT_EQUAL(102, pacer->droppedBytes());
+  //taken again once the queue ran empty
+  Run(300 * 1000);
+  TEST_ASSERT_EQUAL(0, pacer->queued());
+  TEST_ASSERT_EQUAL(1, Push("z"));
+  Run(1000);
+  TEST_ASSERT_EQUAL_STRING((data.substr(0, UART_TX_QUEUE_SIZE) + "z").c_str(), uart->wire.c_str());
+}
+
+void test_char_delay()
+{
+  pacer->setPacing(500, 0);
+  Push("show version\r");
+  Run(20000);
+  TEST_ASSERT_EQUAL_STRING("show version\r", uart->wire.c_str());
+  for (size_t i = 1; i < uart->queuedAt.size(); i++)
+  {
+    TEST_ASSERT_TRUE(uart->queuedAt[i] - uart->queuedAt[i - 1] >= 500);
+    TEST_ASSERT_TRUE(uart->queuedAt[i] - uart->queuedAt[i - 1] <= 600);
+  }
+}
+
+//Lines go out whole, the next one only after the line delay
+void test_line_delay()
+{
+  pacer->setPacing(0, 20);
+  Push("setenv a 1\rsetenv b 2\nsaveenv\r");
+  Run(100000);
+  TEST_ASSERT_EQUAL_STRING("setenv a 1\rsetenv b 2\nsaveenv\r", uart->wire.c_str());
+  const std::string &w = uart->wire;
+  for (size_t i = 1; i < w.size(); i++)
+  {
+    uint64_t gap = uart->queuedAt[i] - uart->queuedAt[i - 1];
+    if (w[i - 1] == '\r' || w[i - 1] == '\n')
+    {
+      TEST_ASSERT_TRUE(gap >= 20000);
+    }
+    else
+    {
+      TEST_ASSERT_EQUAL(0, gap);
+    }
+  }
+}
+
+void test_setpacing_cancels_wait()
+{
+  pacer->setPacing(0, 1000);
+  Push("a\rb");
+  pacer->service();
+  HostClock::advance(1000);
+  TEST_ASSERT_FALSE(pacer->ready());
+  pacer->setPacing(0, 0);
+  TEST_ASSERT_TRUE(pacer->ready());
+}
+
+void test_xon_xoff()
+{
+  pacer->setFlow(TxPacer::FLOW_XONXOFF);
+  Rx("login: \x13");
+  TEST_ASSERT_TRUE(pacer->held());
+  Push("root\r");
+  TEST_ASSERT_FALSE(pacer->ready());
+  Run(5000);
+  TEST_ASSERT_EQUAL(0, uart->wire.size());
+  //the last flow control byte of a chunk decides
+  Rx("\x13...\x11");
+  TEST_ASSERT_FALSE(pacer->held());
+  Run(5000);
+  TEST_ASSERT_EQUAL_STRING("root\r", uart->wire.c_str());
+  Rx("\x11\x13");
+  TEST_ASSERT_TRUE(pacer->held());
+  TEST_ASSERT_EQUAL(2, pacer->xoffs());
+  //ignored without XON/XOFF flow control
+  pacer->setFlow(TxPacer::FLOW_NONE);
+  Rx("\x13");
+  TEST_ASSERT_FALSE(pacer->held());
+}
+
+void test_cts()
+{
+  pacer->setFlow(TxPacer::FLOW_CTS, CTS_PIN);
+  //pulled up, an unplugged line holds the output
+  TEST_ASSERT_TRUE(pacer->held());
+  Push("reset\r");
+  Run(5000);
+  TEST_ASSERT_EQUAL(0, uart->wire.size());
+  HostPins::level[CTS_PIN] = LOW;
+  Run(5000);
+  TEST_ASSERT_EQUAL_STRING("reset\r", uart->wire.c_str());
+  //no pin, no CTS flow control
+  pacer->setFlow(TxPacer::FLOW_CTS, -1);
+  TEST_ASSERT_EQUAL(TxPacer::FLOW_NONE, pacer->flow());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_unpaced);
+  RUN_TEST(test_queue_full_drops_tail);
+  RUN_TEST(test_char_delay);
+  RUN_TEST(test_line_delay);
+  RUN_TEST(test_setpacing_cancels_wait);
+  RUN_TEST(test_xon_xoff);
+  RUN_TEST(test_cts);
+  return UNITY_END();
+}
@@ -0,0 +1,280 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <HostUart.h>
+#include <RxBatcher.h>
+
+//The UART RX path of the bridge: the ring of the core's uart.c (modelled in
+//HostUart, filled here by a producer thread standing in for the UART
+//interrupt) drained by RxBatcher the way CheckSerialData() does, in batches
+//read in bulk, with overruns polled through hasOverrun(). Byte i of the
+//stream has the value i % 256.
+
+#define STREAM_BYTES (256 * 1024)
+//faster than any UART, keeps the run short
+#define BYTES_PER_SEC (1024 * 1024)
+
+struct Read
+{
+  size_t start, len;
+  bool overrun;   //poll() before this read counted an overrun
+};
+
+static HostUart *uart;
+static RxBatcher *rx;
+static std::atomic<bool> producing;
+
+//Feeds the stream at BYTES_PER_SEC in FIFO-sized batches
+static void Producer()
+{
+  auto start = std::chrono::steady_clock::now();
+  uint8_t batch[16];
+  size_t sent = 0;
+  while (sent < STREAM_BYTES)
+  {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    size_t due = us * BYTES_PER_SEC / 1000000;
+    if (due > STREAM_BYTES) due = STREAM_BYTES;
+    if (due <= sent)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    size_t n = due - sent < sizeof(batch) ? due - sent : sizeof(batch);
+    for (size_t i = 0; i < n; i++)
+    {
+      batch[i] = (uint8_t)(sent + i);
+    }
+    uart->feed(batch, n);
+    sent += n;
+  }
+  producing = false;
+}
+
+//Drains the ring with RxBatcher while the producer runs, stalling stall_us
+//every few passes. Each pass is 100us of loop() time for the coalescing.
+static void Consume(std::vector<uint8_t> &data, std::vector<Read> &reads, uint32_t stall_us)
+{
+  producing = true;
+  std::thread producer(Producer);
+  uint8_t buf[SERIAL_COALESCE_MAX_BYTES];
+  for (uint32_t i = 0; ; i++)
+  {
+    bool last = !producing;
+    uint32_t overruns = rx->overruns();
+    size_t n = rx->poll();
+    bool overrun = rx->overruns() != overruns;
+    if (n > 0)
+    {
+      n = rx->read(buf, n);
+    }
+    if (n > 0 || overrun)
+    {
+      reads.push_back({ data.size(), n, overrun });
+      data.insert(data.end(), buf, buf + n);
+    }
+    if (last && uart->available() == 0)
+    {
+      break;
+    }
+    HostClock::advance(100);
+    if (stall_us > 0 && i % 8 == 0)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(stall_us));
+    }
+  }
+  producer.join();
+}
+
+//Nothing is reordered or duplicated, bytes only go missing where an
+//overrun was counted, and what was read plus what the ring discarded is the
+//whole stream. The overrun behind a gap in a read is counted by a poll
+//between the read before and the read after, the ring may have discarded
+//the bytes while the batch was coalescing or between a poll and its read.
+static void CheckStream(const std::vector<uint8_t> &data, const std::vector<Read> &reads)
+{
+  TEST_ASSERT_EQUAL(STREAM_BYTES, data.size() + uart->overruns);
+  uint32_t lost = 0;
+  for (size_t r = 0; r < reads.size(); r++)
+  {
+    for (size_t i = reads[r].start; i < reads[r].start + reads[r].len; i++)
+    {
+      uint8_t expected = i == 0 ? 0 : data[i - 1] + 1;
+      if (data[i] != expected)
+      {
+        //polled anywhere from the read before to the read after
+        bool reported = reads[r].overrun;
+        for (size_t n = r; n > 0 && reads[n - 1].len == 0 && !reported; n--)
+        {
+          reported = reads[n - 1].overrun;
+        }
+        for (size_t n = r + 1; n < reads.size() && !reported; n++)
+        {
+          reported = reads[n].overrun;
+          if (reads[n].len > 0) break;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(reported, "bytes lost without an overrun");
+        lost += (uint8_t)(data[i] - expected);
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT8((uint8_t)uart->overruns, (uint8_t)lost);
+}
+
+static void Feed(size_t len)
+{
+  static uint8_t next = 0;
+  for (size_t i = 0; i < len; i++, next++)
+  {
+    uart->feed(&next, 1);
+  }
+}
+
+void setUp()
+{
+  HostClock::set(1000000);
+  uart = new HostUart();
+  rx = new RxBatcher(*uart);
+}
+
+void tearDown()
+{
+  delete rx;
+  delete uart;
+}
+
+//A few bytes wait for more until the first of them is SERIAL_COALESCE_MAX_US old
+void test_small_batch_waits()
+{
+  Feed(10);
+  TEST_ASSERT_TRUE(rx->ready());
+  TEST_ASSERT_EQUAL(0, rx->poll());
+  TEST_ASSERT_FALSE(rx->ready());
+  HostClock::advance(SERIAL_COALESCE_MAX_US - 1);
+  Feed(10);
+  TEST_ASSERT_FALSE(rx->ready());
+  TEST_ASSERT_EQUAL(0, rx->poll());
+  HostClock::advance(1);
+  TEST_ASSERT_TRUE(rx->ready());
+  TEST_ASSERT_EQUAL(20, rx->poll());
+  uint8_t buf[20];
+  TEST_ASSERT_EQUAL(20, rx->read(buf, sizeof(buf)));
+  TEST_ASSERT_FALSE(rx->ready());
+  //the next byte starts a new clock
+  Feed(1);
+  TEST_ASSERT_EQUAL(0, rx->poll());
+  TEST_ASSERT_FALSE(rx->ready());
+}
+
+//A full batch goes at once, its leftovers right after it
+void test_full_batch_goes_at_once()
+{
+  uart->setRxBufferSize(1024);
+  Feed(SERIAL_COALESCE_MAX_BYTES + 88);
+  TEST_ASSERT_TRUE(rx->ready());
+  TEST_ASSERT_EQUAL(SERIAL_COALESCE_MAX_BYTES, rx->poll());
+  uint8_t buf[SERIAL_COALESCE_MAX_BYTES];
+  TEST_ASSERT_EQUAL(SERIAL_COALESCE_MAX_BYTES, rx->read(buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(rx->ready());
+  TEST_ASSERT_EQUAL(88, rx->poll());
+}
+
+//What does not fit the room given to poll() stays in the ring
+void test_room_limits_batch()
+{
+  uart->setRxBufferSize(1024);
+  Feed(SERIAL_COALESCE_MAX_BYTES);
+  TEST_ASSERT_EQUAL(100, rx->poll(100));
+  uint8_t buf[100];
+  TEST_ASSERT_EQUAL(100, rx->read(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(SERIAL_COALESCE_MAX_BYTES - 100, uart->available());
+  TEST_ASSERT_EQUAL(0, rx->poll(0));
+}
+
+//overruns() counts polls that found the ring had overflowed, not bytes
+void test_overruns_count_polls()
+{
+  uart->setRxBufferSize(256);
+  Feed(1000);
+  TEST_ASSERT_EQUAL(1000 - 255, uart->overruns);
+  TEST_ASSERT_EQUAL(0, rx->overruns());
+  TEST_ASSERT_EQUAL(0, rx->poll());
+  TEST_ASSERT_EQUAL(1, rx->overruns());
+  HostClock::advance(SERIAL_COALESCE_MAX_US);
+  TEST_ASSERT_EQUAL(255, rx->poll());
+  TEST_ASSERT_EQUAL(1, rx->overruns());
+  Feed(1);
+  rx->poll();
+  TEST_ASSERT_EQUAL(2, rx->overruns());
+}
+
+//A consumer that keeps up loses nothing; the ring is sized so that host
+//scheduling hiccups of the test threads do not count
+void test_consumer_keeps_up()
+{
+  uart->setRxBufferSize(65536);
+  std::vector<uint8_t> data;
+  std::vector<Read> reads;
+  Consume(data, reads, 0);
+  CheckStream(data, reads);
+  TEST_ASSERT_EQUAL(0, uart->overruns);
+  TEST_ASSERT_EQUAL(0, rx->overruns());
+  char msg[100];
+  snprintf(msg, sizeof(msg), "%u reads, %u bytes lost", (unsigned)reads.size(), (unsigned)uart->overruns.load());
+  TEST_MESSAGE(msg);
+}
+
+//A consumer stalling longer than a small ring lasts loses bytes, all of
+//them next to a counted overrun
+void test_stalled_consumer()
+{
+  uart->setRxBufferSize(256);
+  std::vector<uint8_t> data;
+  std::vector<Read> reads;
+  Consume(data, reads, 2000);
+  CheckStream(data, reads);
+  TEST_ASSERT_TRUE(uart->overruns > 0);
+  TEST_ASSERT_TRUE(rx->overruns() > 0);
+  TEST_ASSERT_TRUE(rx->overruns() <= uart->overruns);
+  char msg[100];
+  snprintf(msg, sizeof(msg), "%u reads, %u bytes lost in %u overruns", (unsigned)reads.size(),
+           (unsigned)uart->overruns.load(), (unsigned)rx->overruns());
+  TEST_MESSAGE(msg);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_small_batch_waits);
+  RUN_TEST(test_full_batch_goes_at_once);
+  RUN_TEST(test_room_limits_batch);
+  RUN_TEST(test_overruns_count_polls);
+  RUN_TEST(test_consumer_keeps_up);
+  RUN_TEST(test_stalled_consumer);
+  return UNITY_END();
+}
@@ -0,0 +1,110 @@
+/*
+    Esp WebTTL
+    Copyright (c) 2022 Nate Zhang (skyvense@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+#include <unity.h>
+#include <AsyncWebMask.h>
+
+static const uint8_t key[4] = { 0x37, 0xFA, 0x21, 0x3D };
+
+//RFC 6455 5.3, one byte at a time
+static void Reference(uint8_t *data, size_t len, const uint8_t *mask, size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    data[i] ^= mask[(offset + i) % 4];
+  }
+}
+
+static void Fill(uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    data[i] = (uint8_t)(i * 131 + 7);
+  }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+//Every start alignment, length and mask offset, and nothing around the
+//buffer touched
+void test_matches_reference()
+{
+  alignas(4) uint8_t buf[100 + 8], ref[100 + 8];
+  for (size_t align = 0; align < 4; align++)
+  {
+    for (size_t len = 0; len <= 100 - align; len++)
+    {
+      for (size_t offset = 0; offset < 8; offset++)
+      {
+        Fill(buf, sizeof(buf));
+        Fill(ref, sizeof(ref));
+        webSocketMask(buf + 4 + align, len, key, offset);
+        Reference(ref + 4 + align, len, key, offset);
+        TEST_ASSERT_EQUAL_MEMORY(ref, buf, sizeof(buf));
+      }
+    }
+  }
+}
+
+//A message masked frame by frame, each piece starting where the last ended
+void test_pieces()
+{
+  uint8_t buf[1000], ref[1000];
+  Fill(buf, sizeof(buf));
+  Fill(ref, sizeof(ref));
+  Reference(ref, sizeof(ref), key, 0);
+  size_t pos = 0, piece = 1;
+  while (pos < sizeof(buf))
+  {
+    size_t n = sizeof(buf) - pos < piece ? sizeof(buf) - pos : piece;
+    webSocketMask(buf + pos, n, key, pos);
+    pos += n;
+    piece = piece * 3 + 1;
+  }
+  TEST_ASSERT_EQUAL_MEMORY(ref, buf, sizeof(buf));
+}
+
+void test_unmask_restores()
+{
+  uint8_t buf[257], orig[257];
+  Fill(buf, sizeof(buf));
+  Fill(orig, sizeof(orig));
+  webSocketMask(buf + 1, 255, key, 2);
+  webSocketMask(buf + 1, 255, key, 2);
+  TEST_ASSERT_EQUAL_MEMORY(orig, buf, sizeof(buf));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_reference);
+  RUN_TEST(test_pieces);
+  RUN_TEST(test_unmask_restores);
+  return UNITY_END();
+}
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+"""Decode, grep and time-seek the framed Esp WebTTL SD card log.
+
+The format is described in include/SdLogWriter.h: every record has an 8 byte
+header (magic 0xE7, type, uint16 len, uint32 millis) followed by its payload.
+Timestamps are millis() since the device booted, so queries are relative to a
+boot: the last one in the log unless --boot is given. The 32 bit header times
+wrap after 49.7 days; they are extended with the wrap counts stored in index
+and segment records and by following the records in order.
+
+The log is split into TTLnnnnn.BIN segment files. Pass all of them (in any
+order, they are sorted by name); a boot continues across segments until the
+next boot record.
+
+  ttllog.py boots TTL*.BIN
+  ttllog.py cat  TTL*.BIN [--from 3:12:00] [--to 3:13:00] [--rx|--tx]
+  ttllog.py grep 'panic|Oops' TTL*.BIN [--from 3:00:00]
+  ttllog.py index TTL00007.BIN
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0xE7
+REC_BOOT, REC_RX, REC_TX, REC_INDEX, REC_SEGMENT = 1, 2, 3, 4, 5
+HEADER = struct.Struct('<BBHI')
+INDEX_INTERVAL = 65536
+WRAP = 1 << 32
+TYPE_NAMES = {REC_BOOT: 'BOOT', REC_RX: 'RX', REC_TX: 'TX', REC_INDEX: 'INDEX',
+              REC_SEGMENT: 'SEGMENT'}
+
+
+class Segment:
+    def __init__(self, path):
+        self.path = path
+        self.f = open(path, 'rb')
+        self.size = os.fstat(self.f.fileno()).st_size
+
+    def first_millis(self, start=0):
+        """Full time of the first record at or after start, as (offset, ms)."""
+        pos = resync(self.f, start, self.size)
+        hdr = read_header(self.f, pos, self.size)
+        if hdr is None:
+            return pos, None
+        rtype, length, ms = hdr
+        if rtype == REC_SEGMENT and length >= 17:
+            self.f.seek(pos + HEADER.size + 13)
+            ms |= struct.unpack('<I', self.f.read(4))[0] << 32
+        return pos, ms
+
+
+def open_segments(paths):
+    return [Segment(p) for p in sorted(paths, key=os.path.basename)]
+
+
+def unwrap(ms, near):
+    """Extends a 32 bit millis() to the full time closest to near."""
+    full = (near & ~(WRAP - 1)) | ms
+    if full < near - WRAP // 2:
+        full += WRAP
+    elif full > near + WRAP // 2:
+        full -= WRAP
+    return full
+
+
+def read_header(f, pos, size):
+    if pos + HEADER.size > size:
+        return None
+    f.seek(pos)
+    magic, rtype, length, ms = HEADER.unpack(f.read(HEADER.size))
+    if magic != MAGIC or rtype not in TYPE_NAMES or pos + HEADER.size + length > size:
+        return None
+    return rtype, length, ms
+
+
+def resync(f, pos, size):
+    """Returns the offset of the next plausible record at or after pos."""
+    while pos < size:
+        f.seek(pos)
+        chunk = f.read(4096)
+        if not chunk:
+            break
+        i = chunk.find(bytes([MAGIC]))
+        while i >= 0:
+            cand = pos + i
+            hdr = read_header(f, cand, size)
+            if hdr is not None:
+                nxt = cand + HEADER.size + hdr[1]
+                if nxt == size or read_header(f, nxt, size) is not None:
+                    return cand
+            i = chunk.find(bytes([MAGIC]), i + 1)
+        pos += len(chunk)
+    return size
+
+
+def records(f, pos, size, end=None):
+    """Yields (offset, type, millis, length) walking headers only."""
+    end = size if end is None else end
+    while pos < end:
+        hdr = read_header(f, pos, size)
+        if hdr is None:
+            pos = resync(f, pos + 1, size)
+            continue
+        rtype, length, ms = hdr
+        yield pos, rtype, ms, length
+        pos += HEADER.size + length
+
+
+def find_boots(segs):
+    """(segment number, offset) of every boot record. When the oldest segments
+    were rotated away the log starts in the middle of a boot, which is listed
+    first at (0, 0)."""
+    boots = [(i, off) for i, seg in enumerate(segs)
+             for off, rtype, _, _ in records(seg.f, 0, seg.size) if rtype == REC_BOOT]
+    if segs and (not boots or boots[0] != (0, 0)):
+        boots.insert(0, (0, 0))
+    return boots
+
+
+def index_millis(f, off, payload, count):
+    """Full time of an index record, version 1 logs have no wrap count."""
+    f.seek(off)
+    ms = HEADER.unpack(f.read(HEADER.size))[3]
+    if len(payload) >= 10 + count * 8:
+        ms |= struct.unpack_from('<I', payload, 6 + count * 8)[0] << 32
+    return ms
+
+
+def next_index(f, pos, end, size):
+    """First index record at or after pos and before end, as (offset, entries)."""
+    pos = resync(f, pos, size)
+    for off, rtype, _, length in records(f, pos, size, end):
+        if rtype == REC_BOOT and off != pos:
+            return None
+        if rtype == REC_INDEX:
+            f.seek(off + HEADER.size)
+            payload = f.read(length)
+            _, count = struct.unpack_from('<IH', payload)
+            entries = [struct.unpack_from('<II', payload, 6 + i * 8) for i in range(count)]
+            near = index_millis(f, off, payload, count)
+            return off, [(unwrap(ms, near), eoff) for ms, eoff in entries]
+        if off - pos > 2 * INDEX_INTERVAL:
+            return None
+    return None
+
+
+def seek_time(f, start, end, size, target_ms, start_ms):
+    """Offset and full time of a record at or before target_ms inside
+    [start, end), using the sparse index records instead of reading the whole
+    boot."""
+    best, best_ms = start, start_ms
+    lo, hi = 0, max(0, (end - start) // INDEX_INTERVAL)
+    while lo <= hi:
+        mid = (lo + hi) // 2
+        found = next_index(f, start + mid * INDEX_INTERVAL, end, size)
+        if found is None or not found[1]:
+            hi = mid - 1
+            continue
+        entries = found[1]
+        if entries[0][0] > target_ms:
+            hi = mid - 1
+            continue
+        for ms, off in entries:
+            if ms <= target_ms and off > best:
+                best, best_ms = off, ms
+        lo = mid + 1
+    return best, best_ms
+
+
+def parse_time(text):
+    """[[h:]m:]s[.fff] to milliseconds since boot."""
+    if text is None:
+        return None
+    secs = 0.0
+    for part in text.split(':'):
+        secs = secs * 60 + float(part)
+    return int(secs * 1000)
+
+
+def format_time(ms):
+    secs, ms = divmod(ms, 1000)
+    mins, secs = divmod(secs, 60)
+    hours, mins = divmod(mins, 60)
+    return '%d:%02d:%02d.%03d' % (hours, mins, secs, ms)
+
+
+def boot_spans(segs, boots, i):
+    """[(segment, start, end)] covered by boot i, up to the next boot."""
+    seg_i, start = boots[i]
+    end_seg, end_off = boots[i + 1] if i + 1 < len(boots) else (len(segs) - 1, segs[-1].size)
+    spans = []
+    for s in range(seg_i, end_seg + 1):
+        seg = segs[s]
+        spans.append((seg, start if s == seg_i else 0, end_off if s == end_seg else seg.size))
+    return spans
+
+
+def select_boot(segs, boot):
+    boots = find_boots(segs)
+    i = boot if boot is not None else len(boots) - 1
+    if i < 0 or i >= len(boots):
+        sys.exit('boot %d not found, log has %d' % (i, len(boots)))
+    return boot_spans(segs, boots, i)
+
+
+def payloads(segs, args):
+    spans = select_boot(segs, args.boot)
+    t_from, t_to = parse_time(args.time_from), parse_time(args.time_to)
+    first = 0
+    seg, start, _ = spans[0]
+    near = seg.first_millis(start)[1] or 0
+    if t_from is not None:
+        #last segment starting at or before the target, then its own index
+        for n, (seg, start, _) in enumerate(spans):
+            pos, ms = seg.first_millis(start)
+            if ms is not None and ms <= t_from:
+                first, near = n, ms
+        seg, start, end = spans[first]
+        pos, near = seek_time(seg.f, start, end, seg.size, t_from, near)
+        spans[first] = (seg, pos, end)
+    want = {REC_RX, REC_TX}
+    if args.rx:
+        want = {REC_RX}
+    elif args.tx:
+        want = {REC_TX}
+    for seg, pos, end in spans[first:]:
+        for off, rtype, ms, length in records(seg.f, pos, seg.size, end):
+            ms = near = unwrap(ms, near)
+            if t_from is not None and ms < t_from:
+                continue
+            if t_to is not None and ms > t_to:
+                return
+            if rtype in want:
+                seg.f.seek(off + HEADER.size)
+                yield rtype, ms, seg.f.read(length)
+
+
+def cmd_cat(args):
+    out = sys.stdout.buffer
+    for rtype, ms, data in payloads(open_segments(args.files), args):
+        if args.timestamps:
+            out.write(('\n[%s %s] ' % (format_time(ms), TYPE_NAMES[rtype])).encode())
+        out.write(data)
+    out.flush()
+
+
+def cmd_grep(args):
+    pattern = re.compile(args.pattern)
+    lines = {REC_RX: b'', REC_TX: b''}
+    stamp = {REC_RX: 0, REC_TX: 0}
+    for rtype, ms, data in payloads(open_segments(args.files), args):
+        buf = lines[rtype] + data
+        if not lines[rtype]:
+            stamp[rtype] = ms
+        parts = re.split(rb'\r\n|\n|\r', buf)
+        for line in parts[:-1]:
+            text = line.decode('utf-8', 'replace')
+            if pattern.search(text):
+                print('%s %s: %s' % (format_time(stamp[rtype]), TYPE_NAMES[rtype], text))
+            stamp[rtype] = ms
+        lines[rtype] = parts[-1]
+
+
+def cmd_boots(args):
+    segs = open_segments(args.files)
+    boots = find_boots(segs)
+    for i, (seg_i, off) in enumerate(boots):
+        seg = segs[seg_i]
+        spans = boot_spans(segs, boots, i)
+        length = sum(end - start for _, start, end in spans)
+        hdr = read_header(seg.f, off, seg.size)
+        if hdr is not None and hdr[0] == REC_BOOT:
+            seg.f.seek(off + HEADER.size)
+            tag, version, clock = struct.unpack('<4sBI', seg.f.read(9))
+            info = 'version %d, clock %d' % (version, clock)
+        else:
+            info = 'start rotated away'
+        print('boot %d: %s offset %d, %d bytes in %d segments, %s' %
+              (i, os.path.basename(seg.path), off, length, len(spans), info))
+
+
+def cmd_index(args):
+    with open(args.file, 'rb') as f:
+        size = os.fstat(f.fileno()).st_size
+        near = Segment(args.file).first_millis()[1] or 0
+        for off, rtype, ms, length in records(f, 0, size):
+            ms = near = ms if rtype == REC_BOOT else unwrap(ms, near)
+            if rtype == REC_BOOT:
+                print('boot at %d' % off)
+            elif rtype == REC_SEGMENT:
+                f.seek(off + HEADER.size)
+                _, _, number, clock = struct.unpack('<4sBII', f.read(13))
+                print('segment %d at %d (%s), clock %d' % (number, off, format_time(ms), clock))
+            elif rtype == REC_INDEX:
+                f.seek(off + HEADER.size)
+                payload = f.read(length)
+                prev, count = struct.unpack_from('<IH', payload)
+                print('index at %d (%s), previous %s, %d entries' %
+                      (off, format_time(ms), 'none' if prev == 0xFFFFFFFF else prev, count))
+                near = index_millis(f, off, payload, count)
+                for i in range(count):
+                    ems, eoff = struct.unpack_from('<II', payload, 6 + i * 8)
+                    print('  %s -> %d' % (format_time(unwrap(ems, near)), eoff))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    def add_query(p):
+        p.add_argument('files', nargs='+', metavar='file')
+        p.add_argument('--boot', type=int, help='boot number, default the last one')
+        p.add_argument('--from', dest='time_from', help='start time since boot, [[h:]m:]s')
+        p.add_argument('--to', dest='time_to', help='end time since boot, [[h:]m:]s')
+        group = p.add_mutually_exclusive_group()
+        group.add_argument('--rx', action='store_true', help='target output only')
+        group.add_argument('--tx', action='store_true', help='input sent to the target only')
+
+    p = sub.add_parser('cat', help='write payloads to stdout')
+    add_query(p)
+    p.add_argument('-t', '--timestamps', action='store_true', help='prefix each record with its time')
+    p.set_defaults(func=cmd_cat)
+
+    p = sub.add_parser('grep', help='print matching lines with their time')
+    p.add_argument('pattern')
+    add_query(p)
+    p.set_defaults(func=cmd_grep)
+
+    p = sub.add_parser('boots', help='list boot records')
+    p.add_argument('files', nargs='+', metavar='file')
+    p.set_defaults(func=cmd_boots)
+
+    p = sub.add_parser('index', help='dump the sparse index records')
+    p.add_argument('file')
+    p.set_defaults(func=cmd_index)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()